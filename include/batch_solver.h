@@ -0,0 +1,48 @@
+#pragma once
+#include "dense_gaec.h"
+#include "labeling_io.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    struct batch_instance {
+        std::string input_path;
+        // labeling is not written if empty.
+        std::string output_path;
+    };
+
+    // Instances of a manifest file or directory. A manifest lists one instance per line, optionally followed by its output path,
+    // relative paths are relative to the manifest. Empty lines and lines starting with # are skipped.
+    // A directory contributes all .txt files in name order. Without explicit output path labelings go to output_dir/<file name>, or nowhere if output_dir is empty.
+    std::vector<batch_instance> read_batch_instances(const std::string& manifest_or_directory, const std::string& output_dir);
+
+    struct batch_options {
+        dense_gaec_options solver;
+        // Instances solved at once, each with single-threaded faiss. 0 uses all OpenMP threads.
+        size_t nr_threads = 0;
+        labeling_format output_format = labeling_format::text;
+        // Only for binary output.
+        bool with_cluster_sizes = false;
+    };
+
+    struct batch_summary {
+        size_t nr_instances = 0;
+        size_t nr_failed = 0;
+        size_t nr_nodes = 0;
+        double seconds = 0.0;
+        double instances_per_second() const { return seconds > 0.0 ? (nr_instances - nr_failed) / seconds : 0.0; }
+        double nodes_per_second() const { return seconds > 0.0 ? nr_nodes / seconds : 0.0; }
+    };
+
+    // Called from the worker thread as soon as an instance is solved, after its labeling was written.
+    using batch_callback = std::function<void(const size_t instance, const dense_gaec_result& result)>;
+
+    // Solves all instances with dense GAEC on a work-stealing pool. Every thread owns a dense_gaec_solver whose workspaces are reused
+    // across its instances. Instances are spread over the threads largest file first and idle threads steal from the back of other queues.
+    // Failing instances are logged and counted, the others are still solved.
+    batch_summary solve_batch(const std::vector<batch_instance>& instances, const batch_options& options, const batch_callback& callback = nullptr);
+
+}
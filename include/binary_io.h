@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace DENSE_MULTICUT {
+
+    // Minimal in-memory serialization of trivially copyable values and vectors of them.
+    class binary_writer {
+        public:
+            template<typename T>
+            void write(const T& val)
+            {
+                static_assert(std::is_trivially_copyable<T>::value);
+                const char* p = reinterpret_cast<const char*>(&val);
+                buffer_.insert(buffer_.end(), p, p + sizeof(T));
+            }
+
+            template<typename T>
+            void write_vector(const std::vector<T>& vec)
+            {
+                write_array(vec.data(), vec.size());
+            }
+
+            // Same format as write_vector, read back with read_vector.
+            template<typename T>
+            void write_array(const T* data, const size_t size)
+            {
+                static_assert(std::is_trivially_copyable<T>::value);
+                write<size_t>(size);
+                const char* p = reinterpret_cast<const char*>(data);
+                buffer_.insert(buffer_.end(), p, p + size * sizeof(T));
+            }
+
+            void reserve(const size_t nr_bytes) { buffer_.reserve(nr_bytes); }
+            std::vector<char>& buffer() { return buffer_; }
+
+        private:
+            std::vector<char> buffer_;
+    };
+
+    class binary_reader {
+        public:
+            binary_reader(const std::vector<char>& buffer) : buffer_(buffer) {}
+
+            template<typename T>
+            T read()
+            {
+                static_assert(std::is_trivially_copyable<T>::value);
+                T val;
+                read_bytes(reinterpret_cast<char*>(&val), sizeof(T));
+                return val;
+            }
+
+            template<typename T>
+            std::vector<T> read_vector()
+            {
+                static_assert(std::is_trivially_copyable<T>::value);
+                const size_t size = read<size_t>();
+                // a corrupted size must not allocate more than the remaining data.
+                if(size > (buffer_.size() - pos_) / sizeof(T))
+                    throw std::runtime_error("unexpected end of serialized data");
+                std::vector<T> vec(size);
+                read_bytes(reinterpret_cast<char*>(vec.data()), vec.size() * sizeof(T));
+                return vec;
+            }
+
+            bool at_end() const { return pos_ == buffer_.size(); }
+
+        private:
+            void read_bytes(char* dest, const size_t nr_bytes)
+            {
+                if(pos_ + nr_bytes > buffer_.size())
+                    throw std::runtime_error("unexpected end of serialized data");
+                std::memcpy(dest, buffer_.data() + pos_, nr_bytes);
+                pos_ += nr_bytes;
+            }
+
+            const std::vector<char>& buffer_;
+            size_t pos_ = 0;
+    };
+}
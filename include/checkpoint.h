@@ -0,0 +1,64 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+
+namespace DENSE_MULTICUT {
+
+    struct checkpoint_options {
+        // Directory for checkpoints. Checkpointing is disabled if empty.
+        std::string directory = "";
+        // Write a checkpoint after this many seconds or contractions since the last one, 0 disables the respective criterion.
+        double interval_seconds = 0.0;
+        size_t interval_contractions = 0;
+        // Continue from the checkpoint in directory instead of starting from scratch.
+        bool resume = false;
+    };
+
+    // Writes serialized solver states to disk on a background thread. Serializing the state into memory happens on the solver thread
+    // and blocks it for time proportional to the state size, only the file write, fsync and rename overlap with solving.
+    // A checkpoint is only taken when the previous one has been written, hence the solver never waits for the disk and at most one
+    // serialized copy of the state exists besides the state itself. Its peak size is logged when the writer is destroyed.
+    class checkpoint_writer {
+        public:
+            // nr_contractions is the number of contractions the solve starts from, i.e. that of the checkpoint it resumes from.
+            checkpoint_writer(const checkpoint_options& options, const size_t nr_contractions = 0);
+            ~checkpoint_writer();
+
+            bool enabled() const { return enabled_; }
+            // Cheap test whether a new checkpoint should be taken, reads the clock only every few calls.
+            bool due(const size_t nr_contractions);
+            // Takes ownership of the serialized state and writes it to disk asynchronously.
+            void submit(std::vector<char>&& state, const size_t nr_contractions);
+            // Size of the last submitted state, to reserve the buffer of the next one instead of growing it by reallocation.
+            size_t size_hint() const { return last_state_bytes_; }
+
+        private:
+            void write_loop();
+
+            const checkpoint_options options_;
+            const bool enabled_;
+            std::chrono::steady_clock::time_point last_checkpoint_time_;
+            size_t last_checkpoint_contractions_ = 0;
+            size_t nr_due_calls_ = 0;
+            size_t last_state_bytes_ = 0;
+            size_t peak_state_bytes_ = 0;
+            size_t nr_checkpoints_ = 0;
+
+            std::thread thread_;
+            std::mutex mutex_;
+            std::condition_variable cv_;
+            std::vector<char> pending_;
+            bool has_pending_ = false;
+            bool stop_ = false;
+            std::atomic<bool> busy_{false};
+    };
+
+    std::string checkpoint_file(const std::string& directory);
+    void write_checkpoint(const std::string& directory, const std::vector<char>& state);
+    std::vector<char> read_checkpoint(const std::string& directory);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include <memory>
+#include <omp.h>
+
+namespace DENSE_MULTICUT {
+
+// Union find which may be used from several threads at once. Sets are linked by index, the root with smaller id is attached to the larger one,
+// so merging a node into a newly created cluster id keeps the new id as root. find compresses paths by halving with compare-and-swap and never blocks.
+template<typename INDEX = std::size_t>
+class concurrent_union_find {
+    std::unique_ptr<std::atomic<INDEX>[]> id;
+    std::size_t N = 0;
+    std::atomic<std::size_t> cnt;
+
+    public:
+    // Create union find data structure with N isolated sets. Not thread-safe.
+    void init(const std::size_t _N)
+    {
+        N = _N;
+        id = std::make_unique<std::atomic<INDEX>[]>(N);
+#pragma omp parallel for schedule(static)
+        for(std::size_t i=0; i<N; ++i)
+            id[i].store(INDEX(i), std::memory_order_relaxed);
+        cnt = N;
+    }
+
+    concurrent_union_find(const std::size_t N = 0) { init(N); }
+    std::size_t size() const { return N; }
+
+    // Return the id of component corresponding to object p.
+    INDEX find(INDEX p) {
+        assert(p < size());
+        INDEX parent = id[p].load(std::memory_order_relaxed);
+        while (p != parent) {
+            INDEX grandparent = id[parent].load(std::memory_order_relaxed);
+            // path halving: a failed exchange means another thread changed the link, which is fine either way.
+            if (parent != grandparent)
+                id[p].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+            p = grandparent;
+            parent = id[p].load(std::memory_order_relaxed);
+        }
+        return p;
+    }
+
+    // Replace sets containing x and y with their union. Returns false if x and y were already in the same set.
+    bool merge(INDEX x, INDEX y) {
+        while (true) {
+            x = find(x);
+            y = find(y);
+            if (x == y)
+                return false;
+            if (x > y)
+                std::swap(x, y);
+            // x is only linked if it is still a root, otherwise retry from the new roots.
+            INDEX expected = x;
+            if (id[x].compare_exchange_strong(expected, y, std::memory_order_acq_rel)) {
+                cnt.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    bool connected(const INDEX x, const INDEX y) {
+        // roots may change concurrently, x and y are in the same set if they agree on a root that is still a root afterwards.
+        while (true) {
+            const INDEX rx = find(x);
+            const INDEX ry = find(y);
+            if (rx == ry)
+                return true;
+            if (id[rx].load(std::memory_order_acquire) == rx)
+                return false;
+        }
+    }
+
+    // Return the number of disjoint sets.
+    std::size_t count() const {
+        return cnt.load(std::memory_order_relaxed);
+    }
+
+    // Labels 0..count()-1 numbered in the order of the smallest root id. Must not run concurrently with merge.
+    std::vector<INDEX> get_contiguous_ids()
+    {
+        // roots are found before any label is written, so that labels of roots are only read once they are final.
+        std::vector<INDEX> roots(this->size());
+        std::vector<INDEX> contiguous_ids(this->size());
+        const int nr_threads = omp_get_max_threads();
+        std::vector<std::size_t> roots_per_thread(nr_threads + 1, 0);
+#pragma omp parallel num_threads(nr_threads)
+        {
+            const int t = omp_get_thread_num();
+            const int T = omp_get_num_threads();
+            const std::size_t begin = (this->size() * t) / T;
+            const std::size_t end = (this->size() * (t + 1)) / T;
+            std::size_t nr_roots = 0;
+            for(std::size_t i=begin; i<end; ++i)
+            {
+                roots[i] = find(i);
+                if(roots[i] == i)
+                    ++nr_roots;
+            }
+            roots_per_thread[t + 1] = nr_roots;
+#pragma omp barrier
+#pragma omp single
+            std::partial_sum(roots_per_thread.begin(), roots_per_thread.end(), roots_per_thread.begin());
+            INDEX next_id = roots_per_thread[t];
+            for(std::size_t i=begin; i<end; ++i)
+                if(roots[i] == i)
+                    contiguous_ids[i] = next_id++;
+#pragma omp barrier
+            for(std::size_t i=begin; i<end; ++i)
+                if(roots[i] != i)
+                    contiguous_ids[i] = contiguous_ids[roots[i]];
+        }
+        return contiguous_ids;
+    }
+};
+
+}
@@ -3,3 +3,9 @@
 #include <tuple>
 
 std::tuple<std::vector<float>, size_t, size_t> read_file(const std::string& filename);
+
+// Graph given as one edge "i j" per line, returned as row offsets and column indices of the CSR adjacency of num_nodes nodes.
+std::tuple<std::vector<size_t>, std::vector<size_t>> read_graph_file(const std::string& filename, const size_t num_nodes);
+
+// One label per line as written by the solvers.
+std::vector<size_t> read_labeling_file(const std::string& filename);
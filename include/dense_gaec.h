@@ -1,10 +1,82 @@
+#pragma once
 #include <vector>
+#include <string>
+#include <memory>
 #include <cstddef>
+#include "merge_tree.h"
+#include "feature_index_options.h"
+#include "solve_budget.h"
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false);
+    std::vector<size_t> dense_gaec_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false, merge_tree* tree = nullptr, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
 
-    std::vector<size_t> dense_gaec_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false);
+    std::vector<size_t> dense_gaec_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false, merge_tree* tree = nullptr, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
+
+    class feature_stream;
+
+    // Dense GAEC on an input file that is still being parsed: the index is trained on the first parsed rows and the rows of each parsed chunk are added right away,
+    // so that index construction overlaps parsing. index_str is a faiss index factory string as in dense_gaec_options. Only for fp32 precision.
+    std::vector<size_t> dense_gaec_pipelined(const feature_stream& stream, const std::string& index_str = "Flat", merge_tree* tree = nullptr, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
+
+    struct dense_gaec_options {
+        // faiss index factory string, "Flat" as in dense_gaec_flat_index or "HNSW" as in dense_gaec_hnsw.
+        std::string index_str = "Flat";
+        // Offset subtracted from all edge costs, appended to the features as in append_dist_offset_in_features.
+        float dist_offset = 0.0;
+        feature_index_options index_options;
+        // Measured from the start of each solve.
+        solve_budget budget;
+    };
+
+    // Wall clock seconds per phase of one solve.
+    struct dense_gaec_timings {
+        // building the feature index, or refilling it on later solves.
+        double index = 0.0;
+        double initial_search = 0.0;
+        double contraction = 0.0;
+        // from the start of the initial search to the first contraction, 0 if nothing was contracted.
+        double first_contraction = 0.0;
+        double labeling = 0.0;
+        double total = 0.0;
+    };
+
+    struct dense_gaec_result {
+        // Cluster id of every node. Ids are union find roots and not contiguous.
+        std::vector<size_t> labels;
+        // Multicut objective including the offset term.
+        double objective = 0.0;
+        size_t nr_clusters = 0;
+        size_t nr_contractions = 0;
+        // false if the budget ran out first.
+        bool is_final = true;
+        dense_gaec_timings timings;
+    };
+
+    // Dense GAEC for many instances in a row. The feature index with its faiss allocations, the union find, the priority queue and
+    // the neighbour lists are kept between solves and only grow, so that solving instances of similar size does not allocate.
+    // Trained faiss quantizers, e.g. of IVF indices, are kept as well and fitted to the first instance only. With adaptive efSearch,
+    // the controller starts over for each solve, so that tombstone rates of one instance do not carry over to the next.
+    // The index is rebuilt when the feature dimension changes. A solver must not be used by several threads at once.
+    class dense_gaec_solver {
+        public:
+            dense_gaec_solver(const dense_gaec_options& options = {});
+            ~dense_gaec_solver();
+
+            // features holds n rows of dimension d without the offset dimension.
+            dense_gaec_result solve(const size_t n, const size_t d, const std::vector<float>& features, merge_tree* tree = nullptr);
+            // Same, reusing the label vector of result.
+            void solve(const size_t n, const size_t d, const std::vector<float>& features, dense_gaec_result& result, merge_tree* tree = nullptr);
+
+            const dense_gaec_options& options() const { return options_; }
+
+        private:
+            struct workspace;
+            const dense_gaec_options options_;
+            std::unique_ptr<workspace> workspace_;
+    };
 
 }
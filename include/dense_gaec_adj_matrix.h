@@ -1,9 +1,10 @@
 #include <vector>
 #include <cstddef>
+#include "merge_tree.h"
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_adj_matrix(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false);
+    std::vector<size_t> dense_gaec_adj_matrix(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false, merge_tree* tree = nullptr);
 
 }
 
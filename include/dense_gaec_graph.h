@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "merge_tree.h"
+#include "feature_index_options.h"
+#include "solve_budget.h"
+
+namespace DENSE_MULTICUT {
+
+    // GAEC restricted to contractions along the edges of a sparse graph, e.g. pixel or point neighbourhoods, so that every cluster is connected in the graph.
+    // The graph is given in CSR format: the neighbours of node i are column_indices[row_offsets[i]], ..., column_indices[row_offsets[i+1]-1].
+    // Edges may be listed in one or both directions, duplicates and self loops are ignored.
+    // Costs of adjacent clusters are inner products of their feature sums, computed when the edge appears, and the objective is the dense multicut objective.
+    // No faiss index is built, only the precision and the storage settings of index_options apply.
+    std::vector<size_t> dense_gaec_graph(const size_t n, const size_t d, std::vector<float> features, const std::vector<size_t>& row_offsets, const std::vector<size_t>& column_indices,
+            const bool track_dist_offset = false, merge_tree* tree = nullptr, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
+
+}
@@ -1,7 +1,12 @@
 #include <vector>
 #include <cstddef>
 #include <string>
+#include "merge_tree.h"
+#include "feature_index_options.h"
+#include "checkpoint.h"
+#include "solve_budget.h"
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_incremental_nn(const size_t n, const size_t d, std::vector<float> features, const size_t k, const std::string index_type = "Flat", const bool track_dist_offset = false);
+    std::vector<size_t> dense_gaec_incremental_nn(const size_t n, const size_t d, std::vector<float> features, const size_t k, const std::string index_type = "Flat", const bool track_dist_offset = false, merge_tree* tree = nullptr, const checkpoint_options& checkpoint = {}, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
 }
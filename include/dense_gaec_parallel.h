@@ -1,11 +1,18 @@
 #include <vector>
 #include <cstddef>
+#include "merge_tree.h"
+#include "feature_index_options.h"
+#include "solve_budget.h"
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_parallel_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false);
+    // Each round contracts a matching of nearest neighbour edges, found with maximum_matching_parallel or with the serial maximum_matching_greedy.
+    // k_candidates > 1 passes the k nearest neighbours with positive cost of every node to the matching, which needs fewer rounds.
+    std::vector<size_t> dense_gaec_parallel_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false, merge_tree* tree = nullptr, const bool greedy_matching = false, const size_t k_candidates = 1, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
 
-    std::vector<size_t> dense_gaec_parallel_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false);
+    std::vector<size_t> dense_gaec_parallel_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset = false, merge_tree* tree = nullptr, const bool greedy_matching = false, const size_t k_candidates = 1, const feature_index_options& index_options = {},
+            const solve_budget& budget = {}, solve_status* status = nullptr);
 
 }
 
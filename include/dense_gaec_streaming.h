@@ -0,0 +1,60 @@
+#pragma once
+#include "feature_index.h"
+#include <vector>
+#include <array>
+#include <string>
+#include <memory>
+#include <limits>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    struct streaming_update {
+        // Cluster label of each inserted point.
+        std::vector<size_t> new_node_labels;
+        // Existing clusters merged during the insertion as (absorbed label, surviving label), in the order of contraction.
+        std::vector<std::array<size_t,2>> merged_clusters;
+        size_t nr_contractions = 0;
+        double cost_change = 0.0;
+        double points_per_second = 0.0;
+    };
+
+    // Keeps a GAEC clustering as cluster-sum features in a persistent feature_index and inserts batches of new points.
+    // Only the new points and the clusters they reach are contracted, existing clusters are assumed to have no positive edge between each other.
+    class dense_gaec_streaming {
+        public:
+            dense_gaec_streaming(const size_t d, const float dist_offset = 0.0, const std::string& index_str = "Flat");
+
+            // Start from the clustering of n points computed by one of the solvers.
+            static dense_gaec_streaming from_labeling(const size_t n, const size_t d, const std::vector<float>& features, const std::vector<size_t>& labeling, const float dist_offset = 0.0, const std::string& index_str = "Flat");
+
+            // Binary file with cluster labels, sizes and feature sums. save writes a temporary file first and renames it, so that a failed write
+            // leaves the previous state intact.
+            static dense_gaec_streaming load(const std::string& file_path, const std::string& index_str = "Flat");
+            void save(const std::string& file_path) const;
+
+            streaming_update insert(const size_t n, const std::vector<float>& new_features);
+
+            size_t nr_clusters() const;
+            size_t dim() const { return d_; }
+            float dist_offset() const { return dist_offset_; }
+
+        private:
+            static constexpr size_t no_label = std::numeric_limits<size_t>::max();
+
+            faiss::Index::idx_t add_nodes(const size_t n, const std::vector<float>& sums, const std::vector<size_t>& sizes);
+            // Contracts the n nodes added at first_new_id with each other and with existing clusters, ids of the queue are stored as ID.
+            template<typename ID>
+            void contract_new_nodes(const faiss::Index::idx_t first_new_id, const size_t n, std::vector<size_t>& merged_into, streaming_update& update);
+            void compact();
+
+            size_t d_;
+            float dist_offset_;
+            std::string index_str_;
+            std::unique_ptr<feature_index> index_;
+            // label and number of points of every id in the feature index.
+            std::vector<size_t> node_label_;
+            std::vector<size_t> node_size_;
+            size_t next_label_ = 0;
+    };
+}
@@ -1,9 +1,36 @@
+#pragma once
 #include <vector>
 #include <cstddef>
 
 namespace DENSE_MULTICUT {
 
+    // Nodes may be weighted, i.e. represent several points with summed features. The offset dimension then holds sqrt(dist_offset) * weight.
     double cost_disconnected(const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset = false);
+
+    // cost_disconnected of rows that arrive in chunks, e.g. while parsing. Rows have dimension d including the offset dimension when tracking it.
+    class cost_disconnected_accumulator {
+        public:
+            cost_disconnected_accumulator(const size_t d, const bool track_dist_offset = false);
+            void add(const size_t n, const float* rows);
+            double cost() const;
+
+        private:
+            size_t d_;
+            bool track_dist_offset_;
+            std::vector<double> feature_sum_;
+            double squared_norm_sum_ = 0.0;
+            double offset_sum_ = 0.0;
+            double offset_sum_squares_ = 0.0;
+    };
+
     std::vector<float> append_dist_offset_in_features(const std::vector<float>& features, const float dist_offset, const size_t n, const size_t d);
+    std::vector<float> append_dist_offset_in_features(const std::vector<float>& features, const float dist_offset, const size_t n, const size_t d, const std::vector<size_t>& node_weights);
+
+    // Maps labels to 0, ..., k-1 in order of first occurrence and returns the number of clusters k. Parallel with OpenMP for labels below about 4n, as of the solvers.
+    size_t contiguous_labeling(const std::vector<size_t>& labeling, std::vector<size_t>& contiguous);
+
+    // Multicut objective of an arbitrary labeling, i.e. the summed cost <f_i,f_j> - dist_offset of all pairs in different clusters.
+    // features are without offset dimension, labels may be any numbers. Computed from cluster feature sums in O(n*d) with OpenMP.
+    double multicut_objective(const size_t n, const size_t d, const std::vector<float>& features, const std::vector<size_t>& labeling, const float dist_offset = 0.0);
 
 }
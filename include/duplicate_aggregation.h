@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Instance in which groups of (near-)duplicate feature rows are contracted to single weighted nodes.
+    // Since groups are never cut, the multicut objective of a labeling of the groups equals the one of its expansion to the original nodes.
+    struct aggregated_instance {
+        size_t n = 0;
+        // summed features of each group, n*d.
+        std::vector<float> features;
+        // number of original nodes in each group.
+        std::vector<size_t> weights;
+        // group of each original node.
+        std::vector<size_t> group;
+        // cost of the edges inside groups, already contracted. It is part of the disconnected cost of the original instance
+        // but not of the objective, i.e. cost_disconnected of the original nodes is that of the groups plus intra_group_cost.
+        double intra_group_cost = 0.0;
+    };
+
+    // Collapses exactly equal rows, and for epsilon > 0 additionally rows within max-norm distance epsilon of a group representative
+    // falling into the same grid cell of width epsilon. Rows only join a group if their edge cost to the representative is positive.
+    aggregated_instance aggregate_duplicates(const size_t n, const size_t d, const std::vector<float>& features, const float epsilon = 0.0, const float dist_offset = 0.0);
+
+    std::vector<size_t> expand_labeling(const aggregated_instance& instance, const std::vector<size_t>& labeling);
+
+}
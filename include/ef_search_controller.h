@@ -0,0 +1,58 @@
+#pragma once
+#include <mutex>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Chooses efSearch for each batch of HNSW queries from the previous batches. Tombstones take up a fraction of the search beam,
+    // so ef is scaled by the inverse of the observed rate of active results. Batches that needed k-doublings raise ef further,
+    // batches answered in the first round let it decay again, so that search effort follows the fill state of the index.
+    class ef_search_controller {
+        public:
+            ef_search_controller(const size_t base_ef = 16, const size_t max_ef = 4096)
+                : base_ef_(base_ef), max_ef_(std::max(base_ef, max_ef))
+            {}
+
+            // efSearch for a batch asking for nr_lookups results per query.
+            size_t ef_search(const size_t nr_lookups) const
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                const double ef = scale_ * std::max(base_ef_, nr_lookups) / active_rate_;
+                return std::clamp(size_t(std::ceil(ef)), std::max(base_ef_, nr_lookups), std::max(max_ef_, nr_lookups));
+            }
+
+            // nr_results returned nodes of which nr_active_results were active, answered after nr_doublings search rounds.
+            void update(const size_t nr_results, const size_t nr_active_results, const size_t nr_doublings)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(nr_results > 0)
+                    active_rate_ = 0.7 * active_rate_ + 0.3 * std::max(0.01, double(nr_active_results) / nr_results);
+                // retries mostly come from tombstones, which the rate already accounts for, so the extra factor stays small.
+                if(nr_doublings > 1)
+                    scale_ = std::min(scale_ * 1.5, max_scale);
+                else
+                    scale_ = std::max(1.0, scale_ * 0.9);
+            }
+
+            // Forget the observations, e.g. when the index is refilled for a new solve.
+            void reset()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                active_rate_ = 1.0;
+                scale_ = 1.0;
+            }
+
+            size_t base_ef() const { return base_ef_; }
+            double active_rate() const { std::lock_guard<std::mutex> lock(mutex_); return active_rate_; }
+
+        private:
+            static constexpr double max_scale = 4.0;
+            const size_t base_ef_;
+            const size_t max_ef_;
+            double active_rate_ = 1.0;
+            double scale_ = 1.0;
+            mutable std::mutex mutex_;
+    };
+}
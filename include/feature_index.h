@@ -1,33 +1,98 @@
 #pragma once
 #include <faiss/Index.h>
+#include "binary_io.h"
+#include "feature_storage.h"
+#include "feature_index_options.h"
+#include "ef_search_controller.h"
 #include <vector>
 #include <tuple>
 #include <memory>
+#include <array>
+#include <functional>
 
 namespace DENSE_MULTICUT {
 
+    // Features of active nodes and merged clusters with a faiss index over them. An empty index string only keeps the features,
+    // for solvers which compute inner products of given node pairs and never search.
     class feature_index {
         public:
-            feature_index(const size_t d, const size_t n, const std::vector<float>& _features, const std::string& index_str, const bool track_dist_offset = false);
+            feature_index(const size_t d, const size_t n, const std::vector<float>& _features, const std::string& index_str, const bool track_dist_offset = false, const feature_index_options& options = {});
+            // Index over rows that become final over time, e.g. while the input is parsed. wait_for_rows(count) blocks until the first count rows of _features
+            // are final and returns the number of final rows. The index is trained on the first train_sample_size rows, by default enough for IVF quantizers,
+            // and rows are added in the chunks returned by wait_for_rows. Only for fp32 precision.
+            feature_index(const size_t d, const size_t n, const std::vector<float>& _features, const std::function<size_t(size_t)>& wait_for_rows, const std::string& index_str,
+                    const bool track_dist_offset = false, const feature_index_options& options = {});
+            // Restore from state written by serialize, including the faiss index.
+            feature_index(binary_reader& reader);
+            // Removes the files of on-disk inverted lists.
+            ~feature_index();
+            // Not supported with on-disk inverted lists.
+            void serialize(binary_writer& writer) const;
+
+            // Replace all nodes by n new ones with the same dimension. Faiss indices, trained quantizers and buffers are reused,
+            // the efSearch controller starts over.
+            void reset(const size_t n, const std::vector<float>& _features);
 
             void remove(const faiss::Index::idx_t i);
             faiss::Index::idx_t merge(const faiss::Index::idx_t i, const faiss::Index::idx_t j);
+            // Merge disjoint pairs at once, the c-th pair gets id first_id + c with the returned first_id. Features are summed in parallel and added to faiss in one call.
+            faiss::Index::idx_t merge(const std::vector<std::array<size_t,2>>& pairs);
+            // Append new active nodes and return the id of the first one.
+            faiss::Index::idx_t add_nodes(const size_t n, const float* new_features);
             double inner_product(const faiss::Index::idx_t i, const faiss::Index::idx_t j) const;
             std::tuple<std::vector<faiss::Index::idx_t>, std::vector<float>> get_nearest_nodes(const std::vector<faiss::Index::idx_t>& nodes) const;
             std::tuple<std::vector<faiss::Index::idx_t>, std::vector<float>> get_nearest_nodes(const std::vector<faiss::Index::idx_t>& nodes, const size_t k) const;
-            std::tuple<faiss::Index::idx_t, float> get_nearest_node(const faiss::Index::idx_t node);
+            std::tuple<faiss::Index::idx_t, float> get_nearest_node(const faiss::Index::idx_t node) const;
 
+            size_t dim() const { return d; }
             bool node_active(const faiss::Index::idx_t idx) const;
             size_t max_id_nr() const;
             size_t nr_nodes() const;
             std::vector<faiss::Index::idx_t> get_active_nodes() const;
+            // Only for fp32 precision, reduced precision rows are not stored as floats.
+            const float* node_features(const faiss::Index::idx_t idx) const;
+            feature_precision precision() const { return features.precision(); }
+            // Whether searches return the exact nearest neighbours, i.e. all shards are flat indices over fp32 vectors.
+            bool exact_search() const;
+            // faiss index of shard s, e.g. to inspect its parameters.
+            const faiss::Index& shard_index(const size_t s) const { return *shards[s]; }
 
         private:
+            // Members as written by serialize, read completely before the index is constructed from them.
+            struct serialized_state;
+            static serialized_state read_state(binary_reader& reader);
+            feature_index(serialized_state&& state);
+
+            // faiss index for the options, untrained.
+            std::unique_ptr<faiss::Index> create_index(const std::string& index_str, const feature_index_options& options);
+            // The trained index and its clones as shards, with inverted lists on disk for a storage directory.
+            void create_shards(std::unique_ptr<faiss::Index> index, const std::string& index_str, const feature_index_options& options);
+            // Query vector for node in query, the offset dimension is negated when tracking the distance offset.
+            void fill_query(const faiss::Index::idx_t node, float* query) const;
+            // Replaces approximate distances of candidates by exact inner products with node and sorts them in decreasing order.
+            void rescore(const faiss::Index::idx_t node, std::vector<std::tuple<faiss::Index::idx_t, float>>& candidates) const;
+            // Nearest indexed vectors for each query over all shards, at most k and padded with label -1. With several shards inactive nodes are dropped
+            // while merging the shard results and only the part of the merged ranking that is known to be complete is returned.
+            // Shards are searched one after another with multi-threaded faiss calls, or in parallel for batches smaller than the number of threads.
+            void search(const size_t nr_queries, const float* queries, const size_t k, float* distances, faiss::Index::idx_t* labels) const;
+            // Index the nodes first_id, ..., first_id + n - 1, whose features are stored already. Shards get contiguous parts so that loads level out.
+            void add_to_shards(const faiss::Index::idx_t first_id, const size_t n, const float* new_features);
+            // Counts returned nodes and the active ones among them for the efSearch controller.
+            void count_active_results(const std::vector<faiss::Index::idx_t>& nns, size_t& nr_results, size_t& nr_active_results) const;
+            // All other active nodes sorted by exact inner product, for queries the index could not answer, e.g. IVF with small nprobe.
+            std::vector<std::tuple<faiss::Index::idx_t, float>> exhaustive_candidates(const faiss::Index::idx_t node) const;
+
             const size_t d;
-            std::unique_ptr<faiss::Index> index;
-            std::vector<float> features;
+            // shard_ids[s][l] is the node id of the l-th vector added to shard s.
+            std::vector<std::unique_ptr<faiss::Index>> shards;
+            std::vector<std::vector<faiss::Index::idx_t>> shard_ids;
+            feature_storage features;
             std::vector<char> active;
             size_t nr_active = 0;
             const bool track_dist_offset_ = false;
+            const size_t rerank_depth_ = 0;
+            const bool rescore_candidates_ = false;
+            std::unique_ptr<ef_search_controller> ef_controller_;
+            std::vector<std::string> inverted_list_files_;
     };
 }
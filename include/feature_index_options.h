@@ -0,0 +1,45 @@
+#pragma once
+#include "feature_storage.h"
+#include <string>
+#include <vector>
+
+namespace DENSE_MULTICUT {
+
+    // Solver independent settings of feature_index, kept apart from feature_index.h so that solver interfaces do not depend on faiss.
+    struct feature_index_options {
+        // Precision of the input features in feature_index and of the faiss index codes. With reduced precision Flat and HNSW indices
+        // use the corresponding scalar quantizer and nearest neighbour candidates are rescored with exact fp32 inner products.
+        feature_precision precision = feature_precision::fp32;
+        // faiss index factory string replacing the default index of the solver, e.g. "IVF4096,PQ32" or "OPQ32,IVF4096,PQ32". Empty keeps the default.
+        std::string index_string = "";
+        // Inverted lists visited per query by IVF indices, 0 keeps the faiss default.
+        size_t nprobe = 0;
+        // Candidates fetched from the index per query and re-ranked by exact inner products of the stored features.
+        // With 0 candidates are only re-ranked for compressed indices and reduced precision, starting from the usual number of lookups.
+        size_t rerank_depth = 0;
+        // Number of randomly chosen points the index is trained on, 0 uses all points.
+        size_t train_sample_size = 0;
+        // Number of faiss indices the nodes are spread over, new nodes go to the least filled shards. Small batches of queries and inserts
+        // are spread over the shards in parallel, larger ones are parallelized by faiss within each shard.
+        size_t nr_shards = 1;
+        // HNSW graph degree, 0 keeps the degree of the index string. efConstruction and efSearch of 0 keep the faiss defaults.
+        size_t hnsw_m = 0;
+        size_t ef_construction = 0;
+        size_t ef_search = 0;
+        // Adapt efSearch per batch of queries to the fraction of active results and the number of k-doublings, starting from ef_search.
+        bool adaptive_ef_search = false;
+        // Directory for out-of-core solving: fp32 rows and merged cluster sums are kept in a memory-mapped file there and
+        // IVF indices keep their inverted lists on disk. Empty keeps everything in memory.
+        std::string storage_dir = "";
+        // Resident MiB of the file-backed rows above which they are written back and dropped from memory, 0 leaves paging to the OS.
+        size_t memory_budget_mb = 0;
+    };
+
+    // Frees the input rows once the feature_index is built from them. In out-of-core mode the index holds its own file-backed copy,
+    // so the input is not kept in memory during the solve.
+    inline void release_input_features(std::vector<float>& features, const feature_index_options& options)
+    {
+        if(options.storage_dir != "")
+            std::vector<float>().swap(features);
+    }
+}
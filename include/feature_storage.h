@@ -0,0 +1,62 @@
+#pragma once
+#include "binary_io.h"
+#include "mapped_float_array.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace DENSE_MULTICUT {
+
+    enum class feature_precision { fp32, fp16, bf16, int8 };
+
+    feature_precision feature_precision_from_string(const std::string& s);
+    std::string to_string(const feature_precision precision);
+
+    // Feature rows of a feature_index. The first nr_base_rows rows (the input points) are kept in the given precision,
+    // int8 with one fp32 scale per row. All rows appended later, i.e. merged cluster sums, are stored in an fp32 side table,
+    // so that sums do not accumulate rounding error as clusters grow. Arithmetic on decoded rows is always fp32.
+    // With a file path the side table is a memory-mapped file instead, see mapped_float_array. Deserialized storage is always in memory.
+    class feature_storage {
+        public:
+            feature_storage(const size_t d = 0, const size_t nr_base_rows = 0, const float* base_rows = nullptr, const feature_precision precision = feature_precision::fp32,
+                    const std::string& file_path = "", const size_t memory_budget_bytes = 0);
+
+            // Replace all rows by new base rows. Allocations are kept, so refilling with instances of similar size does not allocate.
+            void assign(const size_t nr_base_rows, const float* base_rows);
+
+            void serialize(binary_writer& writer) const;
+            void deserialize(binary_reader& reader);
+
+            size_t dim() const { return d_; }
+            size_t nr_rows() const { return nr_base_rows_ + side_table_size() / d_; }
+            feature_precision precision() const { return precision_; }
+
+            // Row in fp32. Points into the storage for fp32 rows, otherwise the row is decoded into buffer, which must hold d floats.
+            const float* row(const size_t i, float* buffer) const;
+            // Pointer to nr_rows new fp32 rows at the end of the side table, invalidated by the next call.
+            float* append_rows(const size_t nr_rows);
+
+            // Bytes of rows in memory, a file-backed side table counts with its resident pages.
+            size_t memory_bytes() const;
+            size_t fp32_memory_bytes() const { return nr_rows() * d_ * sizeof(float); }
+
+        private:
+            bool is_fp32_row(const size_t i) const { return precision_ == feature_precision::fp32 || i >= nr_base_rows_; }
+            size_t side_table_size() const { return side_file_ ? side_file_->size() : side_table_.size(); }
+            const float* side_table_data() const { return side_file_ ? side_file_->data() : side_table_.data(); }
+            float* side_table_data() { return side_file_ ? side_file_->data() : side_table_.data(); }
+            void resize_side_table(const size_t size);
+
+            size_t d_;
+            size_t nr_base_rows_;
+            feature_precision precision_;
+            // with fp32 precision all rows live in the side table and nr_base_rows_ is 0.
+            std::vector<float> side_table_;
+            std::unique_ptr<mapped_float_array> side_file_;
+            std::vector<uint16_t> half_rows_;
+            std::vector<int8_t> int8_rows_;
+            std::vector<float> int8_scales_;
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "dense_multicut_utils.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <atomic>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Rows of a dense multicut instance file parsed by a background thread, so that index construction can start on the rows parsed so far.
+    // Rows are published in chunks. With a nonzero dist_offset every row gets the offset dimension of append_dist_offset_in_features right away,
+    // and cost_disconnected is accumulated per chunk, so that no pass over the full features is needed after parsing.
+    class feature_stream {
+        public:
+            // Reads the header and starts parsing. Throws if the file cannot be opened.
+            feature_stream(const std::string& path, const float dist_offset = 0.0, const size_t chunk_rows = 4096);
+            // Stops the parser thread after its current chunk and waits for it.
+            ~feature_stream();
+            feature_stream(const feature_stream&) = delete;
+            feature_stream& operator=(const feature_stream&) = delete;
+
+            size_t nr_rows() const { return n_; }
+            // Including the offset dimension.
+            size_t dim() const { return d_; }
+            bool track_dist_offset() const { return track_dist_offset_; }
+
+            // Blocks until the first min(count, nr_rows()) rows are parsed and returns the number of parsed rows. Rethrows parse errors.
+            size_t wait_for_rows(const size_t count) const;
+            // All nr_rows() rows, of which those returned by wait_for_rows are final.
+            const std::vector<float>& features() const { return features_; }
+
+            // Wait for all rows.
+            double cost_disconnected() const;
+            double parse_seconds() const;
+
+        private:
+            void parse(const std::string& path, const float dist_offset, const size_t chunk_rows);
+
+            size_t n_ = 0;
+            size_t d_ = 0;
+            bool track_dist_offset_ = false;
+            std::vector<float> features_;
+            cost_disconnected_accumulator cost_;
+            double parse_seconds_ = 0.0;
+
+            mutable std::mutex mutex_;
+            mutable std::condition_variable rows_parsed_;
+            size_t nr_parsed_ = 0;
+            std::exception_ptr error_;
+            std::atomic<bool> stop_{false};
+            std::thread parser_;
+    };
+}
@@ -1,5 +1,6 @@
 #include <faiss/Index.h>
 #include "feature_index.h"
+#include "binary_io.h"
 #include <vector>
 #include <tuple>
 #include <memory>
@@ -7,6 +8,8 @@
 
 namespace DENSE_MULTICUT {
 
+    // ID is uint32_t whenever all 2n node ids fit, see fits_32bit_ids.
+    template<typename ID = size_t>
     class incremental_nns {
         public:
             incremental_nns() {}
@@ -17,9 +20,12 @@ namespace DENSE_MULTICUT {
                 const size_t n, const size_t k);
 
             // Merges i, j to a single node with new_id and return neighbours of this single node and their associated edge costs.
-            std::unordered_map<size_t, float> merge_nodes(const size_t i, const size_t j, const size_t new_id, const feature_index& index);
+            std::unordered_map<ID, float> merge_nodes(const ID i, const ID j, const ID new_id, const feature_index& index);
 
-            std::vector<std::tuple<size_t, size_t, float>> recheck_possible_contractions(const feature_index& index);
+            std::vector<std::tuple<ID, ID, float>> recheck_possible_contractions(const feature_index& index);
+
+            void serialize(binary_writer& writer) const;
+            void deserialize(binary_reader& reader);
         private:
             
             void insert_nn_to_graph(
@@ -28,7 +34,7 @@ namespace DENSE_MULTICUT {
                 const std::vector<float>& nns_distances, 
                 const size_t k);
 
-            std::vector<std::unordered_map<size_t, float>> nn_graph_;
+            std::vector<std::unordered_map<ID, float>> nn_graph_;
             size_t k_;
             std::vector<float> min_dist_in_knn_;
     };
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Synthetic instances with planted clusters. Points are noisy copies of random unit cluster centers, normalized to unit length,
+    // so inner products are close to 1 within and close to 0 across clusters and offsets in (0,1) separate them.
+    struct synthetic_instance {
+        size_t n;
+        size_t d;
+        std::vector<float> features;
+        std::vector<size_t> ground_truth;
+    };
+
+    synthetic_instance clustered_instance(const size_t d, const std::vector<size_t>& cluster_sizes, const float noise, const unsigned int seed = 0);
+
+    // nr_clusters clusters of equal size.
+    synthetic_instance gaussian_mixture_instance(const size_t n, const size_t d, const size_t nr_clusters, const float noise, const unsigned int seed = 0);
+
+    // Cluster c gets size proportional to (c+1)^-exponent, i.e. few large and many small clusters.
+    synthetic_instance power_law_instance(const size_t n, const size_t d, const size_t nr_clusters, const float exponent, const float noise, const unsigned int seed = 0);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+namespace DENSE_MULTICUT {
+
+    // text: one label per line as given, e.g. union find roots.
+    // binary: contiguous cluster ids 0, ..., k-1 in order of first occurrence. The file starts with the magic "DMCL", a uint32 version,
+    // uint64 number of nodes n, uint64 number of clusters k, uint32 bytes per id (4 if k fits, else 8) and uint32 flags, followed by n ids.
+    // With flag 1 a table of k uint64 cluster sizes follows. All values are little endian as on the writing machine.
+    enum class labeling_format { text, binary };
+
+    labeling_format labeling_format_from_string(const std::string& s);
+
+    constexpr char binary_labeling_magic[4] = {'D', 'M', 'C', 'L'};
+    constexpr uint32_t binary_labeling_version = 1;
+    constexpr uint32_t binary_labeling_has_cluster_sizes = 1;
+
+    // Number of nodes per cluster of a contiguous labeling with nr_clusters clusters.
+    std::vector<size_t> cluster_sizes(const std::vector<size_t>& contiguous, const size_t nr_clusters);
+
+    // Text labels are formatted into a large buffer and written in blocks. Cluster sizes are only written in binary format.
+    void write_labeling(const std::string& path, const std::vector<size_t>& labeling, const labeling_format format = labeling_format::text, const bool with_cluster_sizes = false);
+
+    // Reads either format, recognized by the magic of binary files.
+    std::vector<size_t> read_labeling(const std::string& path);
+    // Cluster sizes stored in a binary labeling file, empty if there are none.
+    std::vector<size_t> read_cluster_sizes(const std::string& path);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    struct local_search_options {
+        size_t max_sweeps = 10;
+        // Target clusters considered per node, the clusters whose sums have the largest inner product with the node's features.
+        size_t nr_candidates = 8;
+        // faiss index factory string of the index over the cluster sums, rebuilt in every sweep. Flat is exact, HNSW or IVF indices
+        // are faster for many clusters at the cost of missed candidates.
+        std::string index_str = "Flat";
+        // Stop when a sweep improves the objective by less than this fraction.
+        double min_relative_improvement = 1e-6;
+        // Later moves of a sweep are left to the next sweep, whose candidates come from the updated sums.
+        size_t max_batches_per_sweep = 100;
+    };
+
+    struct local_search_sweep {
+        double objective;
+        size_t nr_moves;
+        size_t nr_batches;
+        double seconds;
+    };
+
+    struct local_search_result {
+        // Contiguous cluster ids.
+        std::vector<size_t> labels;
+        double initial_objective;
+        double objective;
+        std::vector<local_search_sweep> sweeps;
+    };
+
+    // Improves a labeling of any solver by moving single nodes between clusters. Moving v from cluster A to B lowers the objective by
+    // <f_v, S_B - S_A + f_v> for cluster feature sums S, with the offset dimension negated when track_dist_offset is set as in cost_disconnected.
+    // Each sweep finds candidate target clusters for all nodes with one faiss search over the cluster sums. Moves are then evaluated in parallel
+    // and applied in batches in which every cluster is source or target of at most one move, so that all gains of a batch are exact.
+    // Nodes may also move to a new singleton cluster.
+    local_search_result local_search(const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset, const std::vector<size_t>& labeling,
+            const local_search_options& options = {});
+
+}
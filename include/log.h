@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    enum class log_level { off = 0, error = 1, warning = 2, info = 3, debug = 4, trace = 5 };
+
+    inline std::atomic<log_level> current_log_level{log_level::info};
+
+    // Messages up to this level are written, off silences all output.
+    inline void set_log_level(const log_level level) { current_log_level.store(level, std::memory_order_relaxed); }
+    inline log_level get_log_level() { return current_log_level.load(std::memory_order_relaxed); }
+    inline bool log_enabled(const log_level level) { return level <= current_log_level.load(std::memory_order_relaxed); }
+
+    inline log_level log_level_from_string(const std::string& s)
+    {
+        if(s == "off")
+            return log_level::off;
+        if(s == "error")
+            return log_level::error;
+        if(s == "warning")
+            return log_level::warning;
+        if(s == "info")
+            return log_level::info;
+        if(s == "debug")
+            return log_level::debug;
+        if(s == "trace")
+            return log_level::trace;
+        throw std::runtime_error("Unknown log level " + s + ", expected off, error, warning, info, debug or trace");
+    }
+
+    // Collects one message and writes it with a single call on destruction, so that lines of different threads do not interleave.
+    // Errors and warnings go to standard error, everything else to standard output.
+    class log_line {
+        public:
+            log_line(const log_level level) : level_(level) {}
+            ~log_line()
+            {
+                if(level_ <= log_level::warning)
+                    std::cerr << stream_.str();
+                else
+                    std::cout << stream_.str();
+            }
+            std::ostream& stream() { return stream_; }
+        private:
+            const log_level level_;
+            std::ostringstream stream_;
+    };
+}
+
+// Levels above DENSE_MULTICUT_MAX_LOG_LEVEL are compiled out. For disabled levels the message arguments are not evaluated,
+// the cost is one relaxed load and a branch. The message is the body of a loop running at most once instead of the else branch
+// of an if, so that a LOG_* statement as the body of an unbraced if cannot take over a following else.
+#ifndef DENSE_MULTICUT_MAX_LOG_LEVEL
+#define DENSE_MULTICUT_MAX_LOG_LEVEL 5
+#endif
+
+#define DENSE_MULTICUT_LOG(LEVEL) \
+    for(bool dense_multicut_log_enabled = int(DENSE_MULTICUT::log_level::LEVEL) <= DENSE_MULTICUT_MAX_LOG_LEVEL && DENSE_MULTICUT::log_enabled(DENSE_MULTICUT::log_level::LEVEL); \
+        dense_multicut_log_enabled; dense_multicut_log_enabled = false) \
+        DENSE_MULTICUT::log_line(DENSE_MULTICUT::log_level::LEVEL).stream()
+
+#define LOG_ERROR DENSE_MULTICUT_LOG(error)
+#define LOG_WARNING DENSE_MULTICUT_LOG(warning)
+#define LOG_INFO DENSE_MULTICUT_LOG(info)
+#define LOG_DEBUG DENSE_MULTICUT_LOG(debug)
+#define LOG_TRACE DENSE_MULTICUT_LOG(trace)
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Growable array of floats in a memory-mapped file, so that its size is bounded by disk instead of RAM.
+    // The file is created at path and unlinked right away, so that it is removed even if the process dies. With a memory budget, resident pages
+    // are written back and dropped from memory whenever more than the budget is resident, checked after every eighth of the budget appended or read.
+    // Page faults then bring rows back on access.
+    class mapped_float_array {
+        public:
+            mapped_float_array(const std::string& path, const size_t memory_budget_bytes = 0);
+            ~mapped_float_array();
+            mapped_float_array(const mapped_float_array&) = delete;
+            mapped_float_array& operator=(const mapped_float_array&) = delete;
+
+            size_t size() const { return size_; }
+            float* data() { return data_; }
+            const float* data() const { return data_; }
+            // The file grows by doubling and is mapped again if the capacity does not suffice, which moves data().
+            void resize(const size_t size);
+            // Accounts bytes read through data() towards the next budget check. May be called concurrently with other reads.
+            void note_read(const size_t bytes) const;
+
+            // Bytes of the mapping currently in memory.
+            size_t resident_bytes() const;
+            const std::string& path() const { return path_; }
+
+        private:
+            void map(const size_t capacity);
+            void enforce_memory_budget() const;
+
+            std::string path_;
+            int fd_ = -1;
+            float* data_ = nullptr;
+            size_t size_ = 0;
+            size_t capacity_ = 0;
+            const size_t memory_budget_bytes_;
+            mutable std::atomic<size_t> bytes_since_check_{0};
+            // held while checking residency, readers skip the check if another thread is at it.
+            mutable std::mutex check_mutex_;
+            mutable size_t nr_releases_ = 0;
+            // page faults of the whole process when the array was created, the kernel does not count them per mapping.
+            long minor_faults_ = 0;
+            long major_faults_ = 0;
+    };
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <cassert>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include "time_measure_util.h"
+
+namespace DENSE_MULTICUT {
+
+    // Locally dominant matching: every vertex points to its heaviest edge towards an unmatched vertex and edges chosen by both endpoints are matched.
+    // Ties are broken by edge position, so that the result is the greedy matching for this order and carries the same 1/2-approximation guarantee.
+    // Only vertices whose pointer became invalid are processed again in the next round.
+    // Same interface as maximum_matching_greedy, rounds are processed with OpenMP.
+    template<typename I_ITERATOR, typename J_ITERATOR, typename COST_ITERATOR>
+    std::vector<std::array<size_t,2>> maximum_matching_parallel(I_ITERATOR i_begin, I_ITERATOR i_end, J_ITERATOR j_begin, COST_ITERATOR cost_begin)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        const size_t m = std::distance(i_begin, i_end);
+        std::vector<std::array<size_t,2>> matching;
+        if(m == 0)
+            return matching;
+        const size_t n = std::max( *std::max_element(i_begin, i_end), *std::max_element(j_begin, j_begin+m)) + 1;
+        constexpr size_t no_edge = std::numeric_limits<size_t>::max();
+
+        auto heavier = [&](const size_t e, const size_t f) {
+            if(f == no_edge)
+                return true;
+            const auto c_e = *(cost_begin+e);
+            const auto c_f = *(cost_begin+f);
+            return c_e > c_f || (c_e == c_f && e < f);
+        };
+        auto other_endpoint = [&](const size_t e, const size_t v) -> size_t {
+            const size_t i = *(i_begin+e);
+            return i == v ? size_t(*(j_begin+e)) : i;
+        };
+
+        // incident edges of each vertex in CSR format
+        std::vector<size_t> offsets(n+1, 0);
+        for(size_t e=0; e<m; ++e)
+        {
+            assert(size_t(*(i_begin+e)) != size_t(*(j_begin+e)));
+            ++offsets[*(i_begin+e)+1];
+            ++offsets[*(j_begin+e)+1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<size_t> incident_edges(2*m);
+        {
+            std::vector<size_t> fill(offsets.begin(), offsets.end()-1);
+            for(size_t e=0; e<m; ++e)
+            {
+                incident_edges[fill[*(i_begin+e)]++] = e;
+                incident_edges[fill[*(j_begin+e)]++] = e;
+            }
+        }
+
+        std::vector<char> matched(n, false);
+        std::vector<size_t> candidate(n, no_edge);
+        std::vector<char> in_round(n, false);
+        std::vector<size_t> round_vertices;
+        round_vertices.reserve(n);
+        for(size_t v=0; v<n; ++v)
+            if(offsets[v+1] > offsets[v])
+                round_vertices.push_back(v);
+
+        std::vector<std::array<size_t,2>> round_matching;
+        while(!round_vertices.empty())
+        {
+            for(const size_t v : round_vertices)
+                in_round[v] = true;
+
+#pragma omp parallel for schedule(dynamic, 256)
+            for(size_t c=0; c<round_vertices.size(); ++c)
+            {
+                const size_t v = round_vertices[c];
+                size_t best = no_edge;
+                for(size_t l=offsets[v]; l<offsets[v+1]; ++l)
+                {
+                    const size_t e = incident_edges[l];
+                    if(!matched[other_endpoint(e, v)] && heavier(e, best))
+                        best = e;
+                }
+                candidate[v] = best;
+            }
+
+            // an edge chosen from both sides is locally dominant. If both endpoints were processed, the smaller one reports it.
+            round_matching.clear();
+#pragma omp parallel
+            {
+                std::vector<std::array<size_t,2>> thread_matching;
+#pragma omp for schedule(static) nowait
+                for(size_t c=0; c<round_vertices.size(); ++c)
+                {
+                    const size_t v = round_vertices[c];
+                    const size_t e = candidate[v];
+                    if(e == no_edge)
+                        continue;
+                    const size_t u = other_endpoint(e, v);
+                    if(candidate[u] == e && (!in_round[u] || v < u))
+                        thread_matching.push_back({size_t(*(i_begin+e)), size_t(*(j_begin+e))});
+                }
+#pragma omp critical
+                round_matching.insert(round_matching.end(), thread_matching.begin(), thread_matching.end());
+            }
+
+            for(const size_t v : round_vertices)
+                in_round[v] = false;
+            for(const auto [i,j] : round_matching)
+            {
+                assert(!matched[i] && !matched[j]);
+                matched[i] = true;
+                matched[j] = true;
+            }
+            matching.insert(matching.end(), round_matching.begin(), round_matching.end());
+
+            // unmatched neighbours of newly matched vertices which pointed to them need a new candidate.
+            round_vertices.clear();
+            for(const auto ij : round_matching)
+                for(const size_t v : ij)
+                    for(size_t l=offsets[v]; l<offsets[v+1]; ++l)
+                    {
+                        const size_t u = other_endpoint(incident_edges[l], v);
+                        if(!matched[u] && !in_round[u] && candidate[u] != no_edge && matched[other_endpoint(candidate[u], u)])
+                        {
+                            in_round[u] = true;
+                            round_vertices.push_back(u);
+                        }
+                    }
+            for(const size_t v : round_vertices)
+                in_round[v] = false;
+        }
+
+        return matching;
+    }
+
+}
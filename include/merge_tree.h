@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <string>
+#include <limits>
+#include "binary_io.h"
+
+namespace DENSE_MULTICUT {
+
+    // Records the sequence of contractions performed by a solver. Leaves are the input nodes 0..n-1,
+    // the c-th contraction creates the cluster with id n+c. Costs are edge costs at the offset the solver ran with.
+    class merge_tree {
+        public:
+            struct contraction {
+                size_t i;
+                size_t j;
+                size_t new_id;
+                float cost;
+                // Highest cost of any other edge present when this contraction was chosen, +inf if unknown, e.g. for approximate
+                // nearest neighbour search or the partial neighbour lists of inc-NN.
+                float runner_up_cost;
+                size_t size_i;
+                size_t size_j;
+            };
+
+            merge_tree(const size_t n = 0, const float dist_offset = 0.0);
+            void init(const size_t n, const float dist_offset = 0.0);
+
+            void add_contraction(const size_t i, const size_t j, const size_t new_id, const float cost, const float runner_up_cost = std::numeric_limits<float>::infinity());
+
+            size_t nr_nodes() const { return n_; }
+            size_t nr_contractions() const { return contractions_.size(); }
+            float dist_offset() const { return dist_offset_; }
+            const std::vector<contraction>& contractions() const { return contractions_; }
+
+            // Labeling of the input nodes after applying the first nr_contractions contractions. Labels are ids of tree nodes.
+            std::vector<size_t> labeling(const size_t nr_contractions) const;
+            std::vector<size_t> labeling_with_nr_clusters(const size_t nr_clusters) const;
+
+            // Binary format: header followed by the (i,j) pairs, costs and runner-up costs. New ids and cluster sizes are implied by the order.
+            void write(const std::string& file_path) const;
+            static merge_tree read(const std::string& file_path);
+
+            void serialize(binary_writer& writer) const;
+            void deserialize(binary_reader& reader);
+
+        private:
+            size_t n_ = 0;
+            float dist_offset_ = 0.0;
+            std::vector<contraction> contractions_;
+            std::vector<size_t> sizes_;
+    };
+
+    struct threshold_sweep_result {
+        float dist_offset;
+        std::vector<size_t> labeling;
+        size_t nr_contractions;
+        // True if GAEC run at this offset provably performs the same contractions. Otherwise the labeling is the cut of the tree
+        // at the first non-positive contraction and first_uncertain_contraction is where the greedy order may start to differ.
+        bool exact;
+        size_t first_uncertain_contraction;
+    };
+
+    // Labelings for several distance offsets from a single solve. Only offsets >= tree.dist_offset() can be answered,
+    // since edge costs at offset t are cost - (t - t0) * |A| * |B| and smaller offsets would require contractions the solver never made.
+    // A contraction stays the greedy choice at offset t if its new cost is at least runner_up_cost - (t - t0), which bounds every competing edge.
+    std::vector<threshold_sweep_result> threshold_sweep(const merge_tree& tree, const std::vector<float>& dist_offsets);
+}
@@ -0,0 +1,310 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+namespace DENSE_MULTICUT {
+
+    enum class metric_kind { counter, gauge, timer, histogram };
+
+    // Merged view of one metric over all threads. Timers are histograms of durations in seconds, gauges report the most recent value.
+    struct metric_snapshot {
+        static constexpr size_t nr_buckets = 48;
+        // bucket b holds values in [2^(b-16), 2^(b-15)), the first and last bucket also collect everything below and above.
+        static size_t bucket(const double value)
+        {
+            if(!(value > 0.0))
+                return 0;
+            const int e = std::ilogb(value) + 16;
+            return size_t(std::clamp(e, 0, int(nr_buckets) - 1));
+        }
+        static double bucket_upper_bound(const size_t b) { return std::ldexp(1.0, int(b) - 15); }
+
+        std::string name;
+        metric_kind kind;
+        uint64_t count = 0;
+        double sum = 0.0;
+        double min = std::numeric_limits<double>::infinity();
+        double max = -std::numeric_limits<double>::infinity();
+        double last = 0.0;
+        std::array<uint64_t, nr_buckets> buckets{};
+
+        double mean() const { return count > 0 ? sum / count : 0.0; }
+        // q-quantile interpolated linearly within its bucket and clamped to [min, max], 0 for counters which keep no buckets.
+        double quantile(const double q) const;
+    };
+
+    struct metrics_snapshot {
+        // Seconds since the registry was created, counters per second are sum / uptime.
+        double uptime;
+        std::vector<metric_snapshot> metrics;
+    };
+
+    // Process-wide registry of named metrics. Every thread records into its own shard without locks or contention,
+    // shards are only merged when a snapshot is taken. When a thread exits its shard is folded into the retired shard and freed,
+    // so values of finished worker threads are kept without one shard per thread ever started.
+    class metrics_registry {
+        public:
+            static constexpr size_t max_nr_metrics = 128;
+
+            static metrics_registry& instance()
+            {
+                static metrics_registry registry;
+                return registry;
+            }
+
+            // Returns the id of the metric with this name, registering it on first use.
+            size_t register_metric(const std::string& name, const metric_kind kind)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for(size_t m=0; m<names_.size(); ++m)
+                    if(names_[m] == name)
+                    {
+                        if(kinds_[m] != kind)
+                            throw std::runtime_error("metric " + name + " registered with different kinds");
+                        return m;
+                    }
+                if(names_.size() == max_nr_metrics)
+                    throw std::runtime_error("too many metrics, increase metrics_registry::max_nr_metrics");
+                names_.push_back(name);
+                kinds_.push_back(kind);
+                return names_.size() - 1;
+            }
+
+            void increment(const size_t metric, const double value) { local_shard().slots[metric].increment(value); }
+            void add(const size_t metric, const double value) { local_shard().slots[metric].add(value); }
+            void set(const size_t metric, const double value) { local_shard().slots[metric].set(value, now_ns()); }
+
+            metrics_snapshot snapshot() const;
+            // Shards of running threads that have recorded, plus the retired shard.
+            size_t nr_shards() const
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return shards_.size();
+            }
+            // Zeroes all values, registered metrics stay. Must not run concurrently with recording.
+            void reset();
+
+        private:
+            // Written by the owning thread only, atomics make concurrent snapshots well defined.
+            struct slot {
+                std::atomic<uint64_t> count{0};
+                std::atomic<double> sum{0.0};
+                std::atomic<double> min{std::numeric_limits<double>::infinity()};
+                std::atomic<double> max{-std::numeric_limits<double>::infinity()};
+                std::atomic<double> last{0.0};
+                std::atomic<int64_t> last_time{std::numeric_limits<int64_t>::min()};
+                std::array<std::atomic<uint64_t>, metric_snapshot::nr_buckets> buckets{};
+
+                // counters only track number of updates and their total.
+                void increment(const double value)
+                {
+                    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+                }
+
+                void add(const double value)
+                {
+                    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+                    if(value < min.load(std::memory_order_relaxed))
+                        min.store(value, std::memory_order_relaxed);
+                    if(value > max.load(std::memory_order_relaxed))
+                        max.store(value, std::memory_order_relaxed);
+                    auto& b = buckets[metric_snapshot::bucket(value)];
+                    b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+
+                void set(const double value, const int64_t time)
+                {
+                    add(value);
+                    last.store(value, std::memory_order_relaxed);
+                    last_time.store(time, std::memory_order_relaxed);
+                }
+
+                // Adds the values of a slot no thread records into anymore.
+                void absorb(const slot& x)
+                {
+                    count.store(count.load(std::memory_order_relaxed) + x.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    sum.store(sum.load(std::memory_order_relaxed) + x.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    min.store(std::min(min.load(std::memory_order_relaxed), x.min.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+                    max.store(std::max(max.load(std::memory_order_relaxed), x.max.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+                    if(x.last_time.load(std::memory_order_relaxed) > last_time.load(std::memory_order_relaxed))
+                    {
+                        last.store(x.last.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        last_time.store(x.last_time.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    }
+                    for(size_t b=0; b<metric_snapshot::nr_buckets; ++b)
+                        buckets[b].store(buckets[b].load(std::memory_order_relaxed) + x.buckets[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+            };
+
+            struct shard {
+                std::array<slot, max_nr_metrics> slots;
+            };
+
+            // Retires the shard of its thread when the thread exits.
+            struct shard_owner {
+                shard* s = nullptr;
+                ~shard_owner()
+                {
+                    if(s != nullptr)
+                        instance().retire(s);
+                }
+            };
+
+            // shards_[0] is the retired shard.
+            metrics_registry() : start_(std::chrono::steady_clock::now()) { shards_.push_back(std::make_unique<shard>()); }
+
+            int64_t now_ns() const { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count(); }
+
+            shard& local_shard()
+            {
+                thread_local shard_owner owner;
+                if(owner.s == nullptr)
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    shards_.push_back(std::make_unique<shard>());
+                    owner.s = shards_.back().get();
+                }
+                return *owner.s;
+            }
+
+            void retire(shard* s)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for(size_t m=0; m<max_nr_metrics; ++m)
+                    shards_[0]->slots[m].absorb(s->slots[m]);
+                shards_.erase(std::find_if(shards_.begin() + 1, shards_.end(), [&](const auto& sh) { return sh.get() == s; }));
+            }
+
+            const std::chrono::steady_clock::time_point start_;
+            mutable std::mutex mutex_;
+            std::vector<std::string> names_;
+            std::vector<metric_kind> kinds_;
+            std::vector<std::unique_ptr<shard>> shards_;
+    };
+
+    inline metrics_snapshot metrics_registry::snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics_snapshot result;
+        result.uptime = now_ns() * 1e-9;
+        result.metrics.resize(names_.size());
+        for(size_t m=0; m<names_.size(); ++m)
+        {
+            metric_snapshot& s = result.metrics[m];
+            s.name = names_[m];
+            s.kind = kinds_[m];
+            int64_t last_time = std::numeric_limits<int64_t>::min();
+            for(const auto& sh : shards_)
+            {
+                const slot& x = sh->slots[m];
+                s.count += x.count.load(std::memory_order_relaxed);
+                s.sum += x.sum.load(std::memory_order_relaxed);
+                s.min = std::min(s.min, x.min.load(std::memory_order_relaxed));
+                s.max = std::max(s.max, x.max.load(std::memory_order_relaxed));
+                if(x.last_time.load(std::memory_order_relaxed) > last_time)
+                {
+                    last_time = x.last_time.load(std::memory_order_relaxed);
+                    s.last = x.last.load(std::memory_order_relaxed);
+                }
+                for(size_t b=0; b<metric_snapshot::nr_buckets; ++b)
+                    s.buckets[b] += x.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+        return result;
+    }
+
+    inline void metrics_registry::reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto& sh : shards_)
+            for(slot& x : sh->slots)
+            {
+                x.count = 0;
+                x.sum = 0.0;
+                x.min = std::numeric_limits<double>::infinity();
+                x.max = -std::numeric_limits<double>::infinity();
+                x.last = 0.0;
+                x.last_time = std::numeric_limits<int64_t>::min();
+                for(auto& b : x.buckets)
+                    b = 0;
+            }
+    }
+
+    inline double metric_snapshot::quantile(const double q) const
+    {
+        if(count == 0 || kind == metric_kind::counter)
+            return 0.0;
+        const uint64_t rank = std::min<uint64_t>(count - 1, uint64_t(q * count));
+        uint64_t seen = 0;
+        for(size_t b=0; b<nr_buckets; ++b)
+        {
+            if(seen + buckets[b] > rank)
+            {
+                // values are assumed to be spread evenly over [2^(b-16), 2^(b-15)), the outer buckets extend to min and max.
+                const double lower = b == 0 ? min : std::max(min, bucket_upper_bound(b) / 2.0);
+                const double upper = b == nr_buckets - 1 ? max : std::min(max, bucket_upper_bound(b));
+                const double fraction = double(rank - seen) / buckets[b];
+                return std::clamp(lower + fraction * (upper - lower), min, max);
+            }
+            seen += buckets[b];
+        }
+        return max;
+    }
+
+    class scoped_metric_timer {
+        public:
+            scoped_metric_timer(const size_t metric) : metric_(metric), begin_(std::chrono::steady_clock::now()) {}
+            ~scoped_metric_timer()
+            {
+                const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - begin_;
+                metrics_registry::instance().add(metric_, duration.count());
+            }
+        private:
+            const size_t metric_;
+            const std::chrono::steady_clock::time_point begin_;
+    };
+
+    // Output format is chosen by the file extension, .csv gives one line per metric and everything else JSON.
+    void write_metrics(const metrics_snapshot& snapshot, const std::string& file_path);
+    std::string metrics_json(const metrics_snapshot& snapshot);
+    std::string metrics_csv(const metrics_snapshot& snapshot);
+
+    // Writes a snapshot to file_path every interval_seconds from a background thread and once more on destruction.
+    class metrics_reporter {
+        public:
+            metrics_reporter(const std::string& file_path, const double interval_seconds = 0.0);
+            ~metrics_reporter();
+        private:
+            struct impl;
+            std::unique_ptr<impl> impl_;
+    };
+}
+
+// Recording macros. Metric names are registered once per call site, recording is a few relaxed stores into the thread's shard.
+// Compiled out entirely unless DENSE_MULTICUT_METRICS is defined.
+#ifdef DENSE_MULTICUT_METRICS
+#define METRICS_CONCAT_IMPL(A, B) A##B
+#define METRICS_CONCAT(A, B) METRICS_CONCAT_IMPL(A, B)
+#define METRICS_ID(NAME, KIND) []() { static const size_t metric_id = DENSE_MULTICUT::metrics_registry::instance().register_metric(NAME, KIND); return metric_id; }()
+#define METRICS_COUNTER_ADD(NAME, VALUE) DENSE_MULTICUT::metrics_registry::instance().increment(METRICS_ID(NAME, DENSE_MULTICUT::metric_kind::counter), VALUE)
+#define METRICS_GAUGE_SET(NAME, VALUE) DENSE_MULTICUT::metrics_registry::instance().set(METRICS_ID(NAME, DENSE_MULTICUT::metric_kind::gauge), VALUE)
+#define METRICS_HISTOGRAM_ADD(NAME, VALUE) DENSE_MULTICUT::metrics_registry::instance().add(METRICS_ID(NAME, DENSE_MULTICUT::metric_kind::histogram), VALUE)
+#define METRICS_SCOPED_TIMER(NAME) const DENSE_MULTICUT::scoped_metric_timer METRICS_CONCAT(scoped_metric_timer_, __LINE__)(METRICS_ID(NAME, DENSE_MULTICUT::metric_kind::timer))
+#else
+#define METRICS_COUNTER_ADD(NAME, VALUE) do {} while(0)
+#define METRICS_GAUGE_SET(NAME, VALUE) do {} while(0)
+#define METRICS_HISTOGRAM_ADD(NAME, VALUE) do {} while(0)
+#define METRICS_SCOPED_TIMER(NAME) do {} while(0)
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <atomic>
+
+namespace DENSE_MULTICUT {
+
+    // Makes the solvers use 64-bit ids for every n, so that both id widths can be compared on small instances.
+    inline std::atomic<bool>& force_64bit_ids()
+    {
+        static std::atomic<bool> force{false};
+        return force;
+    }
+
+    // Contracted nodes get ids up to 2n, so solvers can store ids in 32 bits whenever this fits. Ids coming from faiss are converted where they are received.
+    inline bool fits_32bit_ids(const size_t n)
+    {
+        return !force_64bit_ids() && 2 * n <= std::numeric_limits<uint32_t>::max();
+    }
+
+    // Priority queue entry for candidate contractions, 12 bytes for 32-bit ids.
+    template<typename ID>
+    struct pq_edge {
+        float cost;
+        ID i;
+        ID j;
+    };
+
+    template<typename ID>
+    struct pq_edge_less {
+        bool operator()(const pq_edge<ID>& a, const pq_edge<ID>& b) const { return a.cost < b.cost; }
+    };
+}
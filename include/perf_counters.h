@@ -0,0 +1,140 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace DENSE_MULTICUT {
+
+    // Hardware events counted in user space by Linux perf_event_open, read as one group per thread.
+    enum class perf_event { cycles, instructions, llc_misses, branch_misses };
+    constexpr size_t nr_perf_events = 4;
+    std::string perf_event_name(const perf_event e);
+
+    // Totals of one region over all threads. Counts are scaled by the fraction of time the counters were scheduled, when the kernel multiplexes them.
+    struct perf_region_summary {
+        std::string name;
+        uint64_t calls = 0;
+        size_t nr_threads = 0;
+        double seconds = 0.0;
+        std::array<double, nr_perf_events> counts{};
+        // Whether any thread entering the region could open the event.
+        std::array<bool, nr_perf_events> available{};
+
+        double count(const perf_event e) const { return counts[size_t(e)]; }
+        bool has(const perf_event e) const { return available[size_t(e)]; }
+        double ipc() const { return count(perf_event::cycles) > 0.0 ? count(perf_event::instructions) / count(perf_event::cycles) : 0.0; }
+        double llc_misses_per_kilo_instruction() const { return count(perf_event::instructions) > 0.0 ? 1000.0 * count(perf_event::llc_misses) / count(perf_event::instructions) : 0.0; }
+        double branch_misses_per_kilo_instruction() const { return count(perf_event::instructions) > 0.0 ? 1000.0 * count(perf_event::branch_misses) / count(perf_event::instructions) : 0.0; }
+    };
+
+    // Process-wide profiler of named regions. Regions are no-ops until enable is called. Every thread entering a region opens its own counters
+    // and records into its own shard, like metrics_registry. Counts are those of the thread entering the region, work of faiss's OpenMP
+    // worker threads inside it is not included, so single-threaded faiss (OMP_NUM_THREADS=1) gives complete counts for search regions.
+    // Nested regions each count inclusively.
+    class perf_counters {
+        public:
+            static constexpr size_t max_nr_regions = 32;
+
+            static perf_counters& instance()
+            {
+                static perf_counters counters;
+                return counters;
+            }
+
+            // Starts profiling and returns whether hardware counters are available. Without them, or when built without DENSE_MULTICUT_PERF_COUNTERS,
+            // a warning is logged and regions only record calls and time.
+            bool enable();
+            bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+            size_t register_region(const std::string& name);
+
+            std::vector<perf_region_summary> summary() const;
+            // Logs one line per region with IPC and miss rates, and per thread lines at debug level. Also sets them as metrics gauges.
+            void report() const;
+
+            // Counter values of the calling thread at region boundaries.
+            struct sample {
+                std::chrono::steady_clock::time_point time;
+                std::array<uint64_t, nr_perf_events> values{};
+                uint64_t time_enabled = 0;
+                uint64_t time_running = 0;
+            };
+            void read(sample& s);
+            void record(const size_t region, const sample& begin, const sample& end);
+
+        private:
+            // Written by the owning thread only.
+            struct region_slot {
+                std::atomic<uint64_t> calls{0};
+                std::atomic<double> seconds{0.0};
+                std::array<std::atomic<double>, nr_perf_events> counts{};
+            };
+            struct shard {
+                size_t thread_nr;
+                std::array<bool, nr_perf_events> available{};
+                std::array<region_slot, max_nr_regions> regions;
+            };
+
+            perf_counters() = default;
+            shard& local_shard();
+            std::vector<perf_region_summary> summary(const shard* only) const;
+
+            std::atomic<bool> enabled_{false};
+            mutable std::mutex mutex_;
+            std::vector<std::string> names_;
+            std::vector<std::unique_ptr<shard>> shards_;
+    };
+
+    class perf_region {
+        public:
+            perf_region(const size_t region) : region_(region), active_(perf_counters::instance().enabled())
+            {
+                if(active_)
+                    perf_counters::instance().read(begin_);
+            }
+            ~perf_region() { end(); }
+            // Records the region up to here instead of at destruction. Later calls do nothing.
+            void end()
+            {
+                if(!active_)
+                    return;
+                active_ = false;
+                perf_counters::sample end;
+                perf_counters::instance().read(end);
+                perf_counters::instance().record(region_, begin_, end);
+            }
+        private:
+            const size_t region_;
+            bool active_;
+            perf_counters::sample begin_;
+    };
+
+    // Enables profiling and reports on destruction, so that the report reaches a metrics_reporter destroyed afterwards.
+    class perf_counters_reporter {
+        public:
+            perf_counters_reporter() { perf_counters::instance().enable(); }
+            ~perf_counters_reporter() { perf_counters::instance().report(); }
+    };
+}
+
+// PERF_COUNTERS_REGION counts hardware events from here to the end of the enclosing scope under NAME, registered once per call site.
+// PERF_COUNTERS_REGION_BEGIN and PERF_COUNTERS_REGION_END delimit a region within a scope through the region variable VAR.
+// Compiled out entirely unless DENSE_MULTICUT_PERF_COUNTERS is defined.
+#ifdef DENSE_MULTICUT_PERF_COUNTERS
+#define PERF_COUNTERS_CONCAT_IMPL(A, B) A##B
+#define PERF_COUNTERS_CONCAT(A, B) PERF_COUNTERS_CONCAT_IMPL(A, B)
+#define PERF_COUNTERS_REGION_ID(NAME) []() { static const size_t region_id = DENSE_MULTICUT::perf_counters::instance().register_region(NAME); return region_id; }()
+#define PERF_COUNTERS_REGION(NAME) const DENSE_MULTICUT::perf_region PERF_COUNTERS_CONCAT(perf_region_, __LINE__)(PERF_COUNTERS_REGION_ID(NAME))
+#define PERF_COUNTERS_REGION_BEGIN(VAR, NAME) DENSE_MULTICUT::perf_region VAR(PERF_COUNTERS_REGION_ID(NAME))
+#define PERF_COUNTERS_REGION_END(VAR) VAR.end()
+#else
+#define PERF_COUNTERS_REGION(NAME) do {} while(0)
+#define PERF_COUNTERS_REGION_BEGIN(VAR, NAME) do {} while(0)
+#define PERF_COUNTERS_REGION_END(VAR) do {} while(0)
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <limits>
+#include <cstddef>
+
+namespace DENSE_MULTICUT {
+
+    // Limits for anytime solving. When exhausted, solvers stop contracting and return the labeling reached so far. 0 disables a limit.
+    struct solve_budget {
+        // Wall clock seconds from the start of the solve, including index construction, which itself is not interrupted.
+        double max_seconds = 0.0;
+        size_t max_contractions = 0;
+    };
+
+    // State of the returned labeling.
+    struct solve_status {
+        // Multicut objective of the returned labeling, including the offset term.
+        double objective = 0.0;
+        size_t nr_clusters = 0;
+        size_t nr_contractions = 0;
+        // false if the budget ran out before all positive edges were contracted.
+        bool is_final = true;
+        // Wall clock seconds from the start of the solve, including index construction, to the first contraction. Only recorded by
+        // the index based dense GAEC solvers, 0 otherwise or if nothing was contracted.
+        double first_contraction_seconds = 0.0;
+    };
+
+    // Budget test for solver loops. The contraction limit is an integer comparison, the clock is only read every check_interval calls.
+    class budget_guard {
+        public:
+            budget_guard(const solve_budget& budget, const size_t check_interval = 256)
+                : max_contractions_(budget.max_contractions > 0 ? budget.max_contractions : std::numeric_limits<size_t>::max()),
+                has_deadline_(budget.max_seconds > 0.0),
+                begin_(std::chrono::steady_clock::now()),
+                deadline_(begin_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(budget.max_seconds))),
+                check_interval_(check_interval)
+            {}
+
+            // Once true, stays true.
+            bool exhausted(const size_t nr_contractions)
+            {
+                if(nr_contractions >= max_contractions_)
+                    exhausted_ = true;
+                else if(has_deadline_ && ++nr_calls_ % check_interval_ == 0 && std::chrono::steady_clock::now() >= deadline_)
+                    exhausted_ = true;
+                return exhausted_;
+            }
+
+            // Contractions left before the contraction limit.
+            size_t remaining_contractions(const size_t nr_contractions) const { return nr_contractions < max_contractions_ ? max_contractions_ - nr_contractions : 0; }
+
+            // Seconds since the guard was created, i.e. since the start of the solve.
+            double elapsed_seconds() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_).count(); }
+
+        private:
+            const size_t max_contractions_;
+            const bool has_deadline_;
+            const std::chrono::steady_clock::time_point begin_;
+            const std::chrono::steady_clock::time_point deadline_;
+            const size_t check_interval_;
+            size_t nr_calls_ = 0;
+            bool exhausted_ = false;
+    };
+}
@@ -4,12 +4,15 @@
 #include <cassert>
 #include <limits>
 #include <numeric>
+#include "binary_io.h"
 
 namespace DENSE_MULTICUT {
 
+// INDEX can be a 32-bit type whenever all ids fit, which halves the memory of both arrays.
+template<typename INDEX = std::size_t>
 class union_find {
-    std::vector<std::size_t> id;
-    std::vector<std::size_t> sz;
+    std::vector<INDEX> id;
+    std::vector<INDEX> sz;
     std::size_t cnt;
 
     public: 
@@ -28,22 +31,22 @@ class union_find {
     void reset() { init(this->size()); }
 
     // Return the id of component corresponding to object p.
-    std::size_t find(std::size_t p) {
+    INDEX find(INDEX p) {
         assert(p < size());
-        std::size_t root = p;
+        INDEX root = p;
         while (root != id[root])
             root = id[root];
         while (p != root) {
-            std::size_t newp = id[p];
+            INDEX newp = id[p];
             id[p] = root;
             p = newp;
         }
         return root;
     }
     // Replace sets containing x and y with their union.
-    void merge(const std::size_t x, const std::size_t y) {
-        const std::size_t i = find(x);
-        const std::size_t j = find(y);
+    void merge(const INDEX x, const INDEX y) {
+        const INDEX i = find(x);
+        const INDEX j = find(y);
         if(i == j) return;
 
         // make smaller root point to larger one
@@ -59,22 +62,22 @@ class union_find {
         cnt--;
     }
     // Are objects x and y in the same set?
-    bool connected(const std::size_t x, const std::size_t y) {
+    bool connected(const INDEX x, const INDEX y) {
         return find(x) == find(y);
     }
 
-    std::size_t no_elements(const std::size_t x) const
+    INDEX no_elements(const INDEX x) const
     {
         return sz[x];
     }
 
-    std::size_t thread_safe_find(const std::size_t p) const {
-        std::size_t root = p;
+    INDEX thread_safe_find(const INDEX p) const {
+        INDEX root = p;
         while (root != id[root])
             root = id[root];
         return root;
     }
-    bool thread_safe_connected(const std::size_t x, const std::size_t y) const {
+    bool thread_safe_connected(const INDEX x, const INDEX y) const {
         return thread_safe_find(x) == thread_safe_find(y);
     }
     // Return the number of disjoint sets.
@@ -82,15 +85,32 @@ class union_find {
         return cnt;
     }
 
-    std::vector<std::size_t> get_contiguous_ids()
+    void serialize(binary_writer& writer) const
     {
-        std::vector<std::size_t> contiguous_ids(this->size());
-        std::vector<std::size_t> id_mapping(this->size(), std::numeric_limits<std::size_t>::max());
+        writer.write_vector(id);
+        writer.write_vector(sz);
+        writer.write(cnt);
+    }
+
+    void deserialize(binary_reader& reader)
+    {
+        id = reader.read_vector<INDEX>();
+        sz = reader.read_vector<INDEX>();
+        cnt = reader.read<std::size_t>();
+        assert(id.size() == sz.size());
+    }
+
+    // Sequential, concurrent_union_find::get_contiguous_ids is the parallel counterpart. The solvers do not call either: they return
+    // root ids, which the callers renumber with contiguous_labeling when needed, and that is parallel already.
+    std::vector<INDEX> get_contiguous_ids()
+    {
+        std::vector<INDEX> contiguous_ids(this->size());
+        std::vector<INDEX> id_mapping(this->size(), std::numeric_limits<INDEX>::max());
         for(std::size_t i=0; i<this->size(); ++i) {
-            std::size_t d = find(i);
+            INDEX d = find(i);
             id_mapping[d] = 1; 
         }
-        std::size_t next_id = 0;
+        INDEX next_id = 0;
         for(std::size_t d=0; d<this->size(); ++d) {
             if(id_mapping[d] == 1) {
                 id_mapping[d] = next_id;
@@ -99,11 +119,11 @@ class union_find {
         }
 
         for(std::size_t i=0; i<this->size(); ++i) {
-            std::size_t d = find(i);
-            assert(id_mapping[d] != std::numeric_limits<std::size_t>::max());
+            INDEX d = find(i);
+            assert(id_mapping[d] != std::numeric_limits<INDEX>::max());
             contiguous_ids[i] = id_mapping[d];
         }
-        return id_mapping;
+        return contiguous_ids;
     }
 };
 
@@ -0,0 +1,162 @@
+#include "batch_solver.h"
+#include "dense_features_parser.h"
+#include "metrics.h"
+#include "log.h"
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <omp.h>
+
+namespace DENSE_MULTICUT {
+
+    std::vector<batch_instance> read_batch_instances(const std::string& manifest_or_directory, const std::string& output_dir)
+    {
+        namespace fs = std::filesystem;
+        auto default_output = [&](const fs::path& input) {
+            return output_dir == "" ? std::string("") : (fs::path(output_dir) / input.filename()).string();
+        };
+
+        std::vector<batch_instance> instances;
+        if(fs::is_directory(manifest_or_directory))
+        {
+            std::vector<fs::path> files;
+            for(const auto& entry : fs::directory_iterator(manifest_or_directory))
+                if(entry.is_regular_file() && entry.path().extension() == ".txt")
+                    files.push_back(entry.path());
+            std::sort(files.begin(), files.end());
+            for(const fs::path& f : files)
+                instances.push_back({f.string(), default_output(f)});
+            return instances;
+        }
+
+        std::ifstream manifest(manifest_or_directory);
+        if(!manifest.is_open())
+            throw std::runtime_error("Could not open batch manifest " + manifest_or_directory);
+        const fs::path base = fs::path(manifest_or_directory).parent_path();
+        std::string line;
+        while(std::getline(manifest, line))
+        {
+            std::istringstream fields(line);
+            std::string input, output;
+            if(!(fields >> input) || input[0] == '#')
+                continue;
+            const fs::path input_path = fs::path(input).is_absolute() ? fs::path(input) : base / input;
+            if(fields >> output)
+                instances.push_back({input_path.string(), fs::path(output).is_absolute() ? output : (base / output).string()});
+            else
+                instances.push_back({input_path.string(), default_output(input_path)});
+        }
+        return instances;
+    }
+
+    namespace {
+        struct work_queue {
+            std::mutex mutex;
+            std::deque<size_t> items;
+        };
+
+        // Own work is taken from the front, stolen work from the back.
+        bool next_instance(std::vector<work_queue>& queues, const size_t t, size_t& instance)
+        {
+            for(size_t c=0; c<queues.size(); ++c)
+            {
+                work_queue& q = queues[(t + c) % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if(q.items.empty())
+                    continue;
+                if(c == 0)
+                {
+                    instance = q.items.front();
+                    q.items.pop_front();
+                }
+                else
+                {
+                    instance = q.items.back();
+                    q.items.pop_back();
+                    METRICS_COUNTER_ADD("batch steals", 1);
+                }
+                return true;
+            }
+            return false;
+        }
+    }
+
+    batch_summary solve_batch(const std::vector<batch_instance>& instances, const batch_options& options, const batch_callback& callback)
+    {
+        if(options.solver.dist_offset < 0.0)
+            throw std::runtime_error("dist_offset can only be >= 0.");
+        const auto begin = std::chrono::steady_clock::now();
+        const size_t nr_threads = std::max(size_t(1), std::min(options.nr_threads > 0 ? options.nr_threads : size_t(omp_get_max_threads()), instances.size()));
+
+        // largest files first and dealt round-robin, so that every queue starts with its longest instance.
+        std::vector<size_t> order(instances.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::vector<std::uintmax_t> file_sizes(instances.size(), 0);
+        for(size_t i=0; i<instances.size(); ++i)
+        {
+            std::error_code ec;
+            const std::uintmax_t s = std::filesystem::file_size(instances[i].input_path, ec);
+            file_sizes[i] = ec ? 0 : s;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return file_sizes[a] > file_sizes[b]; });
+        std::vector<work_queue> queues(nr_threads);
+        for(size_t c=0; c<order.size(); ++c)
+            queues[c % nr_threads].items.push_back(order[c]);
+
+        LOG_INFO << "[batch] solve " << instances.size() << " instances on " << nr_threads << " threads\n";
+        std::atomic<size_t> nr_done{0};
+        std::atomic<size_t> nr_failed{0};
+        std::atomic<size_t> nr_nodes{0};
+
+#pragma omp parallel num_threads(nr_threads)
+        {
+            // faiss parallelizes with OpenMP internally, which only costs synchronization for small instances.
+            omp_set_num_threads(1);
+            const size_t t = omp_get_thread_num();
+            dense_gaec_solver solver(options.solver);
+            dense_gaec_result result;
+            size_t i;
+            while(next_instance(queues, t, i))
+            {
+                const batch_instance& instance = instances[i];
+                try
+                {
+                    const auto [features, n, d] = read_file(instance.input_path);
+                    solver.solve(n, d, features, result);
+                    if(instance.output_path != "")
+                        write_labeling(instance.output_path, result.labels, options.output_format, options.with_cluster_sizes);
+                    nr_nodes += n;
+                    METRICS_COUNTER_ADD("batch instances", 1);
+                    METRICS_HISTOGRAM_ADD("batch instance seconds", result.timings.total);
+                    LOG_INFO << "[batch] " << ++nr_done << "/" << instances.size() << " " << instance.input_path << ": " << n << " nodes, "
+                        << result.nr_clusters << " clusters, objective " << result.objective << ", " << result.timings.total << " s" << (result.is_final ? "" : ", budget exhausted") << "\n";
+                    if(callback)
+                        callback(i, result);
+                }
+                catch(const std::exception& e)
+                {
+                    ++nr_failed;
+                    ++nr_done;
+                    LOG_ERROR << "[batch] " << instance.input_path << " failed: " << e.what() << "\n";
+                }
+            }
+        }
+
+        batch_summary summary;
+        summary.nr_instances = instances.size();
+        summary.nr_failed = nr_failed;
+        summary.nr_nodes = nr_nodes;
+        summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        LOG_INFO << "[batch] solved " << summary.nr_instances - summary.nr_failed << " of " << summary.nr_instances << " instances in " << summary.seconds << " s, "
+            << summary.instances_per_second() << " instances/s, " << summary.nodes_per_second() << " nodes/s\n";
+        return summary;
+    }
+}
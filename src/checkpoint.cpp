@@ -0,0 +1,131 @@
+#include "checkpoint.h"
+#include "log.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstdio>
+#include <algorithm>
+#include <unistd.h>
+
+namespace DENSE_MULTICUT {
+
+    checkpoint_writer::checkpoint_writer(const checkpoint_options& options, const size_t nr_contractions)
+        : options_(options),
+        enabled_(options.directory != "" && (options.interval_seconds > 0.0 || options.interval_contractions > 0)),
+        last_checkpoint_time_(std::chrono::steady_clock::now()),
+        last_checkpoint_contractions_(nr_contractions)
+    {
+        if(!enabled_)
+            return;
+        std::filesystem::create_directories(options_.directory);
+        thread_ = std::thread(&checkpoint_writer::write_loop, this);
+    }
+
+    checkpoint_writer::~checkpoint_writer()
+    {
+        if(!thread_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        if(nr_checkpoints_ > 0)
+            LOG_INFO << "[checkpoint] " << nr_checkpoints_ << " checkpoints, peak serialized state " << peak_state_bytes_ / 1e6 << " MB held in memory besides the solver state\n";
+    }
+
+    bool checkpoint_writer::due(const size_t nr_contractions)
+    {
+        if(!enabled_ || busy_.load(std::memory_order_relaxed))
+            return false;
+        if(options_.interval_contractions > 0 && nr_contractions >= last_checkpoint_contractions_ + options_.interval_contractions)
+            return true;
+        if(options_.interval_seconds > 0.0 && ++nr_due_calls_ % 1024 == 0)
+        {
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - last_checkpoint_time_;
+            return elapsed.count() >= options_.interval_seconds;
+        }
+        return false;
+    }
+
+    void checkpoint_writer::submit(std::vector<char>&& state, const size_t nr_contractions)
+    {
+        last_checkpoint_time_ = std::chrono::steady_clock::now();
+        last_checkpoint_contractions_ = nr_contractions;
+        last_state_bytes_ = state.size();
+        peak_state_bytes_ = std::max(peak_state_bytes_, state.capacity());
+        ++nr_checkpoints_;
+        busy_ = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ = std::move(state);
+            has_pending_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    void checkpoint_writer::write_loop()
+    {
+        while(true)
+        {
+            std::vector<char> state;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [&]() { return has_pending_ || stop_; });
+                if(!has_pending_)
+                    return;
+                state = std::move(pending_);
+                has_pending_ = false;
+            }
+            try
+            {
+                const auto begin = std::chrono::steady_clock::now();
+                write_checkpoint(options_.directory, state);
+                const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - begin;
+                LOG_INFO << "[checkpoint] wrote " << state.size() << " bytes to " << checkpoint_file(options_.directory) << " in " << duration.count() << " s\n";
+            }
+            catch(const std::exception& e)
+            {
+                LOG_WARNING << "[checkpoint] writing checkpoint failed: " << e.what() << "\n";
+            }
+            busy_ = false;
+        }
+    }
+
+    std::string checkpoint_file(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "checkpoint.bin").string();
+    }
+
+    void write_checkpoint(const std::string& directory, const std::vector<char>& state)
+    {
+        // write to a temporary file first, so that a preemption during writing leaves the previous checkpoint intact.
+        const std::string path = checkpoint_file(directory);
+        const std::string tmp_path = path + ".tmp";
+        std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+        if(f == nullptr)
+            throw std::runtime_error("Could not open checkpoint file " + tmp_path);
+        const size_t nr_written = std::fwrite(state.data(), 1, state.size(), f);
+        const bool ok = nr_written == state.size() && std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+        std::fclose(f);
+        if(!ok)
+            throw std::runtime_error("Could not write checkpoint file " + tmp_path);
+        std::filesystem::rename(tmp_path, path);
+    }
+
+    std::vector<char> read_checkpoint(const std::string& directory)
+    {
+        const std::string path = checkpoint_file(directory);
+        std::ifstream f(path, std::ios::binary | std::ios::ate);
+        if(!f.is_open())
+            throw std::runtime_error("Could not open checkpoint file " + path);
+        std::vector<char> state(f.tellg());
+        f.seekg(0);
+        f.read(state.data(), state.size());
+        if(!f)
+            throw std::runtime_error("Could not read checkpoint file " + path);
+        return state;
+    }
+}
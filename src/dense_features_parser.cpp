@@ -1,8 +1,11 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
+#include <array>
 #include "dense_features_parser.h"
+#include "labeling_io.h"
 
 std::tuple<std::vector<float>, size_t, size_t> read_file(const std::string& file_path)
 {
@@ -23,4 +26,48 @@ std::tuple<std::vector<float>, size_t, size_t> read_file(const std::string& file
         ++index;
     }
     return {features, num_nodes, num_dim};
-}
\ No newline at end of file
+}
+
+std::tuple<std::vector<size_t>, std::vector<size_t>> read_graph_file(const std::string& file_path, const size_t num_nodes)
+{
+    std::ifstream f;
+    f.open(file_path);
+    if(!f.is_open())
+        throw std::runtime_error("Could not open graph file " + file_path);
+
+    std::vector<std::array<size_t,2>> edges;
+    std::string line;
+    size_t line_nr = 0;
+    while (std::getline(f, line))
+    {
+        ++line_nr;
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        std::istringstream s(line);
+        size_t i, j;
+        std::string rest;
+        if (!(s >> i >> j) || s >> rest)
+            throw std::runtime_error("Could not parse edge in line " + std::to_string(line_nr) + " of " + file_path);
+        if(i >= num_nodes || j >= num_nodes)
+            throw std::runtime_error("Edge " + std::to_string(i) + " " + std::to_string(j) + " in " + file_path + " out of range for " + std::to_string(num_nodes) + " nodes");
+        edges.push_back({i, j});
+    }
+    if (!f.eof())
+        throw std::runtime_error("Could not read graph file " + file_path);
+
+    std::vector<size_t> row_offsets(num_nodes + 1, 0);
+    for (const auto [i, j] : edges)
+        ++row_offsets[i + 1];
+    for (size_t c = 0; c < num_nodes; ++c)
+        row_offsets[c + 1] += row_offsets[c];
+    std::vector<size_t> column_indices(edges.size());
+    std::vector<size_t> fill(row_offsets.begin(), row_offsets.end() - 1);
+    for (const auto [i, j] : edges)
+        column_indices[fill[i]++] = j;
+    return {row_offsets, column_indices};
+}
+
+std::vector<size_t> read_labeling_file(const std::string& file_path)
+{
+    return DENSE_MULTICUT::read_labeling(file_path);
+}
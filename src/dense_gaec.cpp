@@ -1,14 +1,23 @@
 #include "dense_gaec.h"
 #include "feature_index.h"
+#include "feature_stream.h"
 #include "dense_multicut_utils.h"
 #include "union_find.hxx"
 #include "time_measure_util.h"
+#include "perf_counters.h"
+#include "node_id.h"
+#include "log.h"
 
 #include <vector>
 #include <queue>
 #include <numeric>
 #include <random>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <limits>
 
 #include <faiss/index_factory.h>
 #include <faiss/IndexFlat.h>
@@ -22,69 +31,145 @@
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_impl(const size_t n, const size_t d, std::vector<float> features, const std::string index_str, const bool track_dist_offset)
+    // Buffers of the contraction loop, kept between solves of dense_gaec_solver. The priority queue is a heap in pq, so that its storage can be reused.
+    template<typename ID>
+    struct dense_gaec_workspace {
+        union_find<ID> uf;
+        std::vector<pq_edge<ID>> pq;
+        std::vector<std::vector<ID>> pq_pair;
+        std::vector<faiss::Index::idx_t> query;
+
+        void init(const size_t max_nr_ids)
+        {
+            uf.init(max_nr_ids);
+            pq.clear();
+            if(pq_pair.size() < max_nr_ids)
+                pq_pair.resize(max_nr_ids);
+            for(size_t i=0; i<max_nr_ids; ++i)
+                pq_pair[i].clear();
+        }
+    };
+
+    namespace {
+        double seconds_since(const std::chrono::steady_clock::time_point begin)
+        {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+
+        double offset_dimension_square(const size_t d, const std::vector<float>& features, const bool track_dist_offset)
+        {
+            return track_dist_offset ? features[d-1] * features[d-1] : 0.0;
+        }
+    }
+
+    // Contracts all positive edges of the nodes in index, which must hold exactly n features, or stops early when the budget is exhausted.
+    // The objective starts from disconnected_cost, the cost_disconnected of the features. The merge tree starts from tree_dist_offset,
+    // the squared offset dimension of the first node.
+    template<typename ID>
+    void dense_gaec_impl(const size_t n, const size_t d, const double tree_dist_offset, const std::string& index_str, const bool track_dist_offset, merge_tree* tree,
+            feature_index& index, const double disconnected_cost, dense_gaec_workspace<ID>& ws, budget_guard& budget, dense_gaec_result& result)
     {
         MEASURE_FUNCTION_EXECUTION_TIME;
-        feature_index index(d, n, features, index_str, track_dist_offset);
-        assert(features.size() == n*d);
 
-        std::cout << "[dense gaec " << index_str << "] Find multicut for " << n << " nodes with features of dimension " << d << "\n";
+        LOG_INFO << "[dense gaec " << index_str << "] Find multicut for " << n << " nodes with features of dimension " << d << "\n";
 
-        double multicut_cost = cost_disconnected(n, d, features, track_dist_offset);
+        double multicut_cost = disconnected_cost;
+        if(tree != nullptr)
+            tree->init(n, tree_dist_offset);
 
         const size_t max_nr_ids = 2*n;
-        union_find uf(max_nr_ids);
-
-        using pq_type = std::tuple<float, std::array<faiss::Index::idx_t,2>>;
-        auto pq_comp = [](const pq_type& a, const pq_type& b) { return std::get<0>(a) < std::get<0>(b); };
-        std::priority_queue<pq_type, std::vector<pq_type>, decltype(pq_comp)> pq(pq_comp);
-        std::vector<std::vector<u_int32_t>> pq_pair(max_nr_ids);
+        ws.init(max_nr_ids);
+        auto& uf = ws.uf;
+        auto& pq = ws.pq;
+        auto& pq_pair = ws.pq_pair;
+        const pq_edge_less<ID> less;
+        size_t nr_contractions = 0;
+        const bool exact_search = index.exact_search();
 
+        const auto search_begin = std::chrono::steady_clock::now();
+        auto phase_begin = search_begin;
         {
-            std::vector<faiss::Index::idx_t> all_indices(n);
+            PERF_COUNTERS_REGION("initial kNN");
+            auto& all_indices = ws.query;
+            all_indices.resize(n);
             std::iota(all_indices.begin(), all_indices.end(), 0);
             const auto [nns, distances] = index.get_nearest_nodes(all_indices);
             for(size_t i=0; i<n; ++i)
             {
                 if(distances[i] > 0.0)
                 {
-                    pq.push({distances[i], {i,nns[i]}});
+                    pq.push_back({distances[i], ID(i), ID(nns[i])});
                     pq_pair[nns[i]].push_back(i);
                     //std::cout << "[dense gaec] push initial shortest edge " << i << " <-> " << nns << " with cost " << distance << "\n";
                 }
             }
+            std::make_heap(pq.begin(), pq.end(), less);
         }
+        result.timings.initial_search = seconds_since(phase_begin);
         //std::cout << "[dense gaec] Added " << pq.size() << " initial elements to priority queue\n";
 
+        phase_begin = std::chrono::steady_clock::now();
         // iteratively find pairs of features with highest inner product
+        PERF_COUNTERS_REGION_BEGIN(queue_region, "queue processing");
+        result.is_final = true;
         while(!pq.empty()) {
-            const auto [distance, ij] = pq.top();
-            pq.pop();
+            if(budget.exhausted(nr_contractions))
+            {
+                result.is_final = false;
+                break;
+            }
+            std::pop_heap(pq.begin(), pq.end(), less);
+            const auto [distance, i, j] = pq.back();
+            pq.pop_back();
             assert(distance > 0.0);
-            const auto [i,j] = ij;
             assert(i != j);
             // check if edge is still present in contracted graph. This is true if both endpoints have not been contracted
             if(index.node_active(i) && index.node_active(j))
             {
                 //std::cout << "[dense multicut " << index_str << "] contracting edge " << i << " and " << j << " with edge cost " << distance << "\n";
+                // the queue holds the best edge of every node, so its top bounds all competing edges if searches are exact. Otherwise the contraction cannot be certified.
+                float runner_up_cost = std::numeric_limits<float>::infinity();
+                if(tree != nullptr && exact_search)
+                {
+                    runner_up_cost = 0.0;
+                    // drop stale entries and duplicates of (i,j), so that the top of the queue is the best competing edge. Non-positive edges never enter the queue.
+                    while(!pq.empty())
+                    {
+                        const ID k = pq.front().i;
+                        const ID l = pq.front().j;
+                        if(index.node_active(k) && index.node_active(l) && !((k == i && l == j) || (k == j && l == i)))
+                            break;
+                        std::pop_heap(pq.begin(), pq.end(), less);
+                        pq.pop_back();
+                    }
+                    if(!pq.empty())
+                        runner_up_cost = std::max(runner_up_cost, pq.front().cost);
+                }
                 // contract edge:
-                const size_t new_id = index.merge(i,j);
+                const ID new_id = index.merge(i,j);
 
                 uf.merge(i, new_id);
                 uf.merge(j, new_id);
 
                 multicut_cost -= distance;
+                if(++nr_contractions == 1)
+                    result.timings.first_contraction = seconds_since(search_begin);
+                METRICS_COUNTER_ADD("contractions", 1);
+                METRICS_GAUGE_SET("queue size", pq.size());
+                if(tree != nullptr)
+                    tree->add_contraction(i, j, new_id, distance, runner_up_cost);
 
                 // find new nearest neighbor
                 if(index.nr_nodes() > 1)
                 {
-                    std::vector<faiss::Index::idx_t> new_query;
+                    auto& new_query = ws.query;
+                    new_query.clear();
                     new_query.push_back(new_id);
 
-                    for(const faiss::Index::idx_t k : pq_pair[i])
+                    for(const ID k : pq_pair[i])
                         if(index.node_active(k))
                             new_query.push_back(k);
-                    for(const faiss::Index::idx_t k : pq_pair[j])
+                    for(const ID k : pq_pair[j])
                         if(index.node_active(k))
                             new_query.push_back(k);
 
@@ -96,33 +181,150 @@ namespace DENSE_MULTICUT {
                     {
                         if(new_distances[c] > 0.0)
                         {
-                            pq.push({new_distances[c], {new_nns[c], new_query[c]}});
+                            pq.push_back({new_distances[c], ID(new_nns[c]), ID(new_query[c])});
+                            std::push_heap(pq.begin(), pq.end(), less);
                             pq_pair[new_nns[c]].push_back(new_query[c]);
                         }
                     }
                 }
             }
         }
+        PERF_COUNTERS_REGION_END(queue_region);
+        result.timings.contraction = seconds_since(phase_begin);
 
-        std::cout << "[dense gaec " << index_str << "] final nr clusters = " << uf.count() - (max_nr_ids - index.max_id_nr()-1) << "\n";
-        std::cout << "[dense gaec " << index_str << "] final multicut cost = " << multicut_cost << "\n";
+        phase_begin = std::chrono::steady_clock::now();
+        result.objective = multicut_cost;
+        result.nr_contractions = nr_contractions;
+        result.nr_clusters = uf.count() - (max_nr_ids - index.max_id_nr()-1);
+        LOG_INFO << "[dense gaec " << index_str << "] final nr clusters = " << result.nr_clusters << "\n";
+        LOG_INFO << "[dense gaec " << index_str << "] final multicut cost = " << multicut_cost << "\n";
+        if(!result.is_final)
+            LOG_INFO << "[dense gaec " << index_str << "] budget exhausted after " << nr_contractions << " contractions, labeling is not final\n";
 
-        std::vector<size_t> component_labeling(n);
+        result.labels.resize(n);
         for(size_t i=0; i<n; ++i)
-            component_labeling[i] = uf.find(i);
-        return component_labeling;
+            result.labels[i] = uf.find(i);
+        result.timings.labeling = seconds_since(phase_begin);
     }
 
-    std::vector<size_t> dense_gaec_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset)
+    std::vector<size_t> dense_gaec_impl(const size_t n, const size_t d, const double tree_dist_offset, const std::string& index_str, const bool track_dist_offset, merge_tree* tree,
+            feature_index& index, const double disconnected_cost, budget_guard& guard, solve_status* status)
     {
-        std::cout << "Dense GAEC with flat index\n";
-        return dense_gaec_impl(n, d, features, "Flat", track_dist_offset);
+        const double index_seconds = guard.elapsed_seconds();
+        dense_gaec_result result;
+        if(fits_32bit_ids(n))
+        {
+            dense_gaec_workspace<uint32_t> ws;
+            dense_gaec_impl<uint32_t>(n, d, tree_dist_offset, index_str, track_dist_offset, tree, index, disconnected_cost, ws, guard, result);
+        }
+        else
+        {
+            dense_gaec_workspace<size_t> ws;
+            dense_gaec_impl<size_t>(n, d, tree_dist_offset, index_str, track_dist_offset, tree, index, disconnected_cost, ws, guard, result);
+        }
+        if(status != nullptr)
+            *status = {result.objective, result.nr_clusters, result.nr_contractions, result.is_final,
+                result.nr_contractions > 0 ? index_seconds + result.timings.first_contraction : 0.0};
+        return std::move(result.labels);
+    }
+
+    std::vector<size_t> dense_gaec_impl(const size_t n, const size_t d, std::vector<float> features, const std::string index_str, const bool track_dist_offset, merge_tree* tree, const feature_index_options& index_options,
+            const solve_budget& budget, solve_status* status)
+    {
+        budget_guard guard(budget);
+        feature_index index(d, n, features, index_str, track_dist_offset, index_options);
+        const double disconnected_cost = cost_disconnected(n, d, features, track_dist_offset);
+        const double tree_dist_offset = offset_dimension_square(d, features, track_dist_offset);
+        release_input_features(features, index_options);
+        return dense_gaec_impl(n, d, tree_dist_offset, index_str, track_dist_offset, tree, index, disconnected_cost, guard, status);
     }
 
-    std::vector<size_t> dense_gaec_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset)
+    std::vector<size_t> dense_gaec_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset, merge_tree* tree, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
     {
-        std::cout << "Dense GAEC with HNSW index\n";
-        return dense_gaec_impl(n, d, features, "HNSW", track_dist_offset);
+        LOG_INFO << "Dense GAEC with flat index\n";
+        return dense_gaec_impl(n, d, std::move(features), "Flat", track_dist_offset, tree, index_options, budget, status);
     }
 
+    std::vector<size_t> dense_gaec_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset, merge_tree* tree, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
+    {
+        LOG_INFO << "Dense GAEC with HNSW index\n";
+        return dense_gaec_impl(n, d, std::move(features), "HNSW", track_dist_offset, tree, index_options, budget, status);
+    }
+
+    std::vector<size_t> dense_gaec_pipelined(const feature_stream& stream, const std::string& index_str, merge_tree* tree, const feature_index_options& index_options,
+            const solve_budget& budget, solve_status* status)
+    {
+        LOG_INFO << "Dense GAEC with " << index_str << " index on pipelined input\n";
+        const auto begin = std::chrono::steady_clock::now();
+        budget_guard guard(budget);
+        feature_index index(stream.dim(), stream.nr_rows(), stream.features(), [&](const size_t count) { return stream.wait_for_rows(count); },
+                index_str, stream.track_dist_offset(), index_options);
+        LOG_INFO << "[dense gaec " << index_str << "] index ready after " << seconds_since(begin) << " s, parsing took " << stream.parse_seconds() << " s\n";
+        return dense_gaec_impl(stream.nr_rows(), stream.dim(), offset_dimension_square(stream.dim(), stream.features(), stream.track_dist_offset()), index_str, stream.track_dist_offset(), tree, index, stream.cost_disconnected(), guard, status);
+    }
+
+}
+
+namespace DENSE_MULTICUT {
+
+    struct dense_gaec_solver::workspace {
+        // input features, with the offset dimension appended if there is an offset.
+        std::vector<float> features;
+        std::unique_ptr<feature_index> index;
+        dense_gaec_workspace<uint32_t> ws32;
+        dense_gaec_workspace<size_t> ws64;
+    };
+
+    dense_gaec_solver::dense_gaec_solver(const dense_gaec_options& options)
+        : options_(options),
+        workspace_(std::make_unique<workspace>())
+    {
+        if(options_.dist_offset < 0.0)
+            throw std::runtime_error("dist_offset can only be >= 0.");
+    }
+
+    dense_gaec_solver::~dense_gaec_solver() = default;
+
+    dense_gaec_result dense_gaec_solver::solve(const size_t n, const size_t d, const std::vector<float>& features, merge_tree* tree)
+    {
+        dense_gaec_result result;
+        solve(n, d, features, result, tree);
+        return result;
+    }
+
+    void dense_gaec_solver::solve(const size_t n, const size_t d, const std::vector<float>& features, dense_gaec_result& result, merge_tree* tree)
+    {
+        if(features.size() != n*d)
+            throw std::runtime_error("dense gaec solver: expected " + std::to_string(n*d) + " feature values, got " + std::to_string(features.size()));
+        const auto begin = std::chrono::steady_clock::now();
+        budget_guard guard(options_.budget);
+        workspace& w = *workspace_;
+        const bool track_dist_offset = options_.dist_offset != 0.0;
+        const size_t d_eff = track_dist_offset ? d + 1 : d;
+
+        if(track_dist_offset)
+        {
+            w.features.resize(n * d_eff);
+            const float offset_feature = std::sqrt(options_.dist_offset);
+            for(size_t i=0; i<n; ++i)
+            {
+                std::copy(features.begin() + i*d, features.begin() + (i+1)*d, w.features.begin() + i*d_eff);
+                w.features[i*d_eff + d] = offset_feature;
+            }
+        }
+        const std::vector<float>& solver_features = track_dist_offset ? w.features : features;
+
+        // the index is rebuilt only when the dimension changes, otherwise its storage and trained quantizers are reused.
+        if(w.index == nullptr || w.index->dim() != d_eff)
+            w.index = std::make_unique<feature_index>(d_eff, n, solver_features, options_.index_str, track_dist_offset, options_.index_options);
+        else
+            w.index->reset(n, solver_features);
+        result.timings.index = seconds_since(begin);
+
+        if(fits_32bit_ids(n))
+            dense_gaec_impl<uint32_t>(n, d_eff, offset_dimension_square(d_eff, solver_features, track_dist_offset), options_.index_str, track_dist_offset, tree, *w.index, cost_disconnected(n, d_eff, solver_features, track_dist_offset), w.ws32, guard, result);
+        else
+            dense_gaec_impl<size_t>(n, d_eff, offset_dimension_square(d_eff, solver_features, track_dist_offset), options_.index_str, track_dist_offset, tree, *w.index, cost_disconnected(n, d_eff, solver_features, track_dist_offset), w.ws64, guard, result);
+        result.timings.total = seconds_since(begin);
+    }
 }
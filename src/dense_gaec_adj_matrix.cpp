@@ -2,20 +2,27 @@
 #include "dense_multicut_utils.h"
 #include "union_find.hxx"
 #include "time_measure_util.h"
+#include "log.h"
 
 #include <iostream>
 #include <vector>
 #include <queue>
 #include <cassert>
 #include <functional>
+#include <numeric>
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_adj_matrix(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset)
+    std::vector<size_t> dense_gaec_adj_matrix(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset, merge_tree* tree)
     {
         MEASURE_FUNCTION_EXECUTION_TIME;
-        std::cout << "[dense gaec adj matrix] compute multicut on graph with " << n << " nodes with " << d << " feature dimensions\n";
+        LOG_INFO << "[dense gaec adj matrix] compute multicut on graph with " << n << " nodes with " << d << " feature dimensions\n";
         double multicut_cost = cost_disconnected(n, d, features, track_dist_offset);
+        if(tree != nullptr)
+            tree->init(n, track_dist_offset ? features[d-1] * features[d-1] : 0.0);
+        // merged clusters keep the id of one endpoint here, but get consecutive new ids in the merge tree.
+        std::vector<size_t> tree_id(tree != nullptr ? n : 0);
+        std::iota(tree_id.begin(), tree_id.end(), 0);
 
         //std::vector<std::tuple<float,u_int32_t>> edges(((n-1)*n)/2, 0.0);
         std::vector<std::tuple<float,u_int32_t>> edges(n*n, {0.0, 0});
@@ -79,7 +86,7 @@ namespace DENSE_MULTICUT {
                 }
 
         std::vector<char> active(n, true);
-        union_find uf(n);
+        union_find<u_int32_t> uf(n);
 
         while(!pq.empty())
         {
@@ -96,6 +103,23 @@ namespace DENSE_MULTICUT {
 
             uf.merge(i,j);
             multicut_cost -= edge_cost(i,j);
+            METRICS_COUNTER_ADD("contractions", 1);
+            METRICS_GAUGE_SET("queue size", pq.size());
+            if(tree != nullptr)
+            {
+                // drop outdated entries and duplicates of (i,j), so that the top of the queue is the best competing edge.
+                while(!pq.empty())
+                {
+                    const edge_type_q& f_q = pq.top();
+                    if(f_q.stamp == edge_stamp(f_q[0], f_q[1]) && active[f_q[0]] && active[f_q[1]] && !((f_q[0] == i && f_q[1] == j) || (f_q[0] == j && f_q[1] == i)))
+                        break;
+                    pq.pop();
+                }
+                const float runner_up_cost = pq.empty() ? 0.0 : std::max(0.0f, pq.top().cost);
+                const size_t new_id = n + tree->nr_contractions();
+                tree->add_contraction(tree_id[i], tree_id[j], new_id, edge_cost(i,j), runner_up_cost);
+                tree_id[i] = new_id;
+            }
             active[j] = false;
 
             // contract edge
@@ -117,8 +141,8 @@ namespace DENSE_MULTICUT {
             }
         }
 
-        std::cout << "[dense gaec adj matrix] final nr clusters = " << uf.count() << "\n";
-        std::cout << "[dense gaec adj matrix] final multicut cost = " << multicut_cost << "\n";
+        LOG_INFO << "[dense gaec adj matrix] final nr clusters = " << uf.count() << "\n";
+        LOG_INFO << "[dense gaec adj matrix] final multicut cost = " << multicut_cost << "\n";
 
         std::vector<size_t> cc_ids(n);
         for(size_t i=0; i<n; ++i)
@@ -0,0 +1,165 @@
+#include "dense_gaec_graph.h"
+#include "feature_index.h"
+#include "dense_multicut_utils.h"
+#include "union_find.hxx"
+#include "time_measure_util.h"
+#include "node_id.h"
+#include "log.h"
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+namespace DENSE_MULTICUT {
+
+    template<typename ID>
+    std::vector<size_t> dense_gaec_graph_impl(const size_t n, const size_t d, std::vector<float> features, const std::vector<size_t>& row_offsets, const std::vector<size_t>& column_indices,
+            const bool track_dist_offset, merge_tree* tree, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
+    {
+        MEASURE_FUNCTION_EXECUTION_TIME;
+        budget_guard guard(budget);
+        if(row_offsets.size() != n+1 || row_offsets.back() != column_indices.size())
+            throw std::runtime_error("graph in CSR format needs n+1 row offsets ending at the number of column indices");
+
+        // only the features are needed, cluster sums are formed by merge.
+        feature_index_options storage_options;
+        storage_options.precision = index_options.precision;
+        storage_options.storage_dir = index_options.storage_dir;
+        storage_options.memory_budget_mb = index_options.memory_budget_mb;
+        feature_index index(d, n, features, "", track_dist_offset, storage_options);
+
+        LOG_INFO << "[dense gaec graph] Find multicut for " << n << " nodes with features of dimension " << d << " on graph with " << column_indices.size() << " adjacency entries\n";
+
+        double multicut_cost = cost_disconnected(n, d, features, track_dist_offset);
+        if(tree != nullptr)
+            tree->init(n, track_dist_offset ? features[d-1] * features[d-1] : 0.0);
+        release_input_features(features, index_options);
+
+        const size_t max_nr_ids = 2*n;
+        union_find<ID> uf(max_nr_ids);
+        std::vector<std::vector<ID>> adjacency(max_nr_ids);
+        // stamp of the last node whose neighbours were collected, to drop duplicate neighbours without sorting.
+        std::vector<ID> seen(max_nr_ids, ID(max_nr_ids));
+
+        // symmetric adjacency without duplicates and self loops.
+        for(size_t i=0; i<n; ++i)
+            for(size_t c=row_offsets[i]; c<row_offsets[i+1]; ++c)
+            {
+                const size_t j = column_indices[c];
+                if(j >= n)
+                    throw std::runtime_error("graph neighbour " + std::to_string(j) + " of node " + std::to_string(i) + " out of range");
+                if(i != j)
+                {
+                    adjacency[i].push_back(j);
+                    adjacency[j].push_back(i);
+                }
+            }
+        std::priority_queue<pq_edge<ID>, std::vector<pq_edge<ID>>, pq_edge_less<ID>> pq;
+        size_t nr_edges = 0;
+        for(size_t i=0; i<n; ++i)
+        {
+            std::vector<ID>& neighbours = adjacency[i];
+            size_t nr_unique = 0;
+            for(const ID j : neighbours)
+                if(seen[j] != ID(i))
+                {
+                    seen[j] = i;
+                    neighbours[nr_unique++] = j;
+                    // cost of each edge once, from its smaller endpoint.
+                    if(i < j)
+                    {
+                        ++nr_edges;
+                        const float cost = index.inner_product(i, j);
+                        if(cost > 0.0)
+                            pq.push({cost, ID(i), j});
+                    }
+                }
+            neighbours.resize(nr_unique);
+            neighbours.shrink_to_fit();
+        }
+        LOG_INFO << "[dense gaec graph] " << nr_edges << " edges, " << pq.size() << " with positive cost\n";
+
+        size_t nr_contractions = 0;
+        bool is_final = true;
+        while(!pq.empty())
+        {
+            if(guard.exhausted(nr_contractions))
+            {
+                is_final = false;
+                break;
+            }
+            const auto [distance, i, j] = pq.top();
+            pq.pop();
+            assert(i != j);
+            // edges of contracted nodes are stale, their clusters have new ids.
+            if(!index.node_active(i) || !index.node_active(j))
+                continue;
+
+            float runner_up_cost = 0.0;
+            if(tree != nullptr)
+            {
+                // drop stale entries, so that the top of the queue is the best competing edge. Every edge enters the queue at most once.
+                while(!pq.empty() && !(index.node_active(pq.top().i) && index.node_active(pq.top().j)))
+                    pq.pop();
+                if(!pq.empty())
+                    runner_up_cost = pq.top().cost;
+            }
+
+            const ID new_id = index.merge(i, j);
+            uf.merge(i, new_id);
+            uf.merge(j, new_id);
+            multicut_cost -= distance;
+            ++nr_contractions;
+            METRICS_COUNTER_ADD("contractions", 1);
+            METRICS_GAUGE_SET("queue size", pq.size());
+            if(tree != nullptr)
+                tree->add_contraction(i, j, new_id, distance, runner_up_cost);
+
+            // neighbours of the new cluster are the active neighbours of both parts, their costs come from the summed features.
+            std::vector<ID>& new_neighbours = adjacency[new_id];
+            for(const ID p : {i, j})
+            {
+                for(const ID k : adjacency[p])
+                    if(index.node_active(k) && seen[k] != new_id)
+                    {
+                        seen[k] = new_id;
+                        new_neighbours.push_back(k);
+                    }
+                std::vector<ID>().swap(adjacency[p]);
+            }
+            for(const ID k : new_neighbours)
+            {
+                // replace the contracted parts in the list of k.
+                std::vector<ID>& k_neighbours = adjacency[k];
+                k_neighbours.erase(std::remove_if(k_neighbours.begin(), k_neighbours.end(), [&](const ID l) { return !index.node_active(l); }), k_neighbours.end());
+                k_neighbours.push_back(new_id);
+                const float cost = index.inner_product(new_id, k);
+                if(cost > 0.0)
+                    pq.push({cost, new_id, k});
+            }
+        }
+
+        const size_t nr_clusters = n - nr_contractions;
+        LOG_INFO << "[dense gaec graph] final nr clusters = " << nr_clusters << "\n";
+        LOG_INFO << "[dense gaec graph] final multicut cost = " << multicut_cost << "\n";
+        if(!is_final)
+            LOG_INFO << "[dense gaec graph] budget exhausted after " << nr_contractions << " contractions, labeling is not final\n";
+        if(status != nullptr)
+            *status = {multicut_cost, nr_clusters, nr_contractions, is_final};
+
+        std::vector<size_t> component_labeling(n);
+        for(size_t i=0; i<n; ++i)
+            component_labeling[i] = uf.find(i);
+        return component_labeling;
+    }
+
+    std::vector<size_t> dense_gaec_graph(const size_t n, const size_t d, std::vector<float> features, const std::vector<size_t>& row_offsets, const std::vector<size_t>& column_indices,
+            const bool track_dist_offset, merge_tree* tree, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
+    {
+        if(fits_32bit_ids(n))
+            return dense_gaec_graph_impl<uint32_t>(n, d, std::move(features), row_offsets, column_indices, track_dist_offset, tree, index_options, budget, status);
+        return dense_gaec_graph_impl<size_t>(n, d, std::move(features), row_offsets, column_indices, track_dist_offset, tree, index_options, budget, status);
+    }
+}
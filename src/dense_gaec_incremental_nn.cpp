@@ -4,12 +4,18 @@
 #include "dense_multicut_utils.h"
 #include "union_find.hxx"
 #include "time_measure_util.h"
+#include "perf_counters.h"
+#include "checkpoint.h"
+#include "binary_io.h"
+#include "node_id.h"
+#include "log.h"
 
 #include <vector>
 #include <queue>
 #include <numeric>
 #include <random>
 #include <iostream>
+#include <array>
 
 #include <faiss/index_factory.h>
 #include <faiss/IndexFlat.h>
@@ -23,19 +29,22 @@
 
 namespace DENSE_MULTICUT {
 
-    using pq_type = std::tuple<float, std::array<faiss::Index::idx_t,2>>;
-    template<typename T, class Container=std::vector<T>, class Compare=std::less<typename Container::value_type>> 
-    class priority_queue_with_deletion : public std::priority_queue<T, Container, Compare>
+    namespace {
+        constexpr std::array<char,4> checkpoint_magic = {'D','M','C','P'};
+        constexpr uint32_t checkpoint_version = 1;
+    }
+
+    template<typename ID>
+    class priority_queue_with_deletion : public std::priority_queue<pq_edge<ID>, std::vector<pq_edge<ID>>, pq_edge_less<ID>>
     {
         public:
-            // inherit constructors
-            using std::priority_queue<T, Container, Compare>::priority_queue;
             void remove_invalid(const feature_index& index) {
-                std::vector<pq_type> retained_edges;
+                std::vector<pq_edge<ID>> retained_edges;
                 retained_edges.reserve(this->size());
                 for (auto it = this->c.begin(); it != this->c.end();++it)
                 {
-                    const auto [i,j] = std::get<1>(*it);
+                    const ID i = it->i;
+                    const ID j = it->j;
                     // check if edge is still present in contracted graph. This is true if both endpoints have not been contracted
                     if(index.node_active(i) && index.node_active(j))
                         retained_edges.push_back(*it);
@@ -43,89 +52,229 @@ namespace DENSE_MULTICUT {
                 this->c = retained_edges;
                 std::make_heap(this->c.begin(), this->c.end(), this->comp);
             }
+
+            void serialize(binary_writer& writer) const {
+                std::vector<float> costs;
+                std::vector<ID> endpoints;
+                costs.reserve(this->size());
+                endpoints.reserve(2 * this->size());
+                for (const pq_edge<ID>& e : this->c)
+                {
+                    costs.push_back(e.cost);
+                    endpoints.push_back(e.i);
+                    endpoints.push_back(e.j);
+                }
+                writer.write_vector(costs);
+                writer.write_vector(endpoints);
+            }
+
+            void deserialize(binary_reader& reader) {
+                const std::vector<float> costs = reader.read_vector<float>();
+                const std::vector<ID> endpoints = reader.read_vector<ID>();
+                this->c.clear();
+                this->c.reserve(costs.size());
+                for (size_t e = 0; e != costs.size(); ++e)
+                    this->c.push_back({costs[e], endpoints[2 * e], endpoints[2 * e + 1]});
+                std::make_heap(this->c.begin(), this->c.end(), this->comp);
+            }
     };
 
-    std::vector<size_t> dense_gaec_incremental_nn(const size_t n, const size_t d, std::vector<float> features, const size_t k_in, const std::string index_type, const bool track_dist_offset)
+    template<typename ID>
+    std::vector<size_t> dense_gaec_incremental_nn_impl(const size_t n, const size_t d, std::vector<float> features, const size_t k_in, const std::string index_type, const bool track_dist_offset, merge_tree* tree, const checkpoint_options& checkpoint, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
     {
         MEASURE_FUNCTION_EXECUTION_TIME;
+        budget_guard guard(budget);
         const size_t k = std::min(n - 1, k_in);
-        feature_index index(d, n, features, index_type, track_dist_offset);
         assert(features.size() == n*d);
 
-        std::cout << "[dense gaec incremental nn] Find multicut for " << n << " nodes with features of dimension " << d << " and feature index type "<<index_type<<"\n";
+        // state is written in the order in which it is read back below. The header identifies everything the remaining state is interpreted with:
+        // the instance, the id width of the serialized union find, neighbour lists and queue, the index type and the distance offset.
+        const std::vector<char> index_type_chars(index_type.begin(), index_type.end());
+        const float offset_feature = track_dist_offset ? features[d-1] : 0.0;
+        std::vector<char> checkpoint_state;
+        if(checkpoint.resume)
+        {
+            checkpoint_state = read_checkpoint(checkpoint.directory);
+            LOG_INFO << "[dense gaec incremental nn] resume from checkpoint " << checkpoint_file(checkpoint.directory) << "\n";
+        }
+        binary_reader checkpoint_reader(checkpoint_state);
+        if(checkpoint.resume)
+        {
+            if(checkpoint_reader.read<std::array<char,4>>() != checkpoint_magic || checkpoint_reader.read<uint32_t>() != checkpoint_version)
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " is not a dense multicut checkpoint of version " + std::to_string(checkpoint_version));
+            const size_t checkpoint_n = checkpoint_reader.read<size_t>();
+            const size_t checkpoint_d = checkpoint_reader.read<size_t>();
+            const size_t checkpoint_k = checkpoint_reader.read<size_t>();
+            if(checkpoint_n != n || checkpoint_d != d || checkpoint_k != k)
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " was written for a different instance");
+            if(checkpoint_reader.read<uint32_t>() != sizeof(ID))
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " was written with a different id width");
+            if(checkpoint_reader.read_vector<char>() != index_type_chars)
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " was written for a different index type than " + index_type);
+            const bool checkpoint_track_dist_offset = checkpoint_reader.read<bool>();
+            const float checkpoint_offset_feature = checkpoint_reader.read<float>();
+            if(checkpoint_track_dist_offset != track_dist_offset || checkpoint_offset_feature != offset_feature)
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " was written for a different distance offset");
+        }
+
+        feature_index index = checkpoint.resume ? feature_index(checkpoint_reader) : feature_index(d, n, features, index_type, track_dist_offset, index_options);
 
-        double multicut_cost = cost_disconnected(n, d, features, track_dist_offset);
+        LOG_INFO << "[dense gaec incremental nn] Find multicut for " << n << " nodes with features of dimension " << d << " and feature index type "<<index_type<<"\n";
+
+        double multicut_cost = checkpoint.resume ? checkpoint_reader.read<double>() : cost_disconnected(n, d, features, track_dist_offset);
+        if(tree != nullptr)
+            tree->init(n, track_dist_offset ? features[d-1] * features[d-1] : 0.0);
+        release_input_features(features, index_options);
 
         const size_t max_nr_ids = 2*n;
-        union_find uf(max_nr_ids);
+        union_find<ID> uf(max_nr_ids);
 
-        incremental_nns nn_graph;
-        auto pq_comp = [](const pq_type& a, const pq_type& b) { return std::get<0>(a) < std::get<0>(b); };
-        priority_queue_with_deletion<pq_type, std::vector<pq_type>, decltype(pq_comp)> pq(pq_comp);
+        incremental_nns<ID> nn_graph;
+        priority_queue_with_deletion<ID> pq;
+        bool completed = false;
+        size_t max_pq_size = 0;
+        if(checkpoint.resume)
+        {
+            uf.deserialize(checkpoint_reader);
+            nn_graph.deserialize(checkpoint_reader);
+            pq.deserialize(checkpoint_reader);
+            completed = checkpoint_reader.read<bool>();
+            max_pq_size = checkpoint_reader.read<size_t>();
+            const bool checkpoint_has_tree = checkpoint_reader.read<bool>();
+            if(tree != nullptr && !checkpoint_has_tree)
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " does not contain a merge tree");
+            if(checkpoint_has_tree)
+            {
+                merge_tree checkpoint_tree;
+                checkpoint_tree.deserialize(checkpoint_reader);
+                if(tree != nullptr)
+                    *tree = checkpoint_tree;
+            }
+            if(!checkpoint_reader.at_end())
+                throw std::runtime_error("checkpoint in " + checkpoint.directory + " has trailing data");
+            LOG_INFO << "[dense gaec incremental nn] resumed after " << index.max_id_nr() + 1 - n << " contractions with multicut cost " << multicut_cost << "\n";
+        }
+        else
         {
             MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("Initial KNN construction");
+            PERF_COUNTERS_REGION("initial kNN");
             std::vector<faiss::Index::idx_t> all_indices(n);
             std::iota(all_indices.begin(), all_indices.end(), 0);
             const auto [nns, distances] = index.get_nearest_nodes(all_indices, k);
-            std::cout<<"[dense gaec incremental nn] Initial NN search complete\n";
-            nn_graph = incremental_nns(all_indices, nns, distances, n, k);
+            LOG_INFO <<"[dense gaec incremental nn] Initial NN search complete\n";
+            nn_graph = incremental_nns<ID>(all_indices, nns, distances, n, k);
             size_t index_1d = 0;
             for(size_t i=0; i<n; ++i)
                 for(size_t i_k=0; i_k < k; ++i_k, ++index_1d)
                     if(distances[index_1d] > 0.0)
-                        pq.push({distances[index_1d], {i, nns[index_1d]}});
+                        pq.push({distances[index_1d], ID(i), ID(nns[index_1d])});
+            max_pq_size = pq.size() * 10;
         }
-        const size_t max_pq_size = pq.size() * 10;
+
+        // after resuming, the next checkpoint is due one interval after the one resumed from.
+        checkpoint_writer checkpointer(checkpoint, index.max_id_nr() + 1 - n);
+        auto write_checkpoint_state = [&]() {
+            MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("checkpoint serialization");
+            binary_writer writer;
+            // the state changes little between checkpoints, a little slack usually avoids any reallocation and the copy it needs.
+            writer.reserve(checkpointer.size_hint() + checkpointer.size_hint() / 8);
+            writer.write(checkpoint_magic);
+            writer.write(checkpoint_version);
+            writer.write(n);
+            writer.write(d);
+            writer.write(k);
+            writer.write(uint32_t(sizeof(ID)));
+            writer.write_vector(index_type_chars);
+            writer.write(track_dist_offset);
+            writer.write(offset_feature);
+            index.serialize(writer);
+            writer.write(multicut_cost);
+            uf.serialize(writer);
+            nn_graph.serialize(writer);
+            pq.serialize(writer);
+            writer.write(completed);
+            writer.write(max_pq_size);
+            writer.write(tree != nullptr);
+            if(tree != nullptr)
+                tree->serialize(writer);
+            checkpointer.submit(std::move(writer.buffer()), index.max_id_nr() + 1 - n);
+        };
 
         // iteratively find pairs of features with highest inner product
-        bool completed = false;
+        bool is_final = true;
+        PERF_COUNTERS_REGION_BEGIN(queue_region, "queue processing");
         while(!pq.empty() || !completed) {
+            if (guard.exhausted(index.max_id_nr() + 1 - n))
+            {
+                is_final = false;
+                break;
+            }
+            if (checkpointer.due(index.max_id_nr() + 1 - n))
+                write_checkpoint_state();
             if (pq.size() == 0)
             {
-                const std::vector<std::tuple<size_t, size_t, float>> remaining_edges = nn_graph.recheck_possible_contractions(index);
+                const std::vector<std::tuple<ID, ID, float>> remaining_edges = nn_graph.recheck_possible_contractions(index);
                 for (const auto [i, j, cost]: remaining_edges)
-                    pq.push({cost, {i, j}});
-                std::cout<<"Found "<<pq.size()<<" leftover contractions.\n";
+                    pq.push({cost, i, j});
+                LOG_DEBUG<<"[dense gaec incremental nn] Found "<<pq.size()<<" leftover contractions.\n";
                 completed = pq.size() == 0;
                 continue;
             }
-            const auto [distance, ij] = pq.top();
+            const auto [distance, i, j] = pq.top();
             pq.pop();
             assert(distance >= 0.0);
-            const auto [i,j] = ij;
             assert(i != j);
             // check if edge is still present in contracted graph. This is true if both endpoints have not been contracted
             if(index.node_active(i) && index.node_active(j))
             {
                 // std::cout << "[dense gaec incremental nn] contracting edge " << i << " and " << j << " with edge cost " << distance << "\n";
                 // contract edge:
-                const size_t new_id = index.merge(i,j);
+                const ID new_id = index.merge(i,j);
 
                 uf.merge(i, new_id);
                 uf.merge(j, new_id);
-                const std::unordered_map<size_t, float> nn_ij = nn_graph.merge_nodes(i, j, new_id, index);
+                const std::unordered_map<ID, float> nn_ij = nn_graph.merge_nodes(i, j, new_id, index);
                 multicut_cost -= distance;
+                METRICS_COUNTER_ADD("contractions", 1);
+                METRICS_GAUGE_SET("queue size", pq.size());
+                // the queue only holds edges to the k nearest neighbours and is refilled by rechecks once it drains, so its top does not bound
+                // the competing edges. Contractions are recorded without runner-up cost and threshold sweeps do not certify them.
+                if(tree != nullptr)
+                    tree->add_contraction(i, j, new_id, distance);
                 // find new nearest neighbor
                 if(index.nr_nodes() > 1)
                     for (auto const& [nn_new, new_cost] : nn_ij)
-                        pq.push({new_cost, {new_id, nn_new}});
+                        pq.push({new_cost, new_id, nn_new});
             }
             if (pq.size() > max_pq_size)
             {
-                std::cout<<"[dense gaec incremental nn] cleaning-up PQ with size: "<<pq.size();
+                const size_t old_pq_size = pq.size();
                 pq.remove_invalid(index);
-                std::cout<<", new PQ size: "<<pq.size()<<"\n";
+                LOG_DEBUG<<"[dense gaec incremental nn] cleaning-up PQ with size: "<<old_pq_size<<", new PQ size: "<<pq.size()<<"\n";
             }
         }
+        PERF_COUNTERS_REGION_END(queue_region);
 
-        std::cout << "[dense gaec incremental nn] final nr clusters = " << uf.count() - (max_nr_ids - index.max_id_nr()-1) << "\n";
-        std::cout << "[dense gaec incremental nn] final multicut cost = " << multicut_cost << "\n";
+        const size_t nr_clusters = uf.count() - (max_nr_ids - index.max_id_nr()-1);
+        LOG_INFO << "[dense gaec incremental nn] final nr clusters = " << nr_clusters << "\n";
+        LOG_INFO << "[dense gaec incremental nn] final multicut cost = " << multicut_cost << "\n";
+        if(!is_final)
+            LOG_INFO << "[dense gaec incremental nn] budget exhausted after " << n - nr_clusters << " contractions, labeling is not final\n";
+        if(status != nullptr)
+            *status = {multicut_cost, nr_clusters, n - nr_clusters, is_final};
 
         std::vector<size_t> component_labeling(n);
         for(size_t i=0; i<n; ++i)
             component_labeling[i] = uf.find(i);
         return component_labeling;
     }
+
+    std::vector<size_t> dense_gaec_incremental_nn(const size_t n, const size_t d, std::vector<float> features, const size_t k, const std::string index_type, const bool track_dist_offset, merge_tree* tree, const checkpoint_options& checkpoint, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
+    {
+        if(fits_32bit_ids(n))
+            return dense_gaec_incremental_nn_impl<uint32_t>(n, d, std::move(features), k, index_type, track_dist_offset, tree, checkpoint, index_options, budget, status);
+        return dense_gaec_incremental_nn_impl<size_t>(n, d, std::move(features), k, index_type, track_dist_offset, tree, checkpoint, index_options, budget, status);
+    }
 }
 
 
@@ -1,34 +1,49 @@
 #include "feature_index.h"
 #include "dense_gaec_parallel.h"
 #include "maximum_matching_greedy.h"
+#include "maximum_matching_parallel.h"
 #include "dense_multicut_utils.h"
 #include "time_measure_util.h"
-#include "union_find.hxx"
+#include "concurrent_union_find.hxx"
+#include "node_id.h"
+#include "log.h"
 #include <string>
 #include <queue>
+#include <tuple>
+#include <array>
+#include <algorithm>
 
 namespace DENSE_MULTICUT {
 
-    std::vector<size_t> dense_gaec_parallel_impl(const size_t n, const size_t d, std::vector<float> features, const std::string index_str, const bool track_dist_offset)
+    template<typename ID>
+    std::vector<size_t> dense_gaec_parallel_impl(const size_t n, const size_t d, std::vector<float> features, const std::string index_str, const bool track_dist_offset, merge_tree* tree, const bool greedy_matching, const size_t k_candidates, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
     {
         MEASURE_FUNCTION_EXECUTION_TIME;
-        feature_index index(d, n, features, index_str, track_dist_offset);
+        // rounds are long, so the clock is read before each of them.
+        budget_guard guard(budget, 1);
+        feature_index index(d, n, features, index_str, track_dist_offset, index_options);
         assert(features.size() == n*d);
 
-        std::cout << "[dense gaec parallel " << index_str << "] Find multicut for " << n << " nodes with features of dimension " << d << "\n";
+        LOG_INFO << "[dense gaec parallel " << index_str << "] Find multicut for " << n << " nodes with features of dimension " << d << "\n";
 
         double multicut_cost = cost_disconnected(n, d, features, track_dist_offset);
+        if(tree != nullptr)
+            tree->init(n, track_dist_offset ? features[d-1] * features[d-1] : 0.0);
+        release_input_features(features, index_options);
 
         const size_t max_nr_ids = 2*n;
-        union_find uf(max_nr_ids);
-
-        using pq_type = std::tuple<float, std::array<faiss::Index::idx_t,2>>;
-        auto pq_comp = [](const pq_type& a, const pq_type& b) { return std::get<0>(a) < std::get<0>(b); };
-        std::priority_queue<pq_type, std::vector<pq_type>, decltype(pq_comp)> pq(pq_comp);
+        concurrent_union_find<ID> uf(max_nr_ids);
 
         size_t iter = 0;
+        size_t nr_searched_nodes = 0;
+        bool is_final = true;
         for(; index.nr_nodes() > 0; ++iter)
         {
+            if(guard.exhausted(index.max_id_nr() + 1 - n))
+            {
+                is_final = false;
+                break;
+            }
             std::vector<faiss::Index::idx_t> all_active_indices;
             for(faiss::Index::idx_t idx=0; idx<=index.max_id_nr(); ++idx)
                 if(index.node_active(idx))
@@ -38,7 +53,12 @@ namespace DENSE_MULTICUT {
             if(all_active_indices.size() == 0)
                 break;
 
-            const auto [nns, distances] = index.get_nearest_nodes(all_active_indices);
+            // with more than one candidate per node the matching can pick a further neighbour when the nearest one is taken.
+            const size_t nr_candidates = std::min(k_candidates, all_active_indices.size() - 1);
+            if(nr_candidates == 0)
+                break;
+            const auto [nns, distances] = nr_candidates == 1 ? index.get_nearest_nodes(all_active_indices) : index.get_nearest_nodes(all_active_indices, nr_candidates);
+            nr_searched_nodes += all_active_indices.size();
             if(*std::max_element(distances.begin(), distances.end()) <= 0.0)
                 break;
 
@@ -48,49 +68,91 @@ namespace DENSE_MULTICUT {
             std::vector<float> positive_distances;
             for(size_t c=0; c<all_active_indices.size(); ++c)
             {
-                if(distances[c] > 0.0)
+                for(size_t l=0; l<nr_candidates; ++l)
                 {
-                    i.push_back(all_active_indices[c]);
-                    j.push_back(nns[c]);
-                    positive_distances.push_back(distances[c]);
+                    if(distances[c*nr_candidates + l] > 0.0)
+                    {
+                        i.push_back(all_active_indices[c]);
+                        j.push_back(nns[c*nr_candidates + l]);
+                        positive_distances.push_back(distances[c*nr_candidates + l]);
+                    }
                 }
             }
 
-            const std::vector<std::array<size_t,2>> matching = maximum_matching_greedy(i.begin(), i.end(), j.begin(), positive_distances.begin());
+            std::vector<std::array<size_t,2>> matching = greedy_matching ?
+                maximum_matching_greedy(i.begin(), i.end(), j.begin(), positive_distances.begin()) :
+                maximum_matching_parallel(i.begin(), i.end(), j.begin(), positive_distances.begin());
+            // the last round within the contraction budget only contracts the highest cost part of the matching, the matching itself is not ordered by cost.
+            const size_t remaining_contractions = guard.remaining_contractions(index.max_id_nr() + 1 - n);
+            if(matching.size() > remaining_contractions)
+            {
+                std::vector<std::tuple<double, std::array<size_t,2>>> ranked(matching.size());
+#pragma omp parallel for schedule(static)
+                for(size_t c=0; c<matching.size(); ++c)
+                    ranked[c] = {index.inner_product(matching[c][0], matching[c][1]), matching[c]};
+                std::partial_sort(ranked.begin(), ranked.begin() + remaining_contractions, ranked.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+                matching.resize(remaining_contractions);
+                for(size_t c=0; c<remaining_contractions; ++c)
+                    matching[c] = std::get<1>(ranked[c]);
+            }
 
             //std::cout << "[dense gaec parallel " << index_str << "] matching gave " << matching.size() << " edges to contract\n";
 
-            for(const auto [i,j] : matching)
+            // matched pairs are disjoint, so the whole round is contracted at once.
+            const faiss::Index::idx_t first_new_id = index.merge(matching);
+            std::vector<double> costs(matching.size());
+#pragma omp parallel for schedule(static)
+            for(size_t c=0; c<matching.size(); ++c)
+            {
+                const auto [i,j] = matching[c];
+                costs[c] = index.inner_product(i,j);
+                uf.merge(i, first_new_id + c);
+                uf.merge(j, first_new_id + c);
+            }
+            METRICS_COUNTER_ADD("contractions", matching.size());
+            METRICS_HISTOGRAM_ADD("contractions per round", matching.size());
+            for(size_t c=0; c<matching.size(); ++c)
             {
-                //std::cout << "[dense gaec parallel] contract edge " << i << " <-> " << j << " with edge cost " << index.inner_product(i,j) << "\n";
-                const faiss::Index::idx_t new_id = index.merge(i,j);
-                multicut_cost -= index.inner_product(i,j);
-                uf.merge(i, new_id);
-                uf.merge(j, new_id);
+                multicut_cost -= costs[c];
+                if(tree != nullptr)
+                    tree->add_contraction(matching[c][0], matching[c][1], first_new_id + c, costs[c]);
             }
         }
 
         const size_t nr_contracted_edges = n - (uf.count() - (max_nr_ids - index.max_id_nr()-1)); 
-        std::cout << "[dense gaec parallel " << index_str << "] "
+        LOG_INFO << "[dense gaec parallel " << index_str << "] "
             << "final nr clusters = " << n - nr_contracted_edges 
-            << " after " << iter << " iterations, i.e. " << nr_contracted_edges/double(iter) << " contractions per iteration\n";
-        std::cout << "[dense gaec parallel " << index_str << "] final multicut cost = " << multicut_cost << "\n";
+            << " after " << iter << " iterations, i.e. " << nr_contracted_edges/double(iter) << " contractions per iteration, "
+            << nr_searched_nodes << " nearest neighbour queries\n";
+        LOG_INFO << "[dense gaec parallel " << index_str << "] final multicut cost = " << multicut_cost << "\n";
+        if(!is_final)
+            LOG_INFO << "[dense gaec parallel " << index_str << "] budget exhausted after " << nr_contracted_edges << " contractions, labeling is not final\n";
+        if(status != nullptr)
+            *status = {multicut_cost, n - nr_contracted_edges, nr_contracted_edges, is_final};
 
         std::vector<size_t> component_labeling(n);
+#pragma omp parallel for schedule(static)
         for(size_t i=0; i<n; ++i)
             component_labeling[i] = uf.find(i);
         return component_labeling;
     }
 
-    std::vector<size_t> dense_gaec_parallel_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset)
+    std::vector<size_t> dense_gaec_parallel_impl(const size_t n, const size_t d, std::vector<float> features, const std::string index_str, const bool track_dist_offset, merge_tree* tree, const bool greedy_matching, const size_t k_candidates, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
+    {
+        if(fits_32bit_ids(n))
+            return dense_gaec_parallel_impl<uint32_t>(n, d, std::move(features), index_str, track_dist_offset, tree, greedy_matching, k_candidates, index_options, budget, status);
+        return dense_gaec_parallel_impl<size_t>(n, d, std::move(features), index_str, track_dist_offset, tree, greedy_matching, k_candidates, index_options, budget, status);
+    }
+
+    std::vector<size_t> dense_gaec_parallel_flat_index(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset, merge_tree* tree, const bool greedy_matching, const size_t k_candidates, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
     {
-        std::cout << "Dense parallel GAEC with flat index\n";
-        return dense_gaec_parallel_impl(n, d, features, "Flat", track_dist_offset);
+        LOG_INFO << "Dense parallel GAEC with flat index\n";
+        return dense_gaec_parallel_impl(n, d, std::move(features), "Flat", track_dist_offset, tree, greedy_matching, k_candidates, index_options, budget, status);
     }
 
-    std::vector<size_t> dense_gaec_parallel_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset)
+    std::vector<size_t> dense_gaec_parallel_hnsw(const size_t n, const size_t d, std::vector<float> features, const bool track_dist_offset, merge_tree* tree, const bool greedy_matching, const size_t k_candidates, const feature_index_options& index_options, const solve_budget& budget, solve_status* status)
     {
-        std::cout << "Dense parallel GAEC with HNSW index\n";
-        return dense_gaec_parallel_impl(n, d, features, "HNSW", track_dist_offset);
+        LOG_INFO << "Dense parallel GAEC with HNSW index\n";
+        return dense_gaec_parallel_impl(n, d, std::move(features), "HNSW", track_dist_offset, tree, greedy_matching, k_candidates, index_options, budget, status);
     }
 }
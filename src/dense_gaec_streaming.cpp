@@ -0,0 +1,324 @@
+#include "dense_gaec_streaming.h"
+#include "time_measure_util.h"
+#include "node_id.h"
+#include "log.h"
+
+#include <queue>
+#include <numeric>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstdio>
+#include <unistd.h>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        constexpr char streaming_state_magic[4] = {'D','M','S','S'};
+        constexpr uint32_t streaming_state_version = 1;
+    }
+
+    dense_gaec_streaming::dense_gaec_streaming(const size_t d, const float dist_offset, const std::string& index_str)
+        : d_(d),
+        dist_offset_(dist_offset),
+        index_str_(index_str)
+    {
+        if(dist_offset < 0)
+            throw std::runtime_error("dist_offset can only be >= 0.");
+    }
+
+    dense_gaec_streaming dense_gaec_streaming::from_labeling(const size_t n, const size_t d, const std::vector<float>& features, const std::vector<size_t>& labeling, const float dist_offset, const std::string& index_str)
+    {
+        assert(features.size() == n*d);
+        assert(labeling.size() == n);
+        if(n == 0)
+            return dense_gaec_streaming(d, dist_offset, index_str);
+        std::unordered_map<size_t, size_t> cluster_index;
+        std::vector<size_t> labels;
+        for(size_t i=0; i<n; ++i)
+            if(cluster_index.insert({labeling[i], labels.size()}).second)
+                labels.push_back(labeling[i]);
+
+        std::vector<float> sums(labels.size() * d, 0.0);
+        std::vector<size_t> sizes(labels.size(), 0);
+        for(size_t i=0; i<n; ++i)
+        {
+            const size_t c = cluster_index[labeling[i]];
+            sizes[c]++;
+            for(size_t l=0; l<d; ++l)
+                sums[c*d + l] += features[i*d + l];
+        }
+
+        dense_gaec_streaming s(d, dist_offset, index_str);
+        const faiss::Index::idx_t first_id = s.add_nodes(labels.size(), sums, sizes);
+        std::copy(labels.begin(), labels.end(), s.node_label_.begin() + first_id);
+        s.next_label_ = *std::max_element(labels.begin(), labels.end()) + 1;
+        return s;
+    }
+
+    faiss::Index::idx_t dense_gaec_streaming::add_nodes(const size_t n, const std::vector<float>& sums, const std::vector<size_t>& sizes)
+    {
+        // the distance offset is encoded as additional dimension sqrt(offset) * cluster size, see append_dist_offset_in_features.
+        const bool track_dist_offset = dist_offset_ > 0.0;
+        const size_t index_d = track_dist_offset ? d_ + 1 : d_;
+        std::vector<float> index_features(n * index_d);
+        for(size_t i=0; i<n; ++i)
+        {
+            std::copy(sums.begin() + i*d_, sums.begin() + (i+1)*d_, index_features.begin() + i*index_d);
+            if(track_dist_offset)
+                index_features[i*index_d + d_] = std::sqrt(dist_offset_) * sizes[i];
+        }
+
+        faiss::Index::idx_t first_id = 0;
+        if(index_ == nullptr)
+            index_ = std::make_unique<feature_index>(index_d, n, index_features, index_str_, track_dist_offset);
+        else
+            first_id = index_->add_nodes(n, index_features.data());
+
+        node_label_.resize(first_id + n, no_label);
+        node_size_.resize(first_id + n);
+        std::copy(sizes.begin(), sizes.end(), node_size_.begin() + first_id);
+        return first_id;
+    }
+
+    size_t dense_gaec_streaming::nr_clusters() const
+    {
+        return index_ == nullptr ? 0 : index_->nr_nodes();
+    }
+
+    streaming_update dense_gaec_streaming::insert(const size_t n, const std::vector<float>& new_features)
+    {
+        MEASURE_FUNCTION_EXECUTION_TIME;
+        assert(new_features.size() == n*d_);
+        const auto begin_time = std::chrono::steady_clock::now();
+        streaming_update update;
+        if(n == 0)
+            return update;
+
+        const faiss::Index::idx_t first_new_id = add_nodes(n, new_features, std::vector<size_t>(n, 1));
+        LOG_INFO << "[dense gaec streaming] insert " << n << " points into clustering with " << nr_clusters() - n << " clusters\n";
+
+        // merged_into[id] is the id of the node id was contracted into, or id itself if it is still active.
+        std::vector<size_t> merged_into(index_->max_id_nr() + 1);
+        std::iota(merged_into.begin(), merged_into.end(), 0);
+
+        // ids after this insertion stay below twice the current number of ids, since every contraction consumes an active node.
+        if(fits_32bit_ids(index_->max_id_nr() + 1))
+            contract_new_nodes<uint32_t>(first_new_id, n, merged_into, update);
+        else
+            contract_new_nodes<size_t>(first_new_id, n, merged_into, update);
+
+        auto find_active = [&](size_t id) {
+            while(merged_into[id] != id)
+                id = merged_into[id];
+            return id;
+        };
+
+        update.new_node_labels.resize(n);
+        for(size_t c=0; c<n; ++c)
+        {
+            const size_t root = find_active(first_new_id + c);
+            if(node_label_[root] == no_label)
+                node_label_[root] = next_label_++;
+            update.new_node_labels[c] = node_label_[root];
+        }
+
+        compact();
+
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - begin_time;
+        update.points_per_second = n / std::max(duration.count(), 1e-9);
+        LOG_INFO << "[dense gaec streaming] " << update.nr_contractions << " contractions, " << update.merged_clusters.size() << " merged existing clusters, "
+            << nr_clusters() << " clusters, cost change " << update.cost_change << ", " << update.points_per_second << " points per second\n";
+        return update;
+    }
+
+    template<typename ID>
+    void dense_gaec_streaming::contract_new_nodes(const faiss::Index::idx_t first_new_id, const size_t n, std::vector<size_t>& merged_into, streaming_update& update)
+    {
+        std::priority_queue<pq_edge<ID>, std::vector<pq_edge<ID>>, pq_edge_less<ID>> pq;
+        std::unordered_map<ID, std::vector<ID>> pq_pair;
+
+        if(index_->nr_nodes() > 1)
+        {
+            std::vector<faiss::Index::idx_t> new_indices(n);
+            std::iota(new_indices.begin(), new_indices.end(), first_new_id);
+            const auto [nns, distances] = index_->get_nearest_nodes(new_indices);
+            for(size_t c=0; c<n; ++c)
+            {
+                if(distances[c] > 0.0)
+                {
+                    pq.push({distances[c], ID(new_indices[c]), ID(nns[c])});
+                    pq_pair[nns[c]].push_back(new_indices[c]);
+                }
+            }
+        }
+
+        while(!pq.empty())
+        {
+            const auto [distance, i, j] = pq.top();
+            pq.pop();
+            if(!index_->node_active(i) || !index_->node_active(j))
+                continue;
+
+            const faiss::Index::idx_t new_id = index_->merge(i,j);
+            merged_into.push_back(new_id);
+            merged_into[i] = new_id;
+            merged_into[j] = new_id;
+            update.cost_change -= distance;
+            update.nr_contractions++;
+
+            // the larger of two existing clusters keeps its label.
+            const size_t larger = node_size_[i] >= node_size_[j] ? i : j;
+            const size_t smaller = larger == i ? j : i;
+            size_t label = node_label_[larger] != no_label ? node_label_[larger] : node_label_[smaller];
+            if(node_label_[larger] != no_label && node_label_[smaller] != no_label)
+                update.merged_clusters.push_back({node_label_[smaller], node_label_[larger]});
+            node_label_.push_back(label);
+            node_size_.push_back(node_size_[i] + node_size_[j]);
+
+            if(index_->nr_nodes() > 1)
+            {
+                std::vector<faiss::Index::idx_t> new_query;
+                new_query.push_back(new_id);
+                for(const ID ij_endpoint : {i, j})
+                {
+                    const auto it = pq_pair.find(ij_endpoint);
+                    if(it == pq_pair.end())
+                        continue;
+                    for(const ID k : it->second)
+                        if(index_->node_active(k))
+                            new_query.push_back(k);
+                    pq_pair.erase(it);
+                }
+
+                const auto [new_nns, new_distances] = index_->get_nearest_nodes(new_query);
+                for(size_t c=0; c<new_nns.size(); ++c)
+                {
+                    if(new_distances[c] > 0.0)
+                    {
+                        pq.push({new_distances[c], ID(new_nns[c]), ID(new_query[c])});
+                        pq_pair[new_nns[c]].push_back(new_query[c]);
+                    }
+                }
+            }
+        }
+    }
+
+    void dense_gaec_streaming::compact()
+    {
+        // contracted nodes stay in the feature index as inactive entries. Rebuild once they dominate, so that long streams do not grow without bound.
+        const size_t nr_ids = index_->max_id_nr() + 1;
+        if(nr_ids < 2 * index_->nr_nodes() + 1024)
+            return;
+
+        MEASURE_FUNCTION_EXECUTION_TIME;
+        const std::vector<faiss::Index::idx_t> active_nodes = index_->get_active_nodes();
+        std::vector<float> sums(active_nodes.size() * d_);
+        std::vector<size_t> sizes(active_nodes.size());
+        std::vector<size_t> labels(active_nodes.size());
+        for(size_t c=0; c<active_nodes.size(); ++c)
+        {
+            const float* f = index_->node_features(active_nodes[c]);
+            std::copy(f, f + d_, sums.begin() + c*d_);
+            sizes[c] = node_size_[active_nodes[c]];
+            labels[c] = node_label_[active_nodes[c]];
+        }
+
+        index_.reset();
+        node_label_.clear();
+        node_size_.clear();
+        add_nodes(active_nodes.size(), sums, sizes);
+        node_label_ = labels;
+    }
+
+    void dense_gaec_streaming::save(const std::string& file_path) const
+    {
+        std::vector<uint64_t> labels;
+        std::vector<uint64_t> sizes;
+        std::vector<float> sums;
+        if(index_ != nullptr)
+        {
+            for(const faiss::Index::idx_t i : index_->get_active_nodes())
+            {
+                assert(node_label_[i] != no_label);
+                labels.push_back(node_label_[i]);
+                sizes.push_back(node_size_[i]);
+                const float* feature = index_->node_features(i);
+                sums.insert(sums.end(), feature, feature + d_);
+            }
+        }
+
+        // write to a temporary file first, so that a failure during writing leaves the previous state intact.
+        const std::string tmp_path = file_path + ".tmp";
+        std::FILE* f = std::fopen(tmp_path.c_str(), "wb");
+        if(f == nullptr)
+            throw std::runtime_error("Could not open streaming state file " + tmp_path);
+        bool ok = true;
+        auto write = [&](const void* data, const size_t size) {
+            ok = ok && std::fwrite(data, 1, size, f) == size;
+        };
+        const uint64_t d = d_;
+        const uint64_t nr_clusters = labels.size();
+        write(streaming_state_magic, sizeof(streaming_state_magic));
+        write(&streaming_state_version, sizeof(streaming_state_version));
+        write(&d, sizeof(d));
+        write(&dist_offset_, sizeof(dist_offset_));
+        write(&nr_clusters, sizeof(nr_clusters));
+        write(labels.data(), labels.size() * sizeof(uint64_t));
+        write(sizes.data(), sizes.size() * sizeof(uint64_t));
+        write(sums.data(), sums.size() * sizeof(float));
+        ok = ok && std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+        ok = std::fclose(f) == 0 && ok;
+        if(!ok)
+        {
+            std::remove(tmp_path.c_str());
+            throw std::runtime_error("Could not write streaming state file " + tmp_path);
+        }
+        std::filesystem::rename(tmp_path, file_path);
+    }
+
+    dense_gaec_streaming dense_gaec_streaming::load(const std::string& file_path, const std::string& index_str)
+    {
+        std::ifstream f(file_path, std::ios::binary);
+        if(!f.is_open())
+            throw std::runtime_error("Could not open streaming state file " + file_path);
+
+        char magic[4];
+        uint32_t version;
+        uint64_t d, nr_clusters;
+        float dist_offset;
+        f.read(magic, sizeof(magic));
+        f.read(reinterpret_cast<char*>(&version), sizeof(version));
+        f.read(reinterpret_cast<char*>(&d), sizeof(d));
+        f.read(reinterpret_cast<char*>(&dist_offset), sizeof(dist_offset));
+        f.read(reinterpret_cast<char*>(&nr_clusters), sizeof(nr_clusters));
+        if(!f || std::memcmp(magic, streaming_state_magic, sizeof(magic)) != 0 || version != streaming_state_version)
+            throw std::runtime_error("Invalid streaming state file " + file_path);
+
+        std::vector<uint64_t> labels(nr_clusters);
+        std::vector<uint64_t> sizes(nr_clusters);
+        std::vector<float> sums(nr_clusters * d);
+        f.read(reinterpret_cast<char*>(labels.data()), labels.size() * sizeof(uint64_t));
+        f.read(reinterpret_cast<char*>(sizes.data()), sizes.size() * sizeof(uint64_t));
+        f.read(reinterpret_cast<char*>(sums.data()), sums.size() * sizeof(float));
+        if(!f)
+            throw std::runtime_error("Truncated streaming state file " + file_path);
+
+        dense_gaec_streaming s(d, dist_offset, index_str);
+        if(nr_clusters > 0)
+        {
+            const faiss::Index::idx_t first_id = s.add_nodes(nr_clusters, sums, std::vector<size_t>(sizes.begin(), sizes.end()));
+            std::copy(labels.begin(), labels.end(), s.node_label_.begin() + first_id);
+            s.next_label_ = *std::max_element(labels.begin(), labels.end()) + 1;
+        }
+        LOG_INFO << "[dense gaec streaming] loaded " << nr_clusters << " clusters of dimension " << d << " from " << file_path << "\n";
+        return s;
+    }
+}
@@ -0,0 +1,275 @@
+#include "dense_gaec.h"
+#include "dense_gaec_parallel.h"
+#include "dense_gaec_adj_matrix.h"
+#include "dense_gaec_incremental_nn.h"
+#include "dense_multicut_utils.h"
+#include "dense_features_parser.h"
+#include "feature_stream.h"
+#include "instance_generators.h"
+#include "metrics.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <filesystem>
+#include <unordered_set>
+#include <algorithm>
+#include <tuple>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <omp.h>
+#include <CLI/CLI.hpp>
+
+using namespace DENSE_MULTICUT;
+
+struct bench_result {
+    double wall_time = 0.0;
+    // 0 if the solver does not record its first contraction.
+    double first_contraction_time = 0.0;
+    double objective = 0.0;
+    uint64_t nr_faiss_searches = 0;
+    uint64_t nr_clusters = 0;
+};
+
+std::vector<size_t> run_solver(const std::string& solver, const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset, const size_t k_inc_nn, const feature_index_options& index_options, solve_status& status)
+{
+    if (solver == "adj_matrix")
+        return dense_gaec_adj_matrix(n, d, features, track_dist_offset);
+    else if (solver == "flat_index")
+        return dense_gaec_flat_index(n, d, features, track_dist_offset, nullptr, index_options, {}, &status);
+    else if (solver == "hnsw")
+        return dense_gaec_hnsw(n, d, features, track_dist_offset, nullptr, index_options, {}, &status);
+    else if (solver == "parallel_flat_index")
+        return dense_gaec_parallel_flat_index(n, d, features, track_dist_offset, nullptr, false, 1, index_options, {}, &status);
+    else if (solver == "parallel_hnsw")
+        return dense_gaec_parallel_hnsw(n, d, features, track_dist_offset, nullptr, false, 1, index_options, {}, &status);
+    else if (solver == "inc_nn_flat")
+        return dense_gaec_incremental_nn(n, d, features, k_inc_nn, "Flat", track_dist_offset, nullptr, {}, index_options, {}, &status);
+    else if (solver == "inc_nn_hnsw")
+        return dense_gaec_incremental_nn(n, d, features, k_inc_nn, "HNSW64", track_dist_offset, nullptr, {}, index_options, {}, &status);
+    throw std::runtime_error("Unknown solver type: " + solver);
+}
+
+bool pipelined_solver(const std::string& solver)
+{
+    return solver == "pipelined_flat_index" || solver == "pipelined_hnsw";
+}
+
+void write_instance_file(const std::string& path, const synthetic_instance& instance)
+{
+    std::ofstream f(path);
+    if(!f.is_open())
+        throw std::runtime_error("Could not open benchmark instance file " + path);
+    f << instance.n << " " << instance.d << "\n" << std::setprecision(9);
+    for(size_t i=0; i<instance.n; ++i)
+        for(size_t l=0; l<instance.d; ++l)
+            f << instance.features[i*instance.d + l] << (l+1 < instance.d ? " " : "\n");
+    if(!f)
+        throw std::runtime_error("Could not write benchmark instance file " + path);
+}
+
+// One solve, timed from the start of parsing if instance_path is not empty and from the start of the solve otherwise.
+bench_result run_once(const std::string& solver, const synthetic_instance& instance, const std::string& instance_path, const float dist_offset, const size_t k_inc_nn,
+        const feature_index_options& index_options)
+{
+    // counters of earlier runs in the same process are not part of this one.
+    metrics_registry::instance().reset();
+    bench_result result;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<size_t> labeling;
+    solve_status status;
+    double input_seconds = 0.0;
+    if(pipelined_solver(solver))
+    {
+        const feature_stream stream(instance_path, dist_offset);
+        input_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        labeling = dense_gaec_pipelined(stream, solver == "pipelined_hnsw" ? "HNSW" : "Flat", nullptr, index_options, {}, &status);
+    }
+    else
+    {
+        size_t d = instance.d;
+        std::vector<float> features;
+        if(instance_path != "")
+            std::tie(features, std::ignore, d) = read_file(instance_path);
+        else
+            features = instance.features;
+        if(dist_offset != 0.0)
+        {
+            features = append_dist_offset_in_features(features, dist_offset, instance.n, d);
+            d += 1;
+        }
+        // instances in memory are timed from the start of the solve.
+        if(instance_path == "")
+            begin = std::chrono::steady_clock::now();
+        input_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        labeling = run_solver(solver, instance.n, d, features, dist_offset != 0.0, k_inc_nn, index_options, status);
+    }
+    result.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    if(status.first_contraction_seconds > 0.0)
+        result.first_contraction_time = input_seconds + status.first_contraction_seconds;
+    result.objective = multicut_objective(instance.n, instance.d, instance.features, labeling, dist_offset);
+    result.nr_clusters = std::unordered_set<size_t>(labeling.begin(), labeling.end()).size();
+    for(const metric_snapshot& m : metrics_registry::instance().snapshot().metrics)
+        if(m.name == "faiss search")
+            result.nr_faiss_searches = m.count;
+    return result;
+}
+
+// Runs the solver in a child process, so that peak RSS is measured per configuration and solver output does not mix with the CSV.
+// The child solves nr_warmups times before the measured run, so that the warmups warm its allocator, faiss and OpenMP threads.
+// Peak RSS covers the warmups as well, which solve the same instance.
+bench_result run_isolated(const std::string& solver, const synthetic_instance& instance, const std::string& instance_path, const float dist_offset, const int nr_threads, const size_t k_inc_nn,
+        const feature_index_options& index_options, const size_t nr_warmups, long& peak_rss_kb)
+{
+    int result_pipe[2];
+    if(pipe(result_pipe) != 0)
+        throw std::runtime_error("Could not create pipe for benchmark run");
+    const pid_t pid = fork();
+    if(pid < 0)
+        throw std::runtime_error("Could not fork benchmark run");
+    if(pid == 0)
+    {
+        close(result_pipe[0]);
+        const int dev_null = open("/dev/null", O_WRONLY);
+        dup2(dev_null, STDOUT_FILENO);
+        omp_set_num_threads(nr_threads);
+        bench_result result;
+        try
+        {
+            for(size_t r=0; r<nr_warmups; ++r)
+                run_once(solver, instance, instance_path, dist_offset, k_inc_nn, index_options);
+            result = run_once(solver, instance, instance_path, dist_offset, k_inc_nn, index_options);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "[dense multicut bench] " << solver << " failed: " << e.what() << "\n";
+            _exit(1);
+        }
+        if(write(result_pipe[1], &result, sizeof(result)) != sizeof(result))
+            _exit(1);
+        _exit(0);
+    }
+    close(result_pipe[1]);
+    bench_result result;
+    const bool received = read(result_pipe[0], &result, sizeof(result)) == sizeof(result);
+    close(result_pipe[0]);
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    if(!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        throw std::runtime_error("Benchmark run of " + solver + " failed");
+    peak_rss_kb = usage.ru_maxrss;
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Benchmark dense multicut solvers on synthetic clustered instances");
+
+    std::vector<std::string> generators = {"gaussian", "power_law"};
+    std::vector<std::string> solvers = {"flat_index", "parallel_flat_index", "inc_nn_flat"};
+    std::vector<size_t> nr_nodes = {1000, 10000};
+    std::vector<size_t> nr_dims = {32, 128};
+    std::vector<float> offsets = {0.5};
+    std::vector<int> nr_threads = {1};
+    std::vector<std::string> precisions = {"fp32"};
+    std::vector<size_t> shards = {1};
+    std::vector<int> adaptive_ef = {0};
+    size_t nr_clusters = 20;
+    float exponent = 1.5;
+    float noise = 0.5;
+    size_t warmups = 1;
+    size_t repetitions = 3;
+    size_t k_inc_nn = 10;
+    bool parse_input = false;
+    std::string out_path = "";
+    app.add_option("--generators", generators, "Instance generators: gaussian, power_law.");
+    app.add_option("--solvers", solvers, "Solver types as in dense_multicut_text_input, and pipelined_flat_index and pipelined_hnsw for flat_index and hnsw with --pipelined_input.");
+    app.add_option("-n,--nr_nodes", nr_nodes, "Numbers of points.");
+    app.add_option("-d,--dims", nr_dims, "Feature dimensions.");
+    app.add_option("-t,--thresh", offsets, "Distance offsets.")->check(CLI::NonNegativeNumber);
+    app.add_option("--threads", nr_threads, "OpenMP thread counts.")->check(CLI::PositiveNumber);
+    app.add_option("--precisions", precisions, "Feature precisions: fp32, fp16, bf16, int8. Objectives are always evaluated on the fp32 features.");
+    app.add_option("--shards", shards, "Numbers of faiss indices the feature index is spread over, compare e.g. 1 4 8 for the effect of sharding.")->check(CLI::PositiveNumber);
+    app.add_option("--adaptive_ef", adaptive_ef, "Adaptive efSearch settings for HNSW solvers, compare 0 1 for the effect of the controller. Other solvers only run with 0.");
+    app.add_option("--clusters", nr_clusters, "Number of planted clusters.")->check(CLI::PositiveNumber);
+    app.add_option("--exponent", exponent, "Exponent of the power law cluster size distribution.");
+    app.add_option("--noise", noise, "Expected length of the noise added to unit cluster centers.")->check(CLI::NonNegativeNumber);
+    app.add_option("--warmups", warmups, "Untimed runs before each measured run, in the same process.");
+    app.add_option("--repetitions", repetitions, "Measured runs per configuration.")->check(CLI::PositiveNumber);
+    app.add_option("-k,--knn", k_inc_nn, "Number of nearest neighbours for inc_nn solvers.")->check(CLI::PositiveNumber);
+    app.add_flag("--parse_input", parse_input, "Write each instance to a text file and include parsing it in the measured times, as pipelined solvers always do. "
+        "Compare e.g. flat_index with pipelined_flat_index for the time to the first contraction.");
+    app.add_option("-o,--output_file", out_path, "CSV output path, standard output if empty.");
+    app.parse(argc, argv);
+
+    std::ofstream out_file;
+    if(out_path != "")
+    {
+        out_file.open(out_path);
+        if(!out_file.is_open())
+            throw std::runtime_error("Could not open benchmark output file " + out_path);
+    }
+    std::ostream& out = out_path != "" ? out_file : std::cout;
+    out << "generator,n,d,thresh,threads,solver,precision,shards,adaptive_ef,repetition,wall_time_s,first_contraction_s,peak_rss_kb,faiss_searches,objective,nr_clusters\n";
+
+    for(const std::string& generator : generators)
+        for(const size_t n : nr_nodes)
+            for(const size_t d : nr_dims)
+            {
+                synthetic_instance instance;
+                if(generator == "gaussian")
+                    instance = gaussian_mixture_instance(n, d, nr_clusters, noise);
+                else if(generator == "power_law")
+                    instance = power_law_instance(n, d, std::min(nr_clusters, n), exponent, noise);
+                else
+                    throw std::runtime_error("Unknown instance generator: " + generator);
+                std::string instance_path = "";
+                if(parse_input || std::any_of(solvers.begin(), solvers.end(), pipelined_solver))
+                {
+                    instance_path = (std::filesystem::temp_directory_path() / ("dense_multicut_bench_" + std::to_string(getpid()) + ".txt")).string();
+                    write_instance_file(instance_path, instance);
+                }
+
+                for(const float t : offsets)
+                    for(const int threads : nr_threads)
+                        for(const std::string& solver : solvers)
+                            for(const std::string& precision : precisions)
+                            for(const size_t nr_shards : shards)
+                            for(const int adaptive : adaptive_ef)
+                            {
+                                if(adaptive && solver.find("hnsw") == std::string::npos)
+                                    continue;
+                                if(pipelined_solver(solver) && precision != "fp32")
+                                    continue;
+                                feature_index_options index_options;
+                                index_options.precision = feature_precision_from_string(precision);
+                                index_options.nr_shards = nr_shards;
+                                index_options.adaptive_ef_search = adaptive;
+                                std::cerr << "[dense multicut bench] " << generator << " n=" << n << " d=" << d << " thresh=" << t << " threads=" << threads << " " << solver << " " << precision
+                                    << " shards=" << nr_shards << " adaptive_ef=" << adaptive << "\n";
+                                for(size_t r=0; r<repetitions; ++r)
+                                {
+                                    long peak_rss_kb = 0;
+                                    const bench_result result = run_isolated(solver, instance, parse_input || pipelined_solver(solver) ? instance_path : "", t, threads, k_inc_nn, index_options, warmups, peak_rss_kb);
+                                    out << generator << "," << n << "," << d << "," << t << "," << threads << "," << solver << "," << precision << "," << nr_shards << "," << adaptive << "," << r << ","
+                                        << result.wall_time << ",";
+                                    // empty if the solver does not record its first contraction.
+                                    if(result.first_contraction_time > 0.0)
+                                        out << result.first_contraction_time;
+                                    out << "," << peak_rss_kb << ",";
+                                    // searches are counted by metrics, which are compiled out without DENSE_MULTICUT_METRICS.
+#ifdef DENSE_MULTICUT_METRICS
+                                    out << result.nr_faiss_searches;
+#endif
+                                    out << "," << result.objective << "," << result.nr_clusters << std::endl;
+                                }
+                            }
+                if(instance_path != "")
+                    std::filesystem::remove(instance_path);
+            }
+}
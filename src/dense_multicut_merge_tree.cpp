@@ -0,0 +1,49 @@
+#include "merge_tree.h"
+#include "labeling_io.h"
+#include <iostream>
+#include <algorithm>
+#include <CLI/CLI.hpp>
+
+using namespace DENSE_MULTICUT;
+
+int main(int argc, char** argv)
+{
+    CLI::App app("Cut dense multicut merge trees into labelings");
+
+    std::string tree_path;
+    std::string out_prefix = "";
+    std::vector<float> offsets;
+    std::vector<size_t> nr_clusters;
+    app.add_option("-i,--input,input_pos", tree_path, "Path to binary merge tree written by dense_multicut_text_input --merge_tree")->required()->check(CLI::ExistingPath);
+    app.add_option("-t,--thresh", offsets, "Offsets >= the solve offset for which to compute labelings.")->check(CLI::NonNegativeNumber);
+    app.add_option("-c,--nr_clusters", nr_clusters, "Numbers of clusters for which to compute labelings.");
+    app.add_option("-o,--output_prefix", out_prefix, "Labelings are written to <output_prefix>.thresh_<offset> and <output_prefix>.clusters_<nr>.");
+    std::string output_format_str = "text";
+    app.add_option("--output_format", output_format_str, "Labeling output format: text with one label per line, or binary with contiguous cluster ids.");
+
+    app.parse(argc, argv);
+    const labeling_format output_format = labeling_format_from_string(output_format_str);
+    const auto write_solution = [&](const std::string& path, const std::vector<size_t>& labeling) {
+        std::cout << "Writing solution to file: " << path << "\n";
+        write_labeling(path, labeling, output_format);
+    };
+
+    const merge_tree tree = merge_tree::read(tree_path);
+    std::cout << "[merge tree] " << tree.nr_nodes() << " nodes, " << tree.nr_contractions() << " contractions, solved with offset " << tree.dist_offset() << "\n";
+
+    for (const threshold_sweep_result& r : threshold_sweep(tree, offsets))
+    {
+        std::cout << "[merge tree] offset " << r.dist_offset << ": " << tree.nr_nodes() - r.nr_contractions << " clusters, "
+            << (r.exact ? "exact" : "approximate from contraction " + std::to_string(r.first_uncertain_contraction) + " on") << "\n";
+        if (out_prefix != "")
+            write_solution(out_prefix + ".thresh_" + std::to_string(r.dist_offset), r.labeling);
+    }
+
+    for (const size_t k : nr_clusters)
+    {
+        const std::vector<size_t> labeling = tree.labeling_with_nr_clusters(k);
+        std::cout << "[merge tree] cut into " << k << " clusters\n";
+        if (out_prefix != "")
+            write_solution(out_prefix + ".clusters_" + std::to_string(k), labeling);
+    }
+}
@@ -1,11 +1,29 @@
 #include "dense_gaec.h"
 #include "dense_gaec_parallel.h"
 #include "dense_gaec_adj_matrix.h"
+#include "dense_gaec_graph.h"
 #include "dense_gaec_incremental_nn.h"
 #include "dense_features_parser.h"
 #include "dense_multicut_utils.h"
+#include "merge_tree.h"
+#include "dense_gaec_streaming.h"
+#include "duplicate_aggregation.h"
+#include "batch_solver.h"
+#include "local_search.h"
+#include "feature_stream.h"
+#include "labeling_io.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "log.h"
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <functional>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <chrono>
+#include <iomanip>
 #include <CLI/CLI.hpp>
 
 using namespace DENSE_MULTICUT;
@@ -21,51 +39,296 @@ int main(int argc, char** argv)
     float dist_offset = 0.0;
     app.add_option("-f,--file,file_pos", file_path, "Path to dense multicut instance (.txt)")->required()->check(CLI::ExistingPath);
     app.add_option("-s,--solver,solver_pos", solver_type, "One of the following solver types: \n"
-        "adj_matrix\n, flat_index\n, hnsw\n, parallel_flat_index\n, parallel_hnsw\n, inc_nn_flat\n, inc_nn_hnsw\n")->required();
+        "adj_matrix\n, flat_index\n, hnsw\n, parallel_flat_index\n, parallel_hnsw\n, inc_nn_flat\n, inc_nn_hnsw\n, graph\n");
     app.add_option("-k,--knn,knn_pos", k_inc_nn, "Number of nearest neighbours to build kNN graph. Only used if solver type is inc_nn")->check(CLI::PositiveNumber);
     app.add_option("-t,--thresh,thresh_pos", dist_offset, "Offset to subtract from edge costs, larger value will create more clusters and viceversa.")->check(CLI::NonNegativeNumber);
     app.add_option("-o,--output_file,output_pos", out_path, "Output file path.");
+    std::string output_format_str = "text";
+    bool output_cluster_sizes = false;
+    app.add_option("--output_format", output_format_str, "Labeling output format: text with one label per line, or binary with contiguous cluster ids.");
+    app.add_flag("--cluster_sizes", output_cluster_sizes, "Append the size of every cluster to binary labelings.");
+    std::string metrics_path = "";
+    double metrics_interval = 0.0;
+    std::string log_level_str = "info";
+    app.add_option("--log_level", log_level_str, "Diagnostics up to this level are printed: off, error, warning, info, debug or trace.");
+    app.add_option("--metrics", metrics_path, "Write solver metrics to this file on exit, as CSV if it ends in .csv and JSON otherwise.");
+    app.add_option("--metrics_interval", metrics_interval, "Also write metrics every this many seconds while solving.")->check(CLI::NonNegativeNumber);
+    bool perf_counters_flag = false;
+    app.add_flag("--perf_counters", perf_counters_flag, "Count cycles, instructions, LLC misses and branch misses per solver phase with perf_event_open and report IPC and miss rates on exit. "
+        "Requires a build with DENSE_MULTICUT_PERF_COUNTERS, counts cover the thread entering a phase, so use OMP_NUM_THREADS=1 to include faiss's internal threads.");
+    bool greedy_matching = false;
+    app.add_flag("--greedy_matching", greedy_matching, "Use the serial greedy matching in parallel solvers instead of the multi-threaded one.");
+    size_t k_parallel = 1;
+    app.add_option("--parallel_k", k_parallel, "Number of nearest neighbours per node passed to the matching in each round of parallel solvers. Larger values need fewer rounds but can give a worse objective on weakly clustered data.")->check(CLI::PositiveNumber);
+    std::string merge_tree_path = "";
+    std::vector<float> sweep_offsets;
+    app.add_option("--merge_tree", merge_tree_path, "Write the sequence of contractions as binary merge tree to this path.");
+    app.add_option("--sweep_thresh", sweep_offsets, "Additional offsets >= thresh answered from the merge tree of a single solve. "
+        "Labelings are written to <output_file>.thresh_<offset>.")->check(CLI::NonNegativeNumber);
+
+    checkpoint_options checkpoint;
+    app.add_option("--checkpoint_dir", checkpoint.directory, "Directory for periodic checkpoints of the solver state. Only used if solver type is inc_nn");
+    app.add_option("--checkpoint_interval", checkpoint.interval_seconds, "Seconds between checkpoints.")->check(CLI::NonNegativeNumber);
+    app.add_option("--checkpoint_contractions", checkpoint.interval_contractions, "Contractions between checkpoints.");
+    app.add_flag("--resume", checkpoint.resume, "Resume from the checkpoint in --checkpoint_dir.");
+
+    std::string stream_state_path = "";
+    app.add_option("--stream_state", stream_state_path, "Incremental mode: insert the instance as new points into the clustering stored in this file (created if missing) "
+        "and write the updated clustering back. Solver type must be flat_index or hnsw.");
+
+    bool aggregate_duplicates_flag = false;
+    float duplicate_epsilon = 0.0;
+    app.add_flag("--dedup", aggregate_duplicates_flag, "Collapse duplicate feature rows into weighted nodes before solving.");
+    app.add_option("--dedup_eps", duplicate_epsilon, "Also collapse rows within this max-norm distance, implies --dedup.")->check(CLI::NonNegativeNumber);
+
+    std::string precision = "fp32";
+    app.add_option("--precision", precision, "Precision of stored input features and index codes for index based solvers: fp32, fp16, bf16 or int8. "
+        "Candidates are rescored exactly and merged clusters are kept in fp32.");
+    feature_index_options index_options;
+    app.add_option("--index", index_options.index_string, "faiss index factory string replacing the default index of the solver, e.g. IVF4096,PQ32 or OPQ32,IVF4096,PQ32.");
+    app.add_option("--nprobe", index_options.nprobe, "Inverted lists visited per query for IVF indices.")->check(CLI::PositiveNumber);
+    app.add_option("--rerank_depth", index_options.rerank_depth, "Candidates fetched per query and re-ranked with exact inner products. "
+        "Compressed indices are always re-ranked.");
+    app.add_option("--train_sample", index_options.train_sample_size, "Train the index on this many random points instead of all of them.");
+    app.add_option("--shards", index_options.nr_shards, "Spread the feature index over this many faiss indices. Small batches are searched on the shards in parallel.")->check(CLI::PositiveNumber);
+    app.add_option("--hnsw_m", index_options.hnsw_m, "Graph degree M of HNSW indices.")->check(CLI::PositiveNumber);
+    app.add_option("--ef_construction", index_options.ef_construction, "efConstruction of HNSW indices.")->check(CLI::PositiveNumber);
+    app.add_option("--ef_search", index_options.ef_search, "efSearch of HNSW indices, the starting value with --adaptive_ef.")->check(CLI::PositiveNumber);
+    app.add_flag("--adaptive_ef", index_options.adaptive_ef_search, "Adapt efSearch of HNSW indices to the fraction of contracted nodes in search results.");
+    app.add_option("--storage_dir", index_options.storage_dir, "Out-of-core mode for index based solvers: keep feature rows and cluster sums in a memory-mapped file in this directory "
+        "and inverted lists of IVF indices on disk, e.g. with --index IVF4096,Flat.");
+    app.add_option("--memory_budget_mb", index_options.memory_budget_mb, "Resident MiB of file-backed feature rows in out-of-core mode before they are written back and dropped from memory.");
+
+    solve_budget budget;
+    app.add_option("--time_limit", budget.max_seconds, "Stop contracting after this many seconds and output the labeling reached so far.")->check(CLI::NonNegativeNumber);
+    app.add_option("--max_contractions", budget.max_contractions, "Stop after this many contractions and output the labeling reached so far.");
+
+    std::string graph_path = "";
+    app.add_option("--graph", graph_path, "Edge list with one pair of node indices per line. Only used and required if solver type is graph, "
+        "which only contracts along these edges.")->check(CLI::ExistingFile);
+
+    local_search_options refine;
+    refine.max_sweeps = 0;
+    app.add_option("--refine_sweeps", refine.max_sweeps, "Improve the solver's labeling by at most this many sweeps of single node moves between clusters. "
+        "The merge tree still holds the contractions of the solver.");
+    app.add_option("--refine_candidates", refine.nr_candidates, "Target clusters considered per node and sweep of --refine_sweeps.")->check(CLI::PositiveNumber);
+    app.add_option("--refine_index", refine.index_str, "faiss index factory string of the index over cluster sums searched for candidates in each sweep of --refine_sweeps, e.g. HNSW32 for many clusters.");
+
+    bool pipelined_input = false;
+    app.add_flag("--pipelined_input", pipelined_input, "Build the index while the input is parsed: the index trains on the first parsed rows and adds rows chunk by chunk. "
+        "Solver type must be flat_index or hnsw with fp32 precision, not with duplicate aggregation.");
+
+    bool batch = false;
+    size_t batch_threads = 0;
+    app.add_flag("--batch", batch, "Batch mode: file is a manifest listing one instance per line, optionally followed by its output path, or a directory of .txt instances. "
+        "Instances are solved concurrently with single-threaded faiss, output_file is the directory for labelings. Solver type must be flat_index or hnsw.");
+    app.add_option("--batch_threads", batch_threads, "Instances solved at once in batch mode, all threads by default.")->check(CLI::PositiveNumber);
+
+    CLI::App* evaluate = app.add_subcommand("evaluate", "Print the multicut objective of an existing labeling of the instance for offset thresh instead of solving.");
+    evaluate->fallthrough();
+    std::string labeling_path = "";
+    evaluate->add_option("-l,--labeling", labeling_path, "Labeling with one label per line or in binary labeling format, e.g. an output file of the solver.")->required()->check(CLI::ExistingFile);
 
     app.parse(argc, argv);
+    set_log_level(log_level_from_string(log_level_str));
+    index_options.precision = feature_precision_from_string(precision);
+    const labeling_format output_format = labeling_format_from_string(output_format_str);
+    if (output_cluster_sizes && output_format != labeling_format::binary)
+        throw std::runtime_error("--cluster_sizes requires --output_format binary");
+    const auto write_solution = [&](const std::string& path, const std::vector<size_t>& labeling) {
+        LOG_INFO << "Writing solution to file: " << path << "\n";
+        write_labeling(path, labeling, output_format, output_cluster_sizes);
+    };
+    std::unique_ptr<metrics_reporter> reporter;
+    if (metrics_path != "")
+        reporter = std::make_unique<metrics_reporter>(metrics_path, metrics_interval);
+    // destroyed before the metrics reporter, so that the final metrics include the counter gauges.
+    std::unique_ptr<perf_counters_reporter> perf_reporter;
+    if (perf_counters_flag)
+        perf_reporter = std::make_unique<perf_counters_reporter>();
+    if (index_options.memory_budget_mb > 0 && index_options.storage_dir == "")
+        throw std::runtime_error("--memory_budget_mb requires --storage_dir");
+    if (checkpoint.resume && checkpoint.directory == "")
+        throw std::runtime_error("--resume requires --checkpoint_dir");
+    if (checkpoint.directory != "" && solver_type != "inc_nn_flat" && solver_type != "inc_nn_hnsw")
+        throw std::runtime_error("Checkpointing is only supported for inc_nn solvers");
+    if (checkpoint.directory != "" && index_options.storage_dir != "")
+    {
+        // IVF indices keep their inverted lists in files in out-of-core mode, which checkpoints do not capture.
+        std::stringstream tokens(index_options.index_string);
+        for (std::string token; std::getline(tokens, token, ',');)
+            if (token.rfind("IVF", 0) == 0)
+                throw std::runtime_error("Checkpoints are not supported for IVF indices with --storage_dir, their inverted lists are kept on disk");
+    }
+    if (batch)
+    {
+        if (solver_type != "flat_index" && solver_type != "hnsw")
+            throw std::runtime_error("Batch mode supports solver types flat_index and hnsw only");
+        if (merge_tree_path != "" || sweep_offsets.size() > 0 || stream_state_path != "" || checkpoint.directory != "" || aggregate_duplicates_flag || duplicate_epsilon > 0.0)
+            throw std::runtime_error("Merge trees, threshold sweeps, incremental mode, checkpoints and duplicate aggregation are not supported in batch mode");
+        if (out_path != "")
+            std::filesystem::create_directories(out_path);
+        batch_options options;
+        options.solver.index_str = solver_type == "hnsw" ? "HNSW" : "Flat";
+        options.solver.dist_offset = dist_offset;
+        options.solver.index_options = index_options;
+        options.solver.budget = budget;
+        options.nr_threads = batch_threads;
+        options.output_format = output_format;
+        options.with_cluster_sizes = output_cluster_sizes;
+        const batch_summary summary = solve_batch(read_batch_instances(file_path, out_path), options);
+        return summary.nr_failed > 0 ? 1 : 0;
+    }
+    if (pipelined_input)
+    {
+        if (solver_type != "flat_index" && solver_type != "hnsw")
+            throw std::runtime_error("Pipelined input supports solver types flat_index and hnsw only");
+        if (aggregate_duplicates_flag || duplicate_epsilon > 0.0 || stream_state_path != "" || evaluate->parsed())
+            throw std::runtime_error("Pipelined input is not supported with duplicate aggregation, incremental mode or evaluate");
+        if (index_options.precision != feature_precision::fp32)
+            throw std::runtime_error("Pipelined input needs --precision fp32, reduced precision rows are encoded once all rows are parsed");
+    }
     size_t num_nodes, dim;
     std::vector<float> features;
     bool track_dist_offset = false;
 
-    std::tie(features, num_nodes, dim) = read_file(file_path);
-    if (dist_offset != 0.0)
+    // the stream parses in the background and already holds the offset dimension.
+    std::unique_ptr<feature_stream> input_stream;
+    if (pipelined_input)
+    {
+        input_stream = std::make_unique<feature_stream>(file_path, dist_offset);
+        num_nodes = input_stream->nr_rows();
+        dim = input_stream->dim();
+        track_dist_offset = input_stream->track_dist_offset();
+    }
+    else
+        std::tie(features, num_nodes, dim) = read_file(file_path);
+
+    if (evaluate->parsed())
     {
-        std::cout << "[dense multicut] use distance offset\n";
-        features = append_dist_offset_in_features(features, dist_offset, num_nodes, dim);
+        const std::vector<size_t> labeling = read_labeling_file(labeling_path);
+        const auto begin = std::chrono::steady_clock::now();
+        const double objective = multicut_objective(num_nodes, dim, features, labeling, dist_offset);
+        LOG_INFO << "[dense multicut] evaluated labeling in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << " s\n";
+        std::cout << std::setprecision(12) << objective << "\n";
+        return 0;
+    }
+    if (solver_type == "")
+        throw std::runtime_error("--solver is required");
+
+    if (stream_state_path != "")
+    {
+        if (solver_type != "flat_index" && solver_type != "hnsw")
+            throw std::runtime_error("Incremental mode supports solver types flat_index and hnsw only");
+        const std::string index_str = solver_type == "hnsw" ? "HNSW" : "Flat";
+        dense_gaec_streaming stream = std::filesystem::exists(stream_state_path) ?
+            dense_gaec_streaming::load(stream_state_path, index_str) : dense_gaec_streaming(dim, dist_offset, index_str);
+        if (output_format != labeling_format::text)
+            throw std::runtime_error("Incremental mode writes cluster ids of the stored clustering and supports text output only");
+        if (stream.dim() != dim || stream.dist_offset() != dist_offset)
+            throw std::runtime_error("Instance dimension or offset does not match clustering in " + stream_state_path);
+
+        const streaming_update update = stream.insert(num_nodes, features);
+        stream.save(stream_state_path);
+        if (out_path != "")
+        {
+            write_solution(out_path, update.new_node_labels);
+            std::ofstream merged_file(out_path + ".merged_clusters");
+            for (const auto [absorbed, surviving] : update.merged_clusters)
+                merged_file << absorbed << " " << surviving << "\n";
+        }
+        return 0;
+    }
+    if ((solver_type == "graph") != (graph_path != ""))
+        throw std::runtime_error("Solver type graph requires --graph and --graph requires solver type graph");
+    aggregated_instance aggregated;
+    const bool aggregate = aggregate_duplicates_flag || duplicate_epsilon > 0.0;
+    if (aggregate)
+    {
+        if (merge_tree_path != "" || sweep_offsets.size() > 0)
+            throw std::runtime_error("Merge trees are not supported together with duplicate aggregation");
+        if (solver_type == "graph")
+            throw std::runtime_error("Duplicate aggregation is not supported for solver type graph");
+        aggregated = aggregate_duplicates(num_nodes, dim, features, duplicate_epsilon, dist_offset);
+        features = std::move(aggregated.features);
+        num_nodes = aggregated.n;
+    }
+
+    if (dist_offset != 0.0 && !pipelined_input)
+    {
+        LOG_INFO << "[dense multicut] use distance offset\n";
+        features = append_dist_offset_in_features(features, dist_offset, num_nodes, dim, aggregate ? aggregated.weights : std::vector<size_t>(num_nodes, 1));
         dim += 1;
         track_dist_offset = true;
     }
+    merge_tree tree;
+    merge_tree* tree_ptr = merge_tree_path != "" || sweep_offsets.size() > 0 ? &tree : nullptr;
+    // in out-of-core mode the solvers free their input once the index holds it, so it is handed over instead of copied unless refinement needs it.
+    const bool hand_over_features = index_options.storage_dir != "" && refine.max_sweeps == 0;
+    auto solver_features = [&]() -> std::vector<float> {
+        if (hand_over_features)
+            return std::move(features);
+        return features;
+    };
     std::vector<size_t> labeling;
-    if (solver_type ==  "adj_matrix")
-        labeling = dense_gaec_adj_matrix(num_nodes, dim, features, track_dist_offset);
+    solve_status status;
+    if (solver_type == "adj_matrix" && (budget.max_seconds > 0.0 || budget.max_contractions > 0))
+        throw std::runtime_error("Solver type adj_matrix does not support a time or contraction limit");
+    if (pipelined_input)
+        labeling = dense_gaec_pipelined(*input_stream, solver_type == "hnsw" ? "HNSW" : "Flat", tree_ptr, index_options, budget, &status);
+    else if (solver_type ==  "adj_matrix")
+        labeling = dense_gaec_adj_matrix(num_nodes, dim, features, track_dist_offset, tree_ptr);
     else if (solver_type ==  "flat_index")
-        labeling = dense_gaec_flat_index(num_nodes, dim, features, track_dist_offset);
+        labeling = dense_gaec_flat_index(num_nodes, dim, solver_features(), track_dist_offset, tree_ptr, index_options, budget, &status);
     else if (solver_type ==  "hnsw")
-        labeling = dense_gaec_hnsw(num_nodes, dim, features, track_dist_offset);
+        labeling = dense_gaec_hnsw(num_nodes, dim, solver_features(), track_dist_offset, tree_ptr, index_options, budget, &status);
     else if (solver_type ==  "parallel_flat_index")
-        labeling = dense_gaec_parallel_flat_index(num_nodes, dim, features, track_dist_offset);
+        labeling = dense_gaec_parallel_flat_index(num_nodes, dim, solver_features(), track_dist_offset, tree_ptr, greedy_matching, k_parallel, index_options, budget, &status);
     else if (solver_type ==  "parallel_hnsw")
-        labeling = dense_gaec_parallel_hnsw(num_nodes, dim, features, track_dist_offset);
+        labeling = dense_gaec_parallel_hnsw(num_nodes, dim, solver_features(), track_dist_offset, tree_ptr, greedy_matching, k_parallel, index_options, budget, &status);
     else if (solver_type ==  "flat_index")
-        labeling = dense_gaec_flat_index(num_nodes, dim, features, track_dist_offset);
+        labeling = dense_gaec_flat_index(num_nodes, dim, solver_features(), track_dist_offset, tree_ptr, index_options, budget, &status);
+    else if (solver_type ==  "graph")
+    {
+        const auto [row_offsets, column_indices] = read_graph_file(graph_path, num_nodes);
+        labeling = dense_gaec_graph(num_nodes, dim, solver_features(), row_offsets, column_indices, track_dist_offset, tree_ptr, index_options, budget, &status);
+    }
     else if (solver_type ==  "inc_nn_flat")
-        labeling = dense_gaec_incremental_nn(num_nodes, dim, features, k_inc_nn, "Flat", track_dist_offset);
+        labeling = dense_gaec_incremental_nn(num_nodes, dim, solver_features(), k_inc_nn, "Flat", track_dist_offset, tree_ptr, checkpoint, index_options, budget, &status);
     else if (solver_type ==  "inc_nn_hnsw")
-        labeling = dense_gaec_incremental_nn(num_nodes, dim, features, k_inc_nn, "HNSW64", track_dist_offset);
+        labeling = dense_gaec_incremental_nn(num_nodes, dim, solver_features(), k_inc_nn, "HNSW64", track_dist_offset, tree_ptr, checkpoint, index_options, budget, &status);
     else
         throw std::runtime_error("Unknown solver type: " + solver_type);
-    
+
+    if (!status.is_final)
+        LOG_WARNING << "[dense multicut] budget exhausted, writing labeling after " << status.nr_contractions << " contractions with objective " << status.objective << "\n";
+
+    if (refine.max_sweeps > 0)
+        labeling = local_search(num_nodes, dim, input_stream ? input_stream->features() : features, track_dist_offset, labeling, refine).labels;
+
+    if (aggregate)
+        labeling = expand_labeling(aggregated, labeling);
     
     if (out_path != "")
+        write_solution(out_path, labeling);
+
+    if (merge_tree_path != "")
+    {
+        LOG_INFO <<"Writing merge tree with "<<tree.nr_contractions()<<" contractions to file: "<<merge_tree_path<<"\n";
+        tree.write(merge_tree_path);
+    }
+
+    if (sweep_offsets.size() > 0)
     {
-        std::ofstream sol_file;
-        sol_file.open(out_path);
-        std::cout<<"Writing solution to file: "<<out_path<<"\n";
-        std::copy(labeling.begin(), labeling.end(), std::ostream_iterator<int>(sol_file, "\n"));
-        sol_file.close();
+        for (const threshold_sweep_result& r : threshold_sweep(tree, sweep_offsets))
+        {
+            if (r.exact)
+                LOG_INFO << "[threshold sweep] offset " << r.dist_offset << ": " << num_nodes - r.nr_contractions << " clusters, exact\n";
+            else
+                LOG_INFO << "[threshold sweep] offset " << r.dist_offset << ": " << num_nodes - r.nr_contractions << " clusters, approximate since GAEC order may differ from contraction "
+                    << r.first_uncertain_contraction << " on\n";
+            if (out_path != "")
+                write_solution(out_path + ".thresh_" + std::to_string(r.dist_offset), r.labeling);
+        }
     }
 }
\ No newline at end of file
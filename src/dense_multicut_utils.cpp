@@ -1,50 +1,204 @@
 #include "dense_multicut_utils.h"
+#include "log.h"
 #include <iostream>
 #include <cmath>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <atomic>
+#include <omp.h>
 
 namespace DENSE_MULTICUT {
 
-    double cost_disconnected(const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset)
+    cost_disconnected_accumulator::cost_disconnected_accumulator(const size_t d, const bool track_dist_offset)
+        : d_(d),
+        track_dist_offset_(track_dist_offset),
+        feature_sum_(track_dist_offset ? d - 1 : d, 0.0)
+    {}
+
+    void cost_disconnected_accumulator::add(const size_t n, const float* rows)
     {
-        const size_t d_eff = track_dist_offset ? d - 1: d;
-        std::vector<double> feature_sum(d_eff);
+        const size_t d_eff = feature_sum_.size();
         for(size_t i=0; i<n; ++i)
+        {
+            const float* f = rows + i*d_;
             for(size_t l=0; l<d_eff; ++l)
-                feature_sum[l] += features[i*d+l];
+            {
+                feature_sum_[l] += f[l];
+                squared_norm_sum_ += double(f[l]) * f[l];
+            }
+            if(track_dist_offset_)
+            {
+                offset_sum_ += f[d_-1];
+                offset_sum_squares_ += double(f[d_-1]) * f[d_-1];
+            }
+        }
+    }
 
+    double cost_disconnected_accumulator::cost() const
+    {
         double cost = 0.0;
-
-        for(size_t l=0; l<d_eff; ++l)
-            cost += feature_sum[l] * feature_sum[l];
-
+        for(const double x : feature_sum_)
+            cost += x * x;
         // remove diagonal entries (self-edge)
-        for(size_t i=0; i<n; ++i)
-            for(size_t l=0; l<d_eff; ++l)
-                cost -= features[i*d+l]*features[i*d+l];
-
+        cost -= squared_norm_sum_;
         cost /= 2.0;
-        // account for offset term:
-        if (track_dist_offset)
-        {
-            const float dist_offset_sqrt = features[d - 1];
-            cost -= dist_offset_sqrt * dist_offset_sqrt * n * (n - 1) / 2.0;
-        }
-        std::cout << "disconnected multicut cost = " << cost << "\n";
+        // account for offset term: sum over pairs of sqrt(offset)*w_i * sqrt(offset)*w_j, i.e. offset * n(n-1)/2 for unit weights.
+        if (track_dist_offset_)
+            cost -= (offset_sum_ * offset_sum_ - offset_sum_squares_) / 2.0;
+        return cost;
+    }
+
+    double cost_disconnected(const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset)
+    {
+        cost_disconnected_accumulator accumulator(d, track_dist_offset);
+        accumulator.add(n, features.data());
+        const double cost = accumulator.cost();
+        LOG_DEBUG << "disconnected multicut cost = " << cost << "\n";
         return cost;
     }
 
     std::vector<float> append_dist_offset_in_features(const std::vector<float>& features, const float dist_offset, const size_t n, const size_t d)
+    {
+        return append_dist_offset_in_features(features, dist_offset, n, d, std::vector<size_t>(n, 1));
+    }
+
+    std::vector<float> append_dist_offset_in_features(const std::vector<float>& features, const float dist_offset, const size_t n, const size_t d, const std::vector<size_t>& node_weights)
     {
         std::vector<float> features_w_dist_offset(n * (d + 1));
         if (dist_offset < 0)
             throw std::runtime_error("dist_offset can only be >= 0.");
-        std::cout << "Accounting for dist_offset = " << dist_offset << " by adding additional feature dimension.\n";
+        assert(node_weights.size() == n);
+        LOG_DEBUG << "Accounting for dist_offset = " << dist_offset << " by adding additional feature dimension.\n";
         for(size_t i=0; i<n; ++i)
         {
             for(size_t l=0; l<d; ++l)
                 features_w_dist_offset[i * (d + 1) + l] = features[i * d + l];
-            features_w_dist_offset[i * (d + 1) + d] = std::sqrt(dist_offset);
+            // weighted nodes stand for node_weights[i] points, their offset to other nodes scales accordingly.
+            features_w_dist_offset[i * (d + 1) + d] = std::sqrt(dist_offset) * node_weights[i];
         }
         return features_w_dist_offset;
     }
+
+    size_t contiguous_labeling(const std::vector<size_t>& labeling, std::vector<size_t>& contiguous)
+    {
+        const size_t n = labeling.size();
+        constexpr size_t no_cluster = std::numeric_limits<size_t>::max();
+        contiguous.resize(n);
+        size_t max_label = 0;
+#pragma omp parallel for schedule(static) reduction(max:max_label)
+        for(size_t i=0; i<n; ++i)
+            max_label = std::max(max_label, labeling[i]);
+
+        if(max_label >= 4*n + 1024)
+        {
+            std::unordered_map<size_t, size_t> cluster_id;
+            for(size_t i=0; i<n; ++i)
+                contiguous[i] = cluster_id.try_emplace(labeling[i], cluster_id.size()).first->second;
+            return cluster_id.size();
+        }
+
+        // direct lookup if labels are small as for solver output. First occurrences are found with an atomic minimum,
+        // ids are then handed out by a prefix sum over the first occurrences in blocks of nodes.
+        std::vector<std::atomic<size_t>> first(max_label + 1);
+#pragma omp parallel for schedule(static)
+        for(size_t l=0; l<=max_label; ++l)
+            first[l].store(no_cluster, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static)
+        for(size_t i=0; i<n; ++i)
+        {
+            std::atomic<size_t>& f = first[labeling[i]];
+            size_t current = f.load(std::memory_order_relaxed);
+            while(i < current && !f.compare_exchange_weak(current, i, std::memory_order_relaxed));
+        }
+
+        const size_t nr_blocks = std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), n / 4096));
+        const size_t block_size = (n + nr_blocks - 1) / nr_blocks;
+        std::vector<size_t> block_offsets(nr_blocks + 1, 0);
+#pragma omp parallel for schedule(static, 1)
+        for(size_t b=0; b<nr_blocks; ++b)
+            for(size_t i=b*block_size; i<std::min(n, (b+1)*block_size); ++i)
+                if(first[labeling[i]].load(std::memory_order_relaxed) == i)
+                    ++block_offsets[b+1];
+        for(size_t b=0; b<nr_blocks; ++b)
+            block_offsets[b+1] += block_offsets[b];
+
+        std::vector<size_t> cluster_id(max_label + 1);
+#pragma omp parallel for schedule(static, 1)
+        for(size_t b=0; b<nr_blocks; ++b)
+        {
+            size_t id = block_offsets[b];
+            for(size_t i=b*block_size; i<std::min(n, (b+1)*block_size); ++i)
+                if(first[labeling[i]].load(std::memory_order_relaxed) == i)
+                    cluster_id[labeling[i]] = id++;
+        }
+#pragma omp parallel for schedule(static)
+        for(size_t i=0; i<n; ++i)
+            contiguous[i] = cluster_id[labeling[i]];
+        return block_offsets.back();
+    }
+
+    double multicut_objective(const size_t n, const size_t d, const std::vector<float>& features, const std::vector<size_t>& labeling, const float dist_offset)
+    {
+        if(labeling.size() != n)
+            throw std::runtime_error("labeling has " + std::to_string(labeling.size()) + " entries for " + std::to_string(n) + " nodes");
+        assert(features.size() == n*d);
+
+        std::vector<size_t> cluster;
+        const size_t nr_clusters = contiguous_labeling(labeling, cluster);
+
+        // nodes grouped by cluster, so that each cluster sum is formed by one thread.
+        std::vector<size_t> offsets(nr_clusters + 1, 0);
+        for(size_t i=0; i<n; ++i)
+            ++offsets[cluster[i] + 1];
+        for(size_t c=0; c<nr_clusters; ++c)
+            offsets[c + 1] += offsets[c];
+        std::vector<size_t> members(n);
+        {
+            std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+            for(size_t i=0; i<n; ++i)
+                members[fill[cluster[i]]++] = i;
+        }
+
+        // cut edges are all pairs minus pairs within clusters. Self products cancel, so objective = (|S|^2 - sum |S_c|^2)/2 - t * (n^2 - sum |C|^2)/2.
+        std::vector<double> total_sum(d, 0.0);
+        double cluster_sum_squares = 0.0;
+        double cluster_size_squares = 0.0;
+#pragma omp parallel
+        {
+            std::vector<double> sum(d);
+            std::vector<double> thread_total_sum(d, 0.0);
+#pragma omp for schedule(dynamic, 64) reduction(+:cluster_sum_squares, cluster_size_squares)
+            for(size_t c=0; c<nr_clusters; ++c)
+            {
+                std::fill(sum.begin(), sum.end(), 0.0);
+                for(size_t m=offsets[c]; m<offsets[c+1]; ++m)
+                {
+                    const float* f = features.data() + members[m]*d;
+                    for(size_t l=0; l<d; ++l)
+                        sum[l] += f[l];
+                }
+                double squared_norm = 0.0;
+                for(size_t l=0; l<d; ++l)
+                {
+                    squared_norm += sum[l] * sum[l];
+                    thread_total_sum[l] += sum[l];
+                }
+                cluster_sum_squares += squared_norm;
+                const double size = offsets[c+1] - offsets[c];
+                cluster_size_squares += size * size;
+            }
+#pragma omp critical
+            for(size_t l=0; l<d; ++l)
+                total_sum[l] += thread_total_sum[l];
+        }
+
+        double total_sum_squares = 0.0;
+        for(size_t l=0; l<d; ++l)
+            total_sum_squares += total_sum[l] * total_sum[l];
+        return 0.5 * (total_sum_squares - cluster_sum_squares) - 0.5 * double(dist_offset) * (double(n) * n - cluster_size_squares);
+    }
 }
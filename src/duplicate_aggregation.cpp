@@ -0,0 +1,118 @@
+#include "duplicate_aggregation.h"
+#include "time_measure_util.h"
+#include "log.h"
+#include <unordered_map>
+#include <functional>
+#include <iostream>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+
+namespace DENSE_MULTICUT {
+
+    aggregated_instance aggregate_duplicates(const size_t n, const size_t d, const std::vector<float>& features, const float epsilon, const float dist_offset)
+    {
+        MEASURE_FUNCTION_EXECUTION_TIME;
+        assert(features.size() == n*d);
+        aggregated_instance instance;
+        instance.group.resize(n);
+        std::vector<size_t> representative;
+
+        auto row_hash = [&](const size_t i) -> size_t {
+            size_t h = 0;
+            for(size_t l=0; l<d; ++l)
+            {
+                size_t x_hash;
+                if(epsilon <= 0.0)
+                {
+                    // -0.0 and 0.0 are equal features, hash them alike.
+                    const float x = features[i*d + l] == 0.0f ? 0.0f : features[i*d + l];
+                    uint32_t bits;
+                    std::memcpy(&bits, &x, sizeof(float));
+                    x_hash = std::hash<uint32_t>()(bits);
+                }
+                else
+                {
+                    // cells outside the range of int64_t, and NaN, share one hash. same_group still compares the rows themselves.
+                    const double cell = std::floor(double(features[i*d + l]) / epsilon);
+                    const bool in_range = cell >= -9.2e18 && cell <= 9.2e18;
+                    x_hash = std::hash<int64_t>()(in_range ? static_cast<int64_t>(cell) : std::numeric_limits<int64_t>::min());
+                }
+                h ^= x_hash + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+            }
+            return h;
+        };
+
+        auto same_group = [&](const size_t i, const size_t j) {
+            for(size_t l=0; l<d; ++l)
+                if(std::abs(features[i*d + l] - features[j*d + l]) > epsilon)
+                    return false;
+            // rows with non-positive edge cost repel each other and must stay separate nodes.
+            double inner_prod = 0.0;
+            for(size_t l=0; l<d; ++l)
+                inner_prod += double(features[i*d + l]) * features[j*d + l];
+            return inner_prod > dist_offset;
+        };
+
+        // buckets hold the groups whose representative has the given hash.
+        std::unordered_multimap<size_t, size_t> buckets;
+        buckets.reserve(n);
+        for(size_t i=0; i<n; ++i)
+        {
+            const size_t h = row_hash(i);
+            size_t g = representative.size();
+            const auto [begin, end] = buckets.equal_range(h);
+            for(auto it=begin; it!=end; ++it)
+            {
+                if(same_group(representative[it->second], i))
+                {
+                    g = it->second;
+                    break;
+                }
+            }
+            if(g == representative.size())
+            {
+                representative.push_back(i);
+                instance.weights.push_back(0);
+                instance.features.resize(instance.features.size() + d, 0.0);
+                buckets.insert({h, g});
+            }
+            instance.group[i] = g;
+            instance.weights[g]++;
+            for(size_t l=0; l<d; ++l)
+                instance.features[g*d + l] += features[i*d + l];
+        }
+        instance.n = representative.size();
+
+        // edges inside a group: (|sum|^2 - sum of squared norms)/2 minus the offset for each pair.
+        std::vector<double> squared_norms(instance.n, 0.0);
+        for(size_t i=0; i<n; ++i)
+            for(size_t l=0; l<d; ++l)
+                squared_norms[instance.group[i]] += double(features[i*d + l]) * features[i*d + l];
+        for(size_t g=0; g<instance.n; ++g)
+        {
+            if(instance.weights[g] == 1)
+                continue;
+            double sum_norm = 0.0;
+            for(size_t l=0; l<d; ++l)
+                sum_norm += double(instance.features[g*d + l]) * instance.features[g*d + l];
+            instance.intra_group_cost += (sum_norm - squared_norms[g]) / 2.0 - dist_offset * instance.weights[g] * (instance.weights[g] - 1) / 2.0;
+        }
+
+        LOG_INFO << "[duplicate aggregation] collapsed " << n << " nodes into " << instance.n << " weighted nodes"
+            << (epsilon > 0.0 ? " with epsilon " + std::to_string(epsilon) : "") << ", contracted intra-group cost = " << instance.intra_group_cost << "\n";
+        return instance;
+    }
+
+    std::vector<size_t> expand_labeling(const aggregated_instance& instance, const std::vector<size_t>& labeling)
+    {
+        assert(labeling.size() == instance.n);
+        std::vector<size_t> expanded(instance.group.size());
+        for(size_t i=0; i<instance.group.size(); ++i)
+            expanded[i] = labeling[instance.group[i]];
+        return expanded;
+    }
+
+}
@@ -1,51 +1,565 @@
 #include "feature_index.h"
 #include "time_measure_util.h"
+#include "perf_counters.h"
+#include "log.h"
 #include <faiss/index_factory.h>
 #include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/AutoTune.h>
+#include <faiss/clone_index.h>
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IVFlib.h>
+#include <faiss/invlists/OnDiskInvertedLists.h>
 #include <cassert>
 #include <numeric>
 #include <algorithm>
 #include <unordered_map>
-//#include <iostream>
+#include <random>
+#include <limits>
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <atomic>
+#include <unistd.h>
+#include <omp.h>
 
 namespace DENSE_MULTICUT {
 
-    feature_index::feature_index(const size_t _d, const size_t n, const std::vector<float>& _features, const std::string& index_str, const bool track_dist_offset)
+    namespace {
+        // Scalar quantizer codes matching the feature precision. Other index types keep their own encoding.
+        std::string reduced_precision_index_string(const std::string& index_str, const feature_precision precision)
+        {
+            if(precision == feature_precision::fp32)
+                return index_str;
+            const std::string sq = precision == feature_precision::fp16 ? "SQfp16" : precision == feature_precision::bf16 ? "SQbf16" : "SQ8";
+            if(index_str == "Flat")
+                return sq;
+            if(index_str.rfind("HNSW", 0) == 0 && index_str.find(',') == std::string::npos)
+                return index_str + "," + sq;
+            return index_str;
+        }
+
+        std::string selected_index_string(const std::string& index_str, const feature_index_options& options)
+        {
+            const std::string selected = options.index_string != "" ? options.index_string : index_str;
+            if(options.hnsw_m == 0)
+                return selected;
+            if(selected.rfind("HNSW", 0) != 0)
+                throw std::runtime_error("HNSW degree given for index " + selected);
+            // replace the degree following the HNSW prefix.
+            const size_t degree_end = selected.find_first_not_of("0123456789", 4);
+            return "HNSW" + std::to_string(options.hnsw_m) + (degree_end == std::string::npos ? "" : selected.substr(degree_end));
+        }
+
+        // Codes of these indices only approximate the inner product. Factory tokens are separated by commas, HNSW tokens may carry
+        // their storage after an underscore as in HNSW32_SQ8. Transforms such as OPQ16_64 leave the codes to the following token.
+        bool compressed_index(const std::string& index_str)
+        {
+            std::stringstream tokens(index_str);
+            for(std::string token; std::getline(tokens, token, ',');)
+            {
+                std::stringstream parts(token);
+                for(std::string part; std::getline(parts, part, '_');)
+                    for(const std::string codec : {"PQ", "SQ", "LSH", "RQ", "LSQ", "PRQ", "PLSQ"})
+                        if(part.rfind(codec, 0) == 0)
+                            return true;
+            }
+            return false;
+        }
+
+        // Decoding buffers for reduced precision rows, slot 0 and 1 of d floats each per thread.
+        float* decode_buffer(const size_t d, const size_t slot)
+        {
+            thread_local std::vector<float> buffer;
+            if(buffer.size() < 2*d)
+                buffer.resize(2*d);
+            return buffer.data() + slot*d;
+        }
+
+        // File names unique among the feature indices of all processes sharing the storage directory.
+        std::string storage_file(const std::string& storage_dir, const std::string& name)
+        {
+            if(storage_dir == "")
+                return "";
+            static std::atomic<size_t> counter{0};
+            std::filesystem::create_directories(storage_dir);
+            return (std::filesystem::path(storage_dir) / ("dense_multicut." + std::to_string(getpid()) + "." + std::to_string(counter++) + "." + name)).string();
+        }
+
+        // faiss parallelizes search and add over the vectors of a call, and nested parallelism is not enabled, so inside a parallel loop over shards
+        // every faiss call runs on one thread. Shards are only processed in parallel when a batch is too small to occupy all threads by itself,
+        // e.g. single queries or merged nodes going to HNSW shards, whose inserts are otherwise serialized.
+        bool fan_out_to_shards(const size_t batch_size)
+        {
+            return batch_size < size_t(omp_get_max_threads());
+        }
+
+        size_t bytes_per_component(const feature_precision precision)
+        {
+            switch(precision)
+            {
+                case feature_precision::fp16:
+                case feature_precision::bf16:
+                    return 2;
+                case feature_precision::int8:
+                    return 1;
+                default:
+                    return 4;
+            }
+        }
+    }
+
+    feature_index::feature_index(const size_t _d, const size_t n, const std::vector<float>& _features, const std::string& index_str, const bool track_dist_offset, const feature_index_options& options)
         : d(_d),
-        features(_features),
-        index(index_factory(d, index_str.c_str(), faiss::MetricType::METRIC_INNER_PRODUCT)),
+        features(_d, n, _features.data(), options.precision, storage_file(options.storage_dir, "features"), options.memory_budget_mb << 20),
         nr_active(n),
-        track_dist_offset_(track_dist_offset)
+        track_dist_offset_(track_dist_offset),
+        rerank_depth_(options.rerank_depth),
+        rescore_candidates_(options.precision != feature_precision::fp32 || options.rerank_depth > 0 || compressed_index(selected_index_string(index_str, options)))
     {
-        index->train(n, features.data());
+        if(options.nr_shards == 0)
+            throw std::runtime_error("feature index needs at least one shard");
+        active = std::vector<char>(n, true);
+        if(selected_index_string(index_str, options) == "")
+            return;
+        std::unique_ptr<faiss::Index> index = create_index(index_str, options);
+
+        if(!index->is_trained)
+        {
+            MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss train");
+            if(options.train_sample_size > 0 && options.train_sample_size < n)
+            {
+                // uniform sample without replacement, fixed seed for reproducible indices.
+                std::vector<size_t> rows(n);
+                std::iota(rows.begin(), rows.end(), 0);
+                std::mt19937 generator(0);
+                std::vector<float> sample(options.train_sample_size * d);
+                for(size_t c=0; c<options.train_sample_size; ++c)
+                {
+                    std::swap(rows[c], rows[c + std::uniform_int_distribution<size_t>(0, n-c-1)(generator)]);
+                    std::copy(_features.begin() + rows[c]*d, _features.begin() + (rows[c]+1)*d, sample.begin() + c*d);
+                }
+                LOG_INFO << "[feature index] train on " << options.train_sample_size << " of " << n << " points\n";
+                index->train(options.train_sample_size, sample.data());
+            }
+            else
+                index->train(n, _features.data());
+        }
 
+        create_shards(std::move(index), index_str, options);
+        add_to_shards(0, n, _features.data());
+
+        if(options.precision != feature_precision::fp32)
         {
-            MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss add");
-            index->add(n, features.data());
+            // faiss codes are estimated from the scalar quantizer width.
+            LOG_INFO << "[feature index] " << to_string(options.precision) << " features " << features.memory_bytes() / 1e6 << " MB, fp32 " << features.fp32_memory_bytes() / 1e6 << " MB"
+                << ", index codes about " << n * d * bytes_per_component(options.precision) / 1e6 << " MB, fp32 " << n * d * sizeof(float) / 1e6 << " MB\n";
         }
+    }
 
+    feature_index::feature_index(const size_t _d, const size_t n, const std::vector<float>& _features, const std::function<size_t(size_t)>& wait_for_rows, const std::string& index_str,
+            const bool track_dist_offset, const feature_index_options& options)
+        : d(_d),
+        features(_d, 0, nullptr, options.precision, storage_file(options.storage_dir, "features"), options.memory_budget_mb << 20),
+        nr_active(n),
+        track_dist_offset_(track_dist_offset),
+        rerank_depth_(options.rerank_depth),
+        rescore_candidates_(options.rerank_depth > 0 || compressed_index(selected_index_string(index_str, options)))
+    {
+        if(options.nr_shards == 0)
+            throw std::runtime_error("feature index needs at least one shard");
+        // reduced precision base rows are encoded all at once.
+        if(options.precision != feature_precision::fp32)
+            throw std::runtime_error("feature index over rows that are still parsed needs fp32 precision");
         active = std::vector<char>(n, true);
+        std::unique_ptr<faiss::Index> index = selected_index_string(index_str, options) != "" ? create_index(index_str, options) : nullptr;
+
+        if(index != nullptr && !index->is_trained)
+        {
+            MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss train");
+            // an early sample: the first rows, by default enough for the coarse quantizer of IVF indices.
+            size_t nr_train_rows = n;
+            if(options.train_sample_size > 0)
+                nr_train_rows = std::min(n, options.train_sample_size);
+            else if(const faiss::IndexIVF* ivf = faiss::ivflib::try_extract_index_ivf(index.get()))
+                nr_train_rows = std::min(n, std::max<size_t>(65536, 256 * ivf->nlist));
+            wait_for_rows(nr_train_rows);
+            LOG_INFO << "[feature index] train on first " << nr_train_rows << " of " << n << " points\n";
+            index->train(nr_train_rows, _features.data());
+        }
+        if(index != nullptr)
+            create_shards(std::move(index), index_str, options);
+
+        // rows are stored and indexed chunk by chunk as they are parsed.
+        size_t nr_added = 0;
+        while(nr_added < n)
+        {
+            const size_t nr_ready = wait_for_rows(nr_added + 1);
+            float* added_features = features.append_rows(nr_ready - nr_added);
+            std::copy(_features.begin() + nr_added*d, _features.begin() + nr_ready*d, added_features);
+            add_to_shards(nr_added, nr_ready - nr_added, added_features);
+            nr_added = nr_ready;
+        }
     }
 
-    std::tuple<faiss::Index::idx_t, float> feature_index::get_nearest_node(const faiss::Index::idx_t id)
+    std::unique_ptr<faiss::Index> feature_index::create_index(const std::string& index_str, const feature_index_options& options)
+    {
+        std::unique_ptr<faiss::Index> index(index_factory(d, reduced_precision_index_string(selected_index_string(index_str, options), options.precision).c_str(), faiss::MetricType::METRIC_INNER_PRODUCT));
+        if(options.nprobe > 0)
+        {
+            if(selected_index_string(index_str, options).find("IVF") == std::string::npos)
+                throw std::runtime_error("nprobe requires an IVF index");
+            faiss::ParameterSpace().set_index_parameter(index.get(), "nprobe", options.nprobe);
+        }
+
+        if(options.ef_construction > 0 || options.ef_search > 0 || options.adaptive_ef_search)
+        {
+            faiss::IndexHNSW* hnsw_index = dynamic_cast<faiss::IndexHNSW*>(index.get());
+            if(hnsw_index == nullptr)
+                throw std::runtime_error("efConstruction and efSearch require an HNSW index");
+            if(options.ef_construction > 0)
+                hnsw_index->hnsw.efConstruction = options.ef_construction;
+            if(options.ef_search > 0)
+                hnsw_index->hnsw.efSearch = options.ef_search;
+            if(options.adaptive_ef_search)
+                ef_controller_ = std::make_unique<ef_search_controller>(hnsw_index->hnsw.efSearch);
+        }
+        return index;
+    }
+
+    void feature_index::create_shards(std::unique_ptr<faiss::Index> index, const std::string& index_str, const feature_index_options& options)
+    {
+        // shards share the trained quantizers.
+        for(size_t s=1; s<options.nr_shards; ++s)
+            shards.emplace_back(faiss::clone_index(index.get()));
+        shards.insert(shards.begin(), std::move(index));
+        shard_ids.resize(shards.size());
+        if(options.storage_dir != "")
+        {
+            // codes of IVF indices go to memory-mapped inverted lists, which grow on disk as clusters are added. Empty lists replace the in-memory ones before anything is added.
+            for(auto& shard : shards)
+            {
+                faiss::IndexIVF* ivf = faiss::ivflib::try_extract_index_ivf(shard.get());
+                if(ivf == nullptr)
+                {
+                    LOG_WARNING << "[feature index] index " << selected_index_string(index_str, options) << " is kept in memory, only IVF indices store their inverted lists on disk\n";
+                    break;
+                }
+                inverted_list_files_.push_back(storage_file(options.storage_dir, "ivfdata"));
+                ivf->replace_invlists(new faiss::OnDiskInvertedLists(ivf->nlist, ivf->code_size, inverted_list_files_.back().c_str()), true);
+            }
+        }
+    }
+
+    struct feature_index::serialized_state {
+        size_t d;
+        std::vector<std::unique_ptr<faiss::Index>> shards;
+        std::vector<std::vector<faiss::Index::idx_t>> shard_ids;
+        feature_storage features;
+        std::vector<char> active;
+        size_t nr_active;
+        bool track_dist_offset;
+        size_t rerank_depth;
+        bool rescore_candidates;
+        std::unique_ptr<ef_search_controller> ef_controller;
+    };
+
+    namespace {
+        // Serialized states start with the magic "DMFI" and a version, 2 added the re-ranking depth and whether candidates are rescored.
+        constexpr std::array<char,4> serialization_magic = {'D','M','F','I'};
+        constexpr uint32_t serialization_version = 2;
+
+        std::vector<std::unique_ptr<faiss::Index>> read_faiss_indices(binary_reader& reader)
+        {
+            std::vector<std::unique_ptr<faiss::Index>> indices(reader.read<size_t>());
+            for(auto& index : indices)
+            {
+                faiss::VectorIOReader index_reader;
+                index_reader.data = reader.read_vector<uint8_t>();
+                index.reset(faiss::read_index(&index_reader));
+            }
+            return indices;
+        }
+
+        std::unique_ptr<ef_search_controller> read_ef_search_controller(binary_reader& reader)
+        {
+            const size_t base_ef = reader.read<size_t>();
+            return base_ef > 0 ? std::make_unique<ef_search_controller>(base_ef) : nullptr;
+        }
+
+        std::vector<std::vector<faiss::Index::idx_t>> read_shard_ids(binary_reader& reader)
+        {
+            std::vector<std::vector<faiss::Index::idx_t>> ids(reader.read<size_t>());
+            for(auto& shard_ids : ids)
+                shard_ids = reader.read_vector<faiss::Index::idx_t>();
+            return ids;
+        }
+    }
+
+    feature_index::serialized_state feature_index::read_state(binary_reader& reader)
+    {
+        // in the order of serialize.
+        if(reader.read<std::array<char,4>>() != serialization_magic)
+            throw std::runtime_error("serialized data is not a feature index");
+        const uint32_t version = reader.read<uint32_t>();
+        if(version != serialization_version)
+            throw std::runtime_error("unsupported serialized feature index version " + std::to_string(version) + ", expected " + std::to_string(serialization_version));
+        serialized_state state;
+        state.d = reader.read<size_t>();
+        state.shards = read_faiss_indices(reader);
+        state.shard_ids = read_shard_ids(reader);
+        state.features.deserialize(reader);
+        state.active = reader.read_vector<char>();
+        state.nr_active = reader.read<size_t>();
+        state.track_dist_offset = reader.read<bool>();
+        state.rerank_depth = reader.read<size_t>();
+        state.rescore_candidates = reader.read<bool>();
+        state.ef_controller = read_ef_search_controller(reader);
+        return state;
+    }
+
+    feature_index::feature_index(binary_reader& reader)
+        : feature_index(read_state(reader))
+    {}
+
+    feature_index::feature_index(serialized_state&& state)
+        : d(state.d),
+        shards(std::move(state.shards)),
+        shard_ids(std::move(state.shard_ids)),
+        features(std::move(state.features)),
+        active(std::move(state.active)),
+        nr_active(state.nr_active),
+        track_dist_offset_(state.track_dist_offset),
+        rerank_depth_(state.rerank_depth),
+        rescore_candidates_(state.rescore_candidates),
+        ef_controller_(std::move(state.ef_controller))
+    {
+        if(features.nr_rows() != active.size() || shards.size() != shard_ids.size())
+            throw std::runtime_error("inconsistent serialized feature index");
+    }
+
+    feature_index::~feature_index()
+    {
+        // faiss unmaps the lists when the shards are destroyed.
+        shards.clear();
+        for(const std::string& path : inverted_list_files_)
+            std::filesystem::remove(path);
+    }
+
+    void feature_index::serialize(binary_writer& writer) const
     {
         MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
-        if (track_dist_offset_)
-            features[id * d + d - 1] *= -1.0;
-        for (size_t nr_lookups = 2; nr_lookups < 2 * index->ntotal; nr_lookups *= 2)
+        if(!inverted_list_files_.empty())
+            throw std::runtime_error("feature index with on-disk inverted lists cannot be serialized");
+        writer.write(serialization_magic);
+        writer.write(serialization_version);
+        writer.write(d);
+        writer.write(shards.size());
+        for(const auto& index : shards)
         {
-            float distance[std::min(nr_lookups, size_t(index->ntotal))];
-            faiss::Index::idx_t nns[std::min(nr_lookups, size_t(index->ntotal))];
-            index->search(1, features.data() + id * d, std::min(nr_lookups, size_t(index->ntotal)), distance, nns);
-            assert(std::is_sorted(distance, distance + std::min(nr_lookups, size_t(index->ntotal)), std::greater<float>()));
-            for (size_t k = 0; k < std::min(nr_lookups, size_t(index->ntotal)); ++k)
-                if (nns[k] < active.size() && nns[k] != id && active[nns[k]] == true)
-                    return {nns[k], distance[k]};
+            faiss::VectorIOWriter index_writer;
+            faiss::write_index(index.get(), &index_writer);
+            writer.write_vector(index_writer.data);
         }
-        throw std::runtime_error("Could not find nearest neighbor");
+        writer.write(shard_ids.size());
+        for(const auto& ids : shard_ids)
+            writer.write_vector(ids);
+        features.serialize(writer);
+        writer.write_vector(active);
+        writer.write(nr_active);
+        writer.write(track_dist_offset_);
+        writer.write(rerank_depth_);
+        writer.write(rescore_candidates_);
+        // controller state is not kept, it adapts again within a few batches.
+        writer.write(ef_controller_ ? ef_controller_->base_ef() : size_t(0));
+    }
 
-        if (track_dist_offset_)
-            features[id * d + d - 1] *= -1.0;
+    void feature_index::reset(const size_t n, const std::vector<float>& _features)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        assert(_features.size() == n*d);
+        for(auto& index : shards)
+            index->reset();
+        for(auto& ids : shard_ids)
+            ids.clear();
+        features.assign(n, _features.data());
+        active.assign(n, true);
+        nr_active = n;
+        if(ef_controller_)
+            ef_controller_->reset();
+        add_to_shards(0, n, _features.data());
+    }
+
+    void feature_index::search(const size_t nr_queries, const float* queries, const size_t k, float* distances, faiss::Index::idx_t* labels) const
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss search");
+        PERF_COUNTERS_REGION("faiss search");
+        if(shards.empty())
+            throw std::runtime_error("feature index without faiss index cannot be searched");
+        faiss::SearchParametersHNSW hnsw_params;
+        const faiss::SearchParameters* params = nullptr;
+        if(ef_controller_)
+        {
+            hnsw_params.efSearch = ef_controller_->ef_search(k);
+            params = &hnsw_params;
+            METRICS_GAUGE_SET("hnsw ef search", hnsw_params.efSearch);
+        }
+        // a single shard holds all nodes in id order.
+        if(shards.size() == 1)
+        {
+            shards[0]->search(nr_queries, queries, k, distances, labels, params);
+            return;
+        }
+
+        std::vector<std::vector<float>> shard_distances(shards.size());
+        std::vector<std::vector<faiss::Index::idx_t>> shard_labels(shards.size());
+        const auto search_shard = [&](const size_t s) {
+            shard_distances[s].resize(nr_queries * k);
+            shard_labels[s].resize(nr_queries * k, -1);
+            if(shards[s]->ntotal > 0)
+                shards[s]->search(nr_queries, queries, k, shard_distances[s].data(), shard_labels[s].data(), params);
+        };
+        if(fan_out_to_shards(nr_queries))
+        {
+#pragma omp parallel for schedule(dynamic)
+            for(size_t s=0; s<shards.size(); ++s)
+                search_shard(s);
+        }
+        else
+        {
+            for(size_t s=0; s<shards.size(); ++s)
+                search_shard(s);
+        }
+
+#pragma omp parallel
+        {
+            std::vector<std::tuple<faiss::Index::idx_t, float>> candidates;
+#pragma omp for schedule(static)
+            for(size_t q=0; q<nr_queries; ++q)
+            {
+                // a shard that returned k results may hold further vectors below its k-th distance, merged results are only complete above it.
+                float cutoff = -std::numeric_limits<float>::infinity();
+                for(size_t s=0; s<shards.size(); ++s)
+                    if(shard_labels[s][q*k + k-1] >= 0)
+                        cutoff = std::max(cutoff, shard_distances[s][q*k + k-1]);
+                candidates.clear();
+                for(size_t s=0; s<shards.size(); ++s)
+                    for(size_t l=0; l<k; ++l)
+                    {
+                        const faiss::Index::idx_t local_id = shard_labels[s][q*k + l];
+                        if(local_id < 0 || shard_distances[s][q*k + l] < cutoff)
+                            continue;
+                        const faiss::Index::idx_t id = shard_ids[s][local_id];
+                        if(active[id])
+                            candidates.push_back({id, shard_distances[s][q*k + l]});
+                    }
+                const size_t nr_results = std::min(k, candidates.size());
+                std::partial_sort(candidates.begin(), candidates.begin() + nr_results, candidates.end(), [](const auto& a, const auto& b) { return std::get<1>(a) > std::get<1>(b); });
+                for(size_t l=0; l<k; ++l)
+                {
+                    labels[q*k + l] = l < nr_results ? std::get<0>(candidates[l]) : -1;
+                    distances[q*k + l] = l < nr_results ? std::get<1>(candidates[l]) : -std::numeric_limits<float>::infinity();
+                }
+            }
+        }
+    }
+
+    void feature_index::add_to_shards(const faiss::Index::idx_t first_id, const size_t n, const float* new_features)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss add");
+        if(shards.empty())
+            return;
+        // water filling: the m least filled shards are raised to a common level.
+        std::vector<size_t> order(shards.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return shards[a]->ntotal < shards[b]->ntotal; });
+        size_t m = shards.size();
+        size_t level, total;
+        while(true)
+        {
+            total = n;
+            for(size_t c=0; c<m; ++c)
+                total += shards[order[c]]->ntotal;
+            level = total / m;
+            if(shards[order[m-1]]->ntotal <= level)
+                break;
+            --m;
+        }
+        std::vector<size_t> counts(shards.size(), 0);
+        for(size_t c=0; c<m; ++c)
+            counts[order[c]] = level - shards[order[c]]->ntotal + (c < total - level*m ? 1 : 0);
+
+        std::vector<size_t> offsets(shards.size() + 1, 0);
+        std::partial_sum(counts.begin(), counts.end(), offsets.begin() + 1);
+        assert(offsets.back() == n);
+        const auto add_to_shard = [&](const size_t s) {
+            if(counts[s] == 0)
+                return;
+            shards[s]->add(counts[s], new_features + offsets[s]*d);
+            for(size_t c=offsets[s]; c<offsets[s+1]; ++c)
+                shard_ids[s].push_back(first_id + c);
+        };
+        if(shards.size() > 1 && fan_out_to_shards(n))
+        {
+#pragma omp parallel for schedule(dynamic)
+            for(size_t s=0; s<shards.size(); ++s)
+                add_to_shard(s);
+        }
+        else
+        {
+            for(size_t s=0; s<shards.size(); ++s)
+                add_to_shard(s);
+        }
+    }
+
+    void feature_index::count_active_results(const std::vector<faiss::Index::idx_t>& nns, size_t& nr_results, size_t& nr_active_results) const
+    {
+        for(const faiss::Index::idx_t nn : nns)
+            if(nn >= 0)
+            {
+                ++nr_results;
+                if(active[nn])
+                    ++nr_active_results;
+            }
+    }
+
+    void feature_index::fill_query(const faiss::Index::idx_t node, float* query) const
+    {
+        const float* f = features.row(node, query);
+        if(f != query)
+            std::copy(f, f + d, query);
+        if(track_dist_offset_)
+            query[d-1] *= -1.0;
+    }
+
+    void feature_index::rescore(const faiss::Index::idx_t node, std::vector<std::tuple<faiss::Index::idx_t, float>>& candidates) const
+    {
+        for(auto& [nn, dist] : candidates)
+            dist = inner_product(node, nn);
+        std::stable_sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return std::get<1>(a) > std::get<1>(b); });
+    }
+
+    std::vector<std::tuple<faiss::Index::idx_t, float>> feature_index::exhaustive_candidates(const faiss::Index::idx_t node) const
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        std::vector<std::tuple<faiss::Index::idx_t, float>> candidates;
+        for(faiss::Index::idx_t j=0; j<active.size(); ++j)
+            if(active[j] && j != node)
+                candidates.push_back({j, 0.0});
+        rescore(node, candidates);
+        return candidates;
+    }
+
+    std::tuple<faiss::Index::idx_t, float> feature_index::get_nearest_node(const faiss::Index::idx_t id) const
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        assert(node_active(id));
+        if(nr_nodes() < 2)
+            throw std::runtime_error("Could not find nearest neighbor");
+        const auto [nns, distances] = get_nearest_nodes({id});
+        return {nns[0], distances[0]};
     }
 
     std::tuple<std::vector<faiss::Index::idx_t>, std::vector<float>> feature_index::get_nearest_nodes(const std::vector<faiss::Index::idx_t> &nodes) const
@@ -62,11 +576,14 @@ namespace DENSE_MULTICUT {
         for (size_t c = 0; c < nodes.size(); ++c)
             node_map.insert({nodes[c], c});
 
-        for (size_t _nr_lookups = 2; _nr_lookups < 2 + 2 * max_id_nr(); _nr_lookups *= 2)
+        const bool rescore_candidates = rescore_candidates_;
+        size_t nr_doublings = 0, nr_results = 0, nr_active_results = 0;
+        for (size_t _nr_lookups = std::min(std::max(size_t(2), rerank_depth_), active.size()); _nr_lookups < 2 + 2 * max_id_nr(); _nr_lookups *= 2)
         {
-            const size_t nr_lookups = std::min(_nr_lookups, size_t(index->ntotal));
+            const size_t nr_lookups = std::min(_nr_lookups, active.size());
             if (node_map.size() > 0)
             {
+                ++nr_doublings;
                 std::vector<faiss::Index::idx_t> cur_nodes;
                 for (const auto [node, idx] : node_map)
                     cur_nodes.push_back(node);
@@ -75,34 +592,50 @@ namespace DENSE_MULTICUT {
 
                 std::vector<float> query_features(node_map.size() * d);
                 for (size_t c = 0; c < cur_nodes.size(); ++c)
-                {
-                    for (size_t l = 0; l < d; ++l)
-                        query_features[c * d + l] = features[cur_nodes[c] * d + l];
-                    if (track_dist_offset_)
-                        query_features[c * d + d - 1] *= -1.0;
-                }
-                {
-                    MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss search");
-                    index->search(cur_nodes.size(), query_features.data(), nr_lookups, distances.data(), nns.data());
-                }
+                    fill_query(cur_nodes[c], query_features.data() + c * d);
+                search(cur_nodes.size(), query_features.data(), nr_lookups, distances.data(), nns.data());
+                if (ef_controller_)
+                    count_active_results(nns, nr_results, nr_active_results);
 
+                // approximate distances are only used to select candidates, all active ones of this round are rescored.
+                std::vector<std::tuple<faiss::Index::idx_t, float>> candidates;
                 for (size_t c = 0; c < cur_nodes.size(); ++c)
                 {
+                    candidates.clear();
                     for (size_t k = 0; k < nr_lookups; ++k)
                     {
-                        if (nns[c * nr_lookups + k] < active.size() && nns[c * nr_lookups + k] != cur_nodes[c] && active[nns[nr_lookups * c + k]] == true)
+                        if (nns[c * nr_lookups + k] >= 0 && nns[c * nr_lookups + k] < active.size() && nns[c * nr_lookups + k] != cur_nodes[c] && active[nns[nr_lookups * c + k]] == true)
                         {
-                            assert(node_map.count(cur_nodes[c]) > 0);
-                            return_nns[node_map[cur_nodes[c]]] = nns[c * nr_lookups + k];
-                            return_distances[node_map[cur_nodes[c]]] = distances[c * nr_lookups + k];
-                            node_map.erase(cur_nodes[c]);
-                            break;
+                            candidates.push_back({nns[c * nr_lookups + k], distances[c * nr_lookups + k]});
+                            if (!rescore_candidates)
+                                break;
                         }
                     }
+                    if (candidates.empty())
+                        continue;
+                    if (rescore_candidates)
+                        rescore(cur_nodes[c], candidates);
+                    assert(node_map.count(cur_nodes[c]) > 0);
+                    return_nns[node_map[cur_nodes[c]]] = std::get<0>(candidates[0]);
+                    return_distances[node_map[cur_nodes[c]]] = std::get<1>(candidates[0]);
+                    node_map.erase(cur_nodes[c]);
                 }
             }
         }
 
+            // compressed indices may return fewer than nr_lookups results, even when asked for all points.
+            METRICS_COUNTER_ADD("nn exhaustive fallbacks", node_map.size());
+            for (const auto [node, c] : node_map)
+            {
+                const auto candidates = exhaustive_candidates(node);
+                assert(candidates.size() > 0);
+                return_nns[c] = std::get<0>(candidates[0]);
+                return_distances[c] = std::get<1>(candidates[0]);
+            }
+
+            if(ef_controller_)
+                ef_controller_->update(nr_results, nr_active_results, nr_doublings);
+            METRICS_HISTOGRAM_ADD("nn lookup doublings", nr_doublings);
             for(size_t i=0; i<return_nns.size(); ++i)
                 assert(return_nns[i] != nodes[i]);
             return {return_nns, return_distances};
@@ -128,12 +661,15 @@ namespace DENSE_MULTICUT {
             nns_count.insert({nodes[c], 0});
             }
 
-            for(size_t _nr_lookups=k+1; _nr_lookups<2+2*max_id_nr(); _nr_lookups*=2)
+            const bool rescore_candidates = rescore_candidates_;
+            size_t nr_doublings = 0, nr_results = 0, nr_active_results = 0;
+            for(size_t _nr_lookups=std::min(std::max(k+1, rerank_depth_), active.size()); _nr_lookups<2+2*max_id_nr(); _nr_lookups*=2)
             {
-                const size_t nr_lookups = std::min(_nr_lookups, size_t(index->ntotal));
+                const size_t nr_lookups = std::min(_nr_lookups, active.size());
                 //std::cout << "[feature index get_nearest_nodes] nr lookups = " << nr_lookups << "\n";
                 if(node_map.size() > 0)
                 {
+                    ++nr_doublings;
                     std::vector<faiss::Index::idx_t> cur_nodes;
                     for(const auto [node, idx] : node_map)
                         cur_nodes.push_back(node);
@@ -142,40 +678,52 @@ namespace DENSE_MULTICUT {
 
                     std::vector<float> query_features(node_map.size()*d);
                     for(size_t c=0; c<cur_nodes.size(); ++c)
-                    {
-                        for(size_t l=0; l<d; ++l)
-                            query_features[c*d + l] = features[cur_nodes[c]*d + l];
-                        if(track_dist_offset_)
-                            query_features[c*d + d-1] *= -1.0;
-                    }
+                        fill_query(cur_nodes[c], query_features.data() + c*d);
 
-                    {
-                        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("faiss search");
-                        index->search(cur_nodes.size(), query_features.data(), nr_lookups, distances.data(), nns.data());
-                    }
+                    search(cur_nodes.size(), query_features.data(), nr_lookups, distances.data(), nns.data());
+                    if(ef_controller_)
+                        count_active_results(nns, nr_results, nr_active_results);
 
+                    std::vector<std::tuple<faiss::Index::idx_t, float>> candidates;
                     for(size_t c=0; c<cur_nodes.size(); ++c)
                     {
-                        size_t nns_count = 0;
+                        candidates.clear();
                         for(size_t l=0; l<nr_lookups; ++l)
                         {
                             if(nns[c*nr_lookups + l] >= 0 && nns[c*nr_lookups + l] < active.size() && nns[c*nr_lookups + l] != cur_nodes[c] && active[nns[nr_lookups*c + l]] == true)
                             {
-                                assert(node_map.count(cur_nodes[c]) > 0);
-                                return_nns[node_map[cur_nodes[c]] * k + nns_count] = nns[c*nr_lookups + l];
-                                return_distances[node_map[cur_nodes[c]] * k + nns_count] = distances[c*nr_lookups + l];
-                                nns_count++;
-                                if(nns_count == k)
-                                {
-                                    node_map.erase(cur_nodes[c]);
+                                candidates.push_back({nns[c*nr_lookups + l], distances[c*nr_lookups + l]});
+                                if(!rescore_candidates && candidates.size() == k)
                                     break;
-                                }
                             }
                         }
+                        if(candidates.size() < k)
+                            continue;
+                        if(rescore_candidates)
+                            rescore(cur_nodes[c], candidates);
+                        assert(node_map.count(cur_nodes[c]) > 0);
+                        for(size_t l=0; l<k; ++l)
+                        {
+                            return_nns[node_map[cur_nodes[c]] * k + l] = std::get<0>(candidates[l]);
+                            return_distances[node_map[cur_nodes[c]] * k + l] = std::get<1>(candidates[l]);
+                        }
+                        node_map.erase(cur_nodes[c]);
                     }
                 }
             }
 
+            METRICS_COUNTER_ADD("nn exhaustive fallbacks", node_map.size());
+            for(const auto [node, c] : node_map)
+            {
+                const auto candidates = exhaustive_candidates(node);
+                assert(candidates.size() >= k);
+                for(size_t l=0; l<k; ++l)
+                {
+                    return_nns[c*k + l] = std::get<0>(candidates[l]);
+                    return_distances[c*k + l] = std::get<1>(candidates[l]);
+                }
+            }
+
             for(size_t i=0; i<nodes.size(); ++i)
             {
                 for(size_t l=0; l<k; ++l)
@@ -188,6 +736,9 @@ namespace DENSE_MULTICUT {
                     assert(return_distances[i*k + l] >= return_distances[i*k + l+1]);
                 }
             }
+            if(ef_controller_)
+                ef_controller_->update(nr_results, nr_active_results, nr_doublings);
+            METRICS_HISTOGRAM_ADD("nn lookup doublings", nr_doublings);
             return {return_nns, return_distances};
     }
 
@@ -203,6 +754,7 @@ namespace DENSE_MULTICUT {
     faiss::Index::idx_t feature_index::merge(const faiss::Index::idx_t i, const faiss::Index::idx_t j)
     {
         MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        PERF_COUNTERS_REGION("feature_index::merge");
         assert(i != j);
         assert(i < active.size());
         assert(j < active.size());
@@ -212,25 +764,75 @@ namespace DENSE_MULTICUT {
 
         nr_active--;
 
-        const faiss::Index::idx_t new_id = features.size()/d;
+        // cluster sums go to the fp32 side table. Rows are fetched after appending, which may move fp32 rows.
+        const faiss::Index::idx_t new_id = features.nr_rows();
+        float* new_features = features.append_rows(1);
+        const float* f_i = features.row(i, decode_buffer(d, 0));
+        const float* f_j = features.row(j, decode_buffer(d, 1));
         for(size_t l=0; l<d; ++l)
-            features.push_back(features[i*d + l] + features[j*d + l]);
-        index->add(1, features.data() + new_id*d);
+            new_features[l] = f_i[l] + f_j[l];
+        add_to_shards(new_id, 1, new_features);
         active.push_back(true);
+        METRICS_GAUGE_SET("index tombstone ratio", 1.0 - double(nr_active) / active.size());
         return new_id;
     }
 
+    faiss::Index::idx_t feature_index::merge(const std::vector<std::array<size_t,2>>& pairs)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        PERF_COUNTERS_REGION("feature_index::merge");
+        const faiss::Index::idx_t first_id = features.nr_rows();
+        float* merged_features = features.append_rows(pairs.size());
+#pragma omp parallel for schedule(static)
+        for(size_t c=0; c<pairs.size(); ++c)
+        {
+            const auto [i,j] = pairs[c];
+            assert(i != j);
+            assert(i < active.size() && j < active.size());
+            assert(active[i] && active[j]);
+            const float* f_i = features.row(i, decode_buffer(d, 0));
+            const float* f_j = features.row(j, decode_buffer(d, 1));
+            float* new_features = merged_features + c*d;
+            for(size_t l=0; l<d; ++l)
+                new_features[l] = f_i[l] + f_j[l];
+        }
+        for(const auto [i,j] : pairs)
+        {
+            active[i] = false;
+            active[j] = false;
+        }
+        nr_active -= pairs.size();
+        add_to_shards(first_id, pairs.size(), merged_features);
+        active.resize(active.size() + pairs.size(), true);
+        METRICS_GAUGE_SET("index tombstone ratio", 1.0 - double(nr_active) / active.size());
+        return first_id;
+    }
+
+    faiss::Index::idx_t feature_index::add_nodes(const size_t n, const float* new_features)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        const faiss::Index::idx_t first_id = active.size();
+        float* added_features = features.append_rows(n);
+        std::copy(new_features, new_features + n*d, added_features);
+        add_to_shards(first_id, n, added_features);
+        active.resize(active.size() + n, true);
+        nr_active += n;
+        return first_id;
+    }
+
     double feature_index::inner_product(const faiss::Index::idx_t i, const faiss::Index::idx_t j) const
     {
         assert(i < active.size());
         assert(j < active.size());
+        const float* f_i = features.row(i, decode_buffer(d, 0));
+        const float* f_j = features.row(j, decode_buffer(d, 1));
         float x = 0.0;
         for(size_t l=0; l<d-1; ++l)
-            x += features[i*d+l]*features[j*d+l];
+            x += f_i[l]*f_j[l];
         if(track_dist_offset_)
-            x -= features[i*d+d-1]*features[j*d+d-1];
+            x -= f_i[d-1]*f_j[d-1];
         else
-            x += features[i*d+d-1]*features[j*d+d-1];
+            x += f_i[d-1]*f_j[d-1];
         return x;
     }
 
@@ -252,6 +854,18 @@ namespace DENSE_MULTICUT {
         return nr_active;
     }
 
+    const float* feature_index::node_features(const faiss::Index::idx_t idx) const
+    {
+        assert(idx < active.size());
+        assert(features.precision() == feature_precision::fp32);
+        return features.row(idx, nullptr);
+    }
+
+    bool feature_index::exact_search() const
+    {
+        return !shards.empty() && std::all_of(shards.begin(), shards.end(), [](const auto& shard) { return dynamic_cast<const faiss::IndexFlat*>(shard.get()) != nullptr; });
+    }
+
     std::vector<faiss::Index::idx_t> feature_index::get_active_nodes() const
     {
         std::vector<faiss::Index::idx_t> active_nodes;
@@ -0,0 +1,230 @@
+#include "feature_storage.h"
+#include <cstring>
+#include <cmath>
+#include <cassert>
+#include <stdexcept>
+#include <algorithm>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        uint32_t float_bits(const float x)
+        {
+            uint32_t b;
+            std::memcpy(&b, &x, sizeof(b));
+            return b;
+        }
+
+        float bits_float(const uint32_t b)
+        {
+            float x;
+            std::memcpy(&x, &b, sizeof(x));
+            return x;
+        }
+
+        // IEEE half precision, round to nearest even. Values beyond the half range become infinity.
+        uint16_t float_to_half(const float x)
+        {
+            const uint32_t b = float_bits(x);
+            const uint32_t sign = (b >> 16) & 0x8000;
+            const int32_t exponent = int32_t((b >> 23) & 0xff) - 127 + 15;
+            uint32_t mantissa = b & 0x7fffff;
+            if(((b >> 23) & 0xff) == 0xff)
+                return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+            if(exponent >= 31)
+                return sign | 0x7c00;
+            if(exponent <= 0)
+            {
+                if(exponent < -10)
+                    return sign;
+                mantissa |= 0x800000;
+                const uint32_t shift = 14 - exponent;
+                uint32_t half = mantissa >> shift;
+                const uint32_t rest = mantissa & ((1u << shift) - 1);
+                const uint32_t halfway = 1u << (shift - 1);
+                if(rest > halfway || (rest == halfway && (half & 1)))
+                    ++half;
+                return sign | half;
+            }
+            uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+            const uint32_t rest = mantissa & 0x1fff;
+            if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+                ++half;
+            return sign | half;
+        }
+
+        float half_to_float(const uint16_t h)
+        {
+            const uint32_t sign = uint32_t(h & 0x8000) << 16;
+            const uint32_t exponent = (h >> 10) & 0x1f;
+            const uint32_t mantissa = h & 0x3ff;
+            if(exponent == 0)
+            {
+                const float x = std::ldexp(float(mantissa), -24);
+                return sign ? -x : x;
+            }
+            if(exponent == 31)
+                return bits_float(sign | 0x7f800000 | (mantissa << 13));
+            return bits_float(sign | ((exponent - 15 + 127) << 23) | (mantissa << 13));
+        }
+
+        uint16_t float_to_bf16(const float x)
+        {
+            const uint32_t b = float_bits(x);
+            if(std::isnan(x))
+                return uint16_t((b >> 16) | 0x40);
+            const uint32_t rounding = 0x7fff + ((b >> 16) & 1);
+            return uint16_t((b + rounding) >> 16);
+        }
+
+        float bf16_to_float(const uint16_t h)
+        {
+            return bits_float(uint32_t(h) << 16);
+        }
+    }
+
+    feature_precision feature_precision_from_string(const std::string& s)
+    {
+        if(s == "fp32")
+            return feature_precision::fp32;
+        if(s == "fp16")
+            return feature_precision::fp16;
+        if(s == "bf16")
+            return feature_precision::bf16;
+        if(s == "int8")
+            return feature_precision::int8;
+        throw std::runtime_error("Unknown feature precision " + s + ", expected fp32, fp16, bf16 or int8");
+    }
+
+    std::string to_string(const feature_precision precision)
+    {
+        switch(precision)
+        {
+            case feature_precision::fp32: return "fp32";
+            case feature_precision::fp16: return "fp16";
+            case feature_precision::bf16: return "bf16";
+            case feature_precision::int8: return "int8";
+        }
+        return "unknown";
+    }
+
+    feature_storage::feature_storage(const size_t d, const size_t nr_base_rows, const float* base_rows, const feature_precision precision,
+            const std::string& file_path, const size_t memory_budget_bytes)
+        : d_(d),
+        precision_(precision)
+    {
+        if(file_path != "")
+            side_file_ = std::make_unique<mapped_float_array>(file_path, memory_budget_bytes);
+        assign(nr_base_rows, base_rows);
+    }
+
+    void feature_storage::assign(const size_t nr_base_rows, const float* base_rows)
+    {
+        const size_t d = d_;
+        nr_base_rows_ = precision_ == feature_precision::fp32 ? 0 : nr_base_rows;
+        resize_side_table(0);
+        switch(precision_)
+        {
+            case feature_precision::fp32:
+                resize_side_table(nr_base_rows * d);
+                std::copy(base_rows, base_rows + nr_base_rows * d, side_table_data());
+                break;
+            case feature_precision::fp16:
+                half_rows_.resize(nr_base_rows * d);
+                for(size_t i=0; i<half_rows_.size(); ++i)
+                    half_rows_[i] = float_to_half(base_rows[i]);
+                break;
+            case feature_precision::bf16:
+                half_rows_.resize(nr_base_rows * d);
+                for(size_t i=0; i<half_rows_.size(); ++i)
+                    half_rows_[i] = float_to_bf16(base_rows[i]);
+                break;
+            case feature_precision::int8:
+                // symmetric quantization with one scale per row.
+                int8_rows_.resize(nr_base_rows * d);
+                int8_scales_.resize(nr_base_rows);
+                for(size_t i=0; i<nr_base_rows; ++i)
+                {
+                    float max_abs = 0.0;
+                    for(size_t l=0; l<d; ++l)
+                        max_abs = std::max(max_abs, std::abs(base_rows[i*d + l]));
+                    const float scale = max_abs > 0.0 ? max_abs / 127.0f : 1.0f;
+                    int8_scales_[i] = scale;
+                    for(size_t l=0; l<d; ++l)
+                        int8_rows_[i*d + l] = int8_t(std::lround(std::clamp(base_rows[i*d + l] / scale, -127.0f, 127.0f)));
+                }
+                break;
+        }
+    }
+
+    void feature_storage::serialize(binary_writer& writer) const
+    {
+        writer.write(d_);
+        writer.write(nr_base_rows_);
+        writer.write(precision_);
+        writer.write_array(side_table_data(), side_table_size());
+        writer.write_vector(half_rows_);
+        writer.write_vector(int8_rows_);
+        writer.write_vector(int8_scales_);
+    }
+
+    void feature_storage::deserialize(binary_reader& reader)
+    {
+        d_ = reader.read<size_t>();
+        nr_base_rows_ = reader.read<size_t>();
+        precision_ = reader.read<feature_precision>();
+        side_table_ = reader.read_vector<float>();
+        side_file_.reset();
+        half_rows_ = reader.read_vector<uint16_t>();
+        int8_rows_ = reader.read_vector<int8_t>();
+        int8_scales_ = reader.read_vector<float>();
+    }
+
+    const float* feature_storage::row(const size_t i, float* buffer) const
+    {
+        assert(i < nr_rows());
+        if(is_fp32_row(i))
+        {
+            if(side_file_)
+                side_file_->note_read(d_ * sizeof(float));
+            return side_table_data() + (i - nr_base_rows_) * d_;
+        }
+        switch(precision_)
+        {
+            case feature_precision::fp16:
+                for(size_t l=0; l<d_; ++l)
+                    buffer[l] = half_to_float(half_rows_[i*d_ + l]);
+                break;
+            case feature_precision::bf16:
+                for(size_t l=0; l<d_; ++l)
+                    buffer[l] = bf16_to_float(half_rows_[i*d_ + l]);
+                break;
+            case feature_precision::int8:
+                for(size_t l=0; l<d_; ++l)
+                    buffer[l] = int8_scales_[i] * int8_rows_[i*d_ + l];
+                break;
+            case feature_precision::fp32:
+                assert(false);
+        }
+        return buffer;
+    }
+
+    void feature_storage::resize_side_table(const size_t size)
+    {
+        if(side_file_)
+            side_file_->resize(size);
+        else
+            side_table_.resize(size);
+    }
+
+    float* feature_storage::append_rows(const size_t nr_rows)
+    {
+        resize_side_table(side_table_size() + nr_rows * d_);
+        return side_table_data() + side_table_size() - nr_rows * d_;
+    }
+
+    size_t feature_storage::memory_bytes() const
+    {
+        return (side_file_ ? side_file_->resident_bytes() : side_table_.size() * sizeof(float)) + half_rows_.size() * sizeof(uint16_t) + int8_rows_.size() * sizeof(int8_t) + int8_scales_.size() * sizeof(float);
+    }
+}
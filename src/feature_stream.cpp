@@ -0,0 +1,186 @@
+#include "feature_stream.h"
+#include "time_measure_util.h"
+#include "log.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        // Whitespace separated values of a file read in large blocks. Tokens are parsed with strtof/strtoull like operator>> of std::ifstream.
+        class token_reader {
+            public:
+                token_reader(FILE* file, const std::string& path) : file_(file), path_(path), buffer_(1 << 20) {}
+
+                // Next token as pointer into the buffer, terminated by whitespace or 0. nullptr at the end of the file.
+                const char* next()
+                {
+                    while(true)
+                    {
+                        while(begin_ < end_ && std::isspace(static_cast<unsigned char>(buffer_[begin_])))
+                            ++begin_;
+                        size_t token_end = begin_;
+                        while(token_end < end_ && !std::isspace(static_cast<unsigned char>(buffer_[token_end])))
+                            ++token_end;
+                        // a token touching the end of the buffer may continue in the next block.
+                        if(token_end < end_ || (eof_ && begin_ < end_))
+                        {
+                            const char* token = buffer_.data() + begin_;
+                            begin_ = token_end;
+                            return token;
+                        }
+                        if(eof_)
+                            return nullptr;
+                        refill();
+                    }
+                }
+
+                float next_float()
+                {
+                    const char* token = next();
+                    if(token == nullptr)
+                        throw std::runtime_error("unexpected end of dense multicut input file " + path_);
+                    char* stop;
+                    const float x = std::strtof(token, &stop);
+                    if(stop == token)
+                        throw std::runtime_error("invalid value in dense multicut input file " + path_);
+                    return x;
+                }
+
+                size_t next_size()
+                {
+                    const char* token = next();
+                    char* stop;
+                    const size_t x = token != nullptr ? std::strtoull(token, &stop, 10) : 0;
+                    if(token == nullptr || stop == token)
+                        throw std::runtime_error("invalid header in dense multicut input file " + path_);
+                    return x;
+                }
+
+            private:
+                void refill()
+                {
+                    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+                    end_ -= begin_;
+                    begin_ = 0;
+                    if(end_ + 1 >= buffer_.size())
+                        buffer_.resize(2 * buffer_.size());
+                    end_ += std::fread(buffer_.data() + end_, 1, buffer_.size() - end_ - 1, file_);
+                    // terminates the last token of the file for strtof.
+                    buffer_[end_] = 0;
+                    eof_ = std::feof(file_) || std::ferror(file_);
+                }
+
+                FILE* file_;
+                const std::string path_;
+                std::vector<char> buffer_;
+                size_t begin_ = 0;
+                size_t end_ = 0;
+                bool eof_ = false;
+        };
+    }
+
+    feature_stream::feature_stream(const std::string& path, const float dist_offset, const size_t chunk_rows)
+        : track_dist_offset_(dist_offset != 0.0),
+        cost_(1, false)
+    {
+        if(dist_offset < 0.0)
+            throw std::runtime_error("dist_offset can only be >= 0.");
+        FILE* file = std::fopen(path.c_str(), "r");
+        if(file == nullptr)
+            throw std::runtime_error("Could not open dense multicut input file " + path);
+        auto reader = std::make_shared<token_reader>(file, path);
+        try
+        {
+            n_ = reader->next_size();
+            d_ = reader->next_size() + (track_dist_offset_ ? 1 : 0);
+        }
+        catch(...)
+        {
+            std::fclose(file);
+            throw;
+        }
+        features_.resize(n_ * d_);
+        cost_ = cost_disconnected_accumulator(d_, track_dist_offset_);
+        LOG_INFO << "[feature stream] parse " << n_ << " rows of dimension " << d_ << " from " << path << " in chunks of " << chunk_rows << " rows\n";
+
+        parser_ = std::thread([this, file, reader, dist_offset, chunk_rows]() {
+            const auto begin = std::chrono::steady_clock::now();
+            try
+            {
+                const size_t input_dim = track_dist_offset_ ? d_ - 1 : d_;
+                const float offset_feature = std::sqrt(dist_offset);
+                size_t nr_published = 0;
+                for(size_t i=0; i<n_; ++i)
+                {
+                    float* row = features_.data() + i*d_;
+                    for(size_t l=0; l<input_dim; ++l)
+                        row[l] = reader->next_float();
+                    if(track_dist_offset_)
+                        row[d_-1] = offset_feature;
+                    if(i+1 - nr_published == chunk_rows || i+1 == n_)
+                    {
+                        cost_.add(i+1 - nr_published, features_.data() + nr_published*d_);
+                        nr_published = i+1;
+                        if(nr_published == n_)
+                            parse_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                        {
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            nr_parsed_ = nr_published;
+                            rows_parsed_.notify_all();
+                        }
+                        // a stream destroyed before all rows are consumed, e.g. after a failed solve, need not parse the rest of the file.
+                        if(stop_.load(std::memory_order_relaxed))
+                            break;
+                    }
+                }
+            }
+            catch(...)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = std::current_exception();
+                rows_parsed_.notify_all();
+            }
+            std::fclose(file);
+        });
+    }
+
+    feature_stream::~feature_stream()
+    {
+        stop_ = true;
+        if(parser_.joinable())
+            parser_.join();
+    }
+
+    size_t feature_stream::wait_for_rows(const size_t count) const
+    {
+        const size_t nr_rows = std::min(count, n_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(nr_parsed_ < nr_rows)
+        {
+            MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("wait for parsed rows");
+            rows_parsed_.wait(lock, [&]() { return nr_parsed_ >= nr_rows || error_; });
+        }
+        if(nr_parsed_ < nr_rows)
+            std::rethrow_exception(error_);
+        return nr_parsed_;
+    }
+
+    double feature_stream::cost_disconnected() const
+    {
+        wait_for_rows(n_);
+        return cost_.cost();
+    }
+
+    double feature_stream::parse_seconds() const
+    {
+        wait_for_rows(n_);
+        return parse_seconds_;
+    }
+}
@@ -1,36 +1,41 @@
 #include "incremental_nns.h"
 #include "time_measure_util.h"
+#include "perf_counters.h"
+#include "log.h"
 #include <limits>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <algorithm>
 
 namespace DENSE_MULTICUT {
 
-    incremental_nns::incremental_nns(
+    template<typename ID>
+    incremental_nns<ID>::incremental_nns(
         const std::vector<faiss::Index::idx_t>& query_nodes, const std::vector<faiss::Index::idx_t>& nns, const std::vector<float>& nns_distances, const size_t n, const size_t k)
     {
         // Store as undirected graph.
-        nn_graph_ = std::vector<std::unordered_map<size_t, float>>(2 * n);
+        nn_graph_ = std::vector<std::unordered_map<ID, float>>(2 * n);
         min_dist_in_knn_ = std::vector<float>(2 * n, std::numeric_limits<float>::infinity());
         k_ = k;
         insert_nn_to_graph(query_nodes, nns, nns_distances, k);
     }
 
-    void incremental_nns::insert_nn_to_graph(
+    template<typename ID>
+    void incremental_nns<ID>::insert_nn_to_graph(
         const std::vector<faiss::Index::idx_t>& query_nodes, const std::vector<faiss::Index::idx_t>& nns, const std::vector<float>& nns_distances, const size_t k)
     {
         size_t index_1d = 0;
         for (size_t idx = 0; idx != query_nodes.size(); ++idx)
         {
-            const size_t i = query_nodes[idx];
+            const ID i = query_nodes[idx];
             for (size_t i_n = 0; i_n != k; ++i_n, ++index_1d)
             {
                 const float current_distance = nns_distances[index_1d];
                 if (current_distance < 0)
                     continue;
 
-                const size_t j = nns[index_1d];
+                const ID j = nns[index_1d];
                 nn_graph_[i].try_emplace(j, current_distance);
                 nn_graph_[j].try_emplace(i, current_distance);
                 min_dist_in_knn_[i] = std::min(min_dist_in_knn_[i], current_distance);
@@ -39,14 +44,16 @@ namespace DENSE_MULTICUT {
         }
     }
 
-    std::unordered_map<size_t, float> incremental_nns::merge_nodes(const size_t i, const size_t j, const size_t new_id, const feature_index& index)
+    template<typename ID>
+    std::unordered_map<ID, float> incremental_nns<ID>::merge_nodes(const ID i, const ID j, const ID new_id, const feature_index& index)
     {
         MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME
-        const size_t root = nn_graph_[i].size() >= nn_graph_[j].size() ? i: j;
-        const size_t other = root == i ? j : i;
+        PERF_COUNTERS_REGION("incremental_nns::merge_nodes");
+        const ID root = nn_graph_[i].size() >= nn_graph_[j].size() ? i: j;
+        const ID other = root == i ? j : i;
         
         const size_t current_k = 10 * k_; // * index.nr_nodes_in_cluster(i) * index.nr_nodes_in_cluster(j);
-        std::vector<std::pair<size_t, float>> nn_ij;
+        std::vector<std::pair<ID, float>> nn_ij;
 
         const float upper_bound_outside_knn_ij = min_dist_in_knn_[i] + min_dist_in_knn_[j];
 
@@ -108,21 +115,21 @@ namespace DENSE_MULTICUT {
         // If no new neighbours are found within KNNs of i and j, then search in whole graph for current_k many nearest neighbours.
         if ((nn_ij.size() == 0 || largest_distance < upper_bound_outside_knn_ij) && index.nr_nodes() > 1)
         {
-            const std::vector<faiss::Index::idx_t> new_id_to_search = {new_id};
+            const std::vector<faiss::Index::idx_t> new_id_to_search = {faiss::Index::idx_t(new_id)};
             const auto [nns, distances] = index.get_nearest_nodes(new_id_to_search, std::min(current_k, index.nr_nodes() - 1));
             for (int idx = 0; idx != nns.size(); ++idx)
             {
                 const float current_distance = distances[idx];
                 if (current_distance > 0.0)
-                    nn_ij.push_back({nns[idx], current_distance});
+                    nn_ij.push_back({ID(nns[idx]), current_distance});
             }
-            std::cout<<"[incremental nns] Performing exhaustive search on "<<index.nr_nodes()<<" nodes. ";
-            std::cout<<"Found inc. neighbours: "<<nn_ij.size()<<", with max. cost: "<<largest_distance<<", UB: "<<upper_bound_outside_knn_ij<<"\n";
+            LOG_DEBUG<<"[incremental nns] Performing exhaustive search on "<<index.nr_nodes()<<" nodes. "
+                <<"Found inc. neighbours: "<<nn_ij.size()<<", with max. cost: "<<largest_distance<<", UB: "<<upper_bound_outside_knn_ij<<"\n";
         }
 
         // TODO: Remove root and other nodes? Perhaps not necessary since root and other node become 'inactive' anyway.
-        // nn_graph_[root] = std::unordered_map<size_t, float>();
-        // nn_graph_[other] = std::unordered_map<size_t, float>();
+        // nn_graph_[root] = std::unordered_map<ID, float>();
+        // nn_graph_[other] = std::unordered_map<ID, float>();
 
         // Also add bidirectional edges:
         for (auto const& [nn_new, new_dist] : nn_ij)
@@ -132,16 +139,17 @@ namespace DENSE_MULTICUT {
             min_dist_in_knn_[new_id] = std::min(min_dist_in_knn_[new_id], new_dist);
         }
 
-        std::unordered_map<size_t, float> nn_ij_map(nn_ij.begin(), nn_ij.end());
+        std::unordered_map<ID, float> nn_ij_map(nn_ij.begin(), nn_ij.end());
         // Create new node with id 'new_id' and add its neighbours:
         nn_graph_[new_id] = nn_ij_map;
 
         return nn_ij_map;
     }
 
-    std::vector<std::tuple<size_t, size_t, float>> incremental_nns::recheck_possible_contractions(const feature_index& index)
+    template<typename ID>
+    std::vector<std::tuple<ID, ID, float>> incremental_nns<ID>::recheck_possible_contractions(const feature_index& index)
     {
-        std::vector<std::tuple<size_t, size_t, float>> new_edges;
+        std::vector<std::tuple<ID, ID, float>> new_edges;
         const std::vector<faiss::Index::idx_t> active_nodes = index.get_active_nodes();
         if (active_nodes.size() == 1)
             return new_edges;
@@ -153,11 +161,11 @@ namespace DENSE_MULTICUT {
         size_t index_1d = 0;
         for (size_t idx = 0; idx != active_nodes.size(); ++idx)
         {
-            const size_t i = active_nodes[idx];
+            const ID i = active_nodes[idx];
             for (size_t i_n = 0; i_n != eff_k; ++i_n, ++index_1d)
             {
                 const float current_distance = distances[index_1d];
-                const size_t j = nns[index_1d];
+                const ID j = nns[index_1d];
                 if (current_distance < 0 || !index.node_active(j))
                     continue;
 
@@ -166,4 +174,45 @@ namespace DENSE_MULTICUT {
         }
         return new_edges;
     }
+
+    template<typename ID>
+    void incremental_nns<ID>::serialize(binary_writer& writer) const
+    {
+        writer.write(k_);
+        writer.write_vector(min_dist_in_knn_);
+        writer.write(nn_graph_.size());
+        std::vector<ID> nn_ids;
+        std::vector<float> nn_costs;
+        for (const auto& nns : nn_graph_)
+        {
+            nn_ids.clear();
+            nn_costs.clear();
+            for (const auto& [nn, cost] : nns)
+            {
+                nn_ids.push_back(nn);
+                nn_costs.push_back(cost);
+            }
+            writer.write_vector(nn_ids);
+            writer.write_vector(nn_costs);
+        }
+    }
+
+    template<typename ID>
+    void incremental_nns<ID>::deserialize(binary_reader& reader)
+    {
+        k_ = reader.read<size_t>();
+        min_dist_in_knn_ = reader.read_vector<float>();
+        nn_graph_ = std::vector<std::unordered_map<ID, float>>(reader.read<size_t>());
+        for (auto& nns : nn_graph_)
+        {
+            const std::vector<ID> nn_ids = reader.read_vector<ID>();
+            const std::vector<float> nn_costs = reader.read_vector<float>();
+            nns.reserve(nn_ids.size());
+            for (size_t c = 0; c != nn_ids.size(); ++c)
+                nns.emplace(nn_ids[c], nn_costs[c]);
+        }
+    }
+
+    template class incremental_nns<uint32_t>;
+    template class incremental_nns<size_t>;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "instance_generators.h"
+#include <random>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        void normalize(float* x, const size_t d)
+        {
+            double norm = 0.0;
+            for(size_t l=0; l<d; ++l)
+                norm += double(x[l]) * x[l];
+            norm = std::sqrt(norm);
+            if(norm > 0.0)
+                for(size_t l=0; l<d; ++l)
+                    x[l] /= norm;
+        }
+    }
+
+    synthetic_instance clustered_instance(const size_t d, const std::vector<size_t>& cluster_sizes, const float noise, const unsigned int seed)
+    {
+        if(d == 0)
+            throw std::runtime_error("clustered instance needs at least one dimension");
+        std::mt19937 generator(seed);
+        std::normal_distribution<float> distr(0.0, 1.0);
+
+        synthetic_instance instance;
+        instance.n = std::accumulate(cluster_sizes.begin(), cluster_sizes.end(), size_t(0));
+        instance.d = d;
+        instance.features.resize(instance.n * d);
+        instance.ground_truth.reserve(instance.n);
+
+        std::vector<float> center(d);
+        // per-coordinate noise such that the noise vector has expected length noise.
+        const float coordinate_noise = noise / std::sqrt(float(d));
+        size_t i = 0;
+        for(size_t c=0; c<cluster_sizes.size(); ++c)
+        {
+            for(size_t l=0; l<d; ++l)
+                center[l] = distr(generator);
+            normalize(center.data(), d);
+            for(size_t p=0; p<cluster_sizes[c]; ++p, ++i)
+            {
+                float* x = instance.features.data() + i*d;
+                for(size_t l=0; l<d; ++l)
+                    x[l] = center[l] + coordinate_noise * distr(generator);
+                normalize(x, d);
+                instance.ground_truth.push_back(c);
+            }
+        }
+
+        // shuffle points so that solvers do not see them ordered by cluster.
+        std::vector<size_t> order(instance.n);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), generator);
+        std::vector<float> shuffled_features(instance.n * d);
+        std::vector<size_t> shuffled_ground_truth(instance.n);
+        for(size_t k=0; k<instance.n; ++k)
+        {
+            std::copy(instance.features.begin() + order[k]*d, instance.features.begin() + (order[k]+1)*d, shuffled_features.begin() + k*d);
+            shuffled_ground_truth[k] = instance.ground_truth[order[k]];
+        }
+        instance.features = std::move(shuffled_features);
+        instance.ground_truth = std::move(shuffled_ground_truth);
+        return instance;
+    }
+
+    synthetic_instance gaussian_mixture_instance(const size_t n, const size_t d, const size_t nr_clusters, const float noise, const unsigned int seed)
+    {
+        if(nr_clusters == 0)
+            throw std::runtime_error("gaussian mixture needs at least one cluster");
+        std::vector<size_t> cluster_sizes(nr_clusters, n / nr_clusters);
+        for(size_t c=0; c<n % nr_clusters; ++c)
+            ++cluster_sizes[c];
+        return clustered_instance(d, cluster_sizes, noise, seed);
+    }
+
+    synthetic_instance power_law_instance(const size_t n, const size_t d, const size_t nr_clusters, const float exponent, const float noise, const unsigned int seed)
+    {
+        if(nr_clusters == 0 || nr_clusters > n)
+            throw std::runtime_error("power law instance needs between 1 and n clusters");
+        std::vector<double> weights(nr_clusters);
+        for(size_t c=0; c<nr_clusters; ++c)
+            weights[c] = std::pow(double(c+1), -double(exponent));
+        const double total_weight = std::accumulate(weights.begin(), weights.end(), 0.0);
+
+        // every cluster gets at least one point, the rest is distributed by weight and rounding leftovers go to the largest cluster.
+        std::vector<size_t> cluster_sizes(nr_clusters, 1);
+        const size_t remaining = n - nr_clusters;
+        size_t assigned = 0;
+        for(size_t c=0; c<nr_clusters; ++c)
+        {
+            const size_t extra = size_t(std::floor(remaining * weights[c] / total_weight));
+            cluster_sizes[c] += extra;
+            assigned += extra;
+        }
+        cluster_sizes[0] += remaining - assigned;
+        return clustered_instance(d, cluster_sizes, noise, seed);
+    }
+}
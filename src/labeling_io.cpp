@@ -0,0 +1,213 @@
+#include "labeling_io.h"
+#include "dense_multicut_utils.h"
+#include "time_measure_util.h"
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        using file_ptr = std::unique_ptr<FILE, int(*)(FILE*)>;
+
+        file_ptr open_file(const std::string& path, const char* mode)
+        {
+            file_ptr file(std::fopen(path.c_str(), mode), &std::fclose);
+            if(file == nullptr)
+                throw std::runtime_error("Could not open labeling file " + path);
+            return file;
+        }
+
+        void write_bytes(FILE* file, const void* data, const size_t nr_bytes, const std::string& path)
+        {
+            if(std::fwrite(data, 1, nr_bytes, file) != nr_bytes)
+                throw std::runtime_error("Could not write labeling file " + path);
+        }
+
+        template<typename T>
+        void write_value(FILE* file, const T value, const std::string& path)
+        {
+            write_bytes(file, &value, sizeof(T), path);
+        }
+
+        void read_bytes(FILE* file, void* data, const size_t nr_bytes, const std::string& path)
+        {
+            if(std::fread(data, 1, nr_bytes, file) != nr_bytes)
+                throw std::runtime_error("Truncated binary labeling file " + path);
+        }
+
+        template<typename T>
+        T read_value(FILE* file, const std::string& path)
+        {
+            T value;
+            read_bytes(file, &value, sizeof(T), path);
+            return value;
+        }
+
+        // ids are converted block by block, so that the conversion buffer stays small.
+        template<typename ID>
+        void write_ids(FILE* file, const std::vector<size_t>& ids, const std::string& path)
+        {
+            constexpr size_t block_size = size_t(1) << 20;
+            std::vector<ID> buffer(std::min(block_size, ids.size()));
+            for(size_t begin=0; begin<ids.size(); begin+=block_size)
+            {
+                const size_t end = std::min(ids.size(), begin + block_size);
+#pragma omp parallel for schedule(static)
+                for(size_t i=begin; i<end; ++i)
+                    buffer[i-begin] = ID(ids[i]);
+                write_bytes(file, buffer.data(), (end - begin) * sizeof(ID), path);
+            }
+        }
+
+        void write_text_labeling(const std::string& path, const std::vector<size_t>& labeling)
+        {
+            file_ptr file = open_file(path, "w");
+            // digits of the largest label and the newline.
+            constexpr size_t max_line_size = std::numeric_limits<size_t>::digits10 + 2;
+            std::vector<char> buffer(size_t(1) << 20);
+            char* const buffer_end = buffer.data() + buffer.size();
+            char* pos = buffer.data();
+            for(const size_t label : labeling)
+            {
+                if(size_t(buffer_end - pos) < max_line_size)
+                {
+                    write_bytes(file.get(), buffer.data(), pos - buffer.data(), path);
+                    pos = buffer.data();
+                }
+                const auto [end, ec] = std::to_chars(pos, buffer_end, label);
+                if(ec != std::errc() || end == buffer_end)
+                    throw std::runtime_error("Could not format label " + std::to_string(label) + " for labeling file " + path);
+                *end = '\n';
+                pos = end + 1;
+            }
+            write_bytes(file.get(), buffer.data(), pos - buffer.data(), path);
+        }
+
+        void write_binary_labeling(const std::string& path, const std::vector<size_t>& labeling, const bool with_cluster_sizes)
+        {
+            std::vector<size_t> contiguous;
+            const size_t nr_clusters = contiguous_labeling(labeling, contiguous);
+            const uint32_t id_bytes = nr_clusters <= std::numeric_limits<uint32_t>::max() ? 4 : 8;
+
+            file_ptr file = open_file(path, "wb");
+            write_bytes(file.get(), binary_labeling_magic, sizeof(binary_labeling_magic), path);
+            write_value<uint32_t>(file.get(), binary_labeling_version, path);
+            write_value<uint64_t>(file.get(), labeling.size(), path);
+            write_value<uint64_t>(file.get(), nr_clusters, path);
+            write_value<uint32_t>(file.get(), id_bytes, path);
+            write_value<uint32_t>(file.get(), with_cluster_sizes ? binary_labeling_has_cluster_sizes : 0, path);
+            if(id_bytes == 4)
+                write_ids<uint32_t>(file.get(), contiguous, path);
+            else
+                write_ids<uint64_t>(file.get(), contiguous, path);
+            if(with_cluster_sizes)
+                write_ids<uint64_t>(file.get(), cluster_sizes(contiguous, nr_clusters), path);
+        }
+
+        bool is_binary_labeling(const std::string& path)
+        {
+            std::ifstream f(path, std::ios::binary);
+            if(!f.is_open())
+                throw std::runtime_error("Could not open labeling file " + path);
+            char magic[sizeof(binary_labeling_magic)] = {};
+            f.read(magic, sizeof(magic));
+            return f.gcount() == sizeof(magic) && std::memcmp(magic, binary_labeling_magic, sizeof(magic)) == 0;
+        }
+
+        struct binary_labeling_header {
+            uint64_t n;
+            uint64_t nr_clusters;
+            uint32_t id_bytes;
+            uint32_t flags;
+        };
+
+        binary_labeling_header read_binary_header(FILE* file, const std::string& path)
+        {
+            char magic[sizeof(binary_labeling_magic)];
+            read_bytes(file, magic, sizeof(magic), path);
+            if(read_value<uint32_t>(file, path) != binary_labeling_version)
+                throw std::runtime_error("Unsupported binary labeling version in " + path);
+            binary_labeling_header header;
+            header.n = read_value<uint64_t>(file, path);
+            header.nr_clusters = read_value<uint64_t>(file, path);
+            header.id_bytes = read_value<uint32_t>(file, path);
+            header.flags = read_value<uint32_t>(file, path);
+            if(header.id_bytes != 4 && header.id_bytes != 8)
+                throw std::runtime_error("Invalid id width in binary labeling " + path);
+            return header;
+        }
+
+        template<typename ID>
+        std::vector<size_t> read_ids(FILE* file, const size_t nr_ids, const std::string& path)
+        {
+            std::vector<ID> ids(nr_ids);
+            read_bytes(file, ids.data(), nr_ids * sizeof(ID), path);
+            return std::vector<size_t>(ids.begin(), ids.end());
+        }
+    }
+
+    labeling_format labeling_format_from_string(const std::string& s)
+    {
+        if(s == "text")
+            return labeling_format::text;
+        if(s == "binary")
+            return labeling_format::binary;
+        throw std::runtime_error("Unknown labeling format " + s + ", expected text or binary");
+    }
+
+    std::vector<size_t> cluster_sizes(const std::vector<size_t>& contiguous, const size_t nr_clusters)
+    {
+        // a serial pass is memory bound already, atomic increments from several threads contend on the counters of large clusters.
+        std::vector<size_t> sizes(nr_clusters, 0);
+        for(const size_t c : contiguous)
+            ++sizes[c];
+        return sizes;
+    }
+
+    void write_labeling(const std::string& path, const std::vector<size_t>& labeling, const labeling_format format, const bool with_cluster_sizes)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        if(format == labeling_format::binary)
+            write_binary_labeling(path, labeling, with_cluster_sizes);
+        else if(with_cluster_sizes)
+            throw std::runtime_error("Cluster sizes are only written in binary labeling format");
+        else
+            write_text_labeling(path, labeling);
+    }
+
+    std::vector<size_t> read_labeling(const std::string& path)
+    {
+        if(!is_binary_labeling(path))
+        {
+            std::ifstream f(path);
+            std::vector<size_t> labeling;
+            size_t label;
+            while (f >> label)
+                labeling.push_back(label);
+            if (!f.eof())
+                throw std::runtime_error("Could not parse label " + std::to_string(labeling.size()) + " in " + path);
+            return labeling;
+        }
+        file_ptr file = open_file(path, "rb");
+        const binary_labeling_header header = read_binary_header(file.get(), path);
+        return header.id_bytes == 4 ? read_ids<uint32_t>(file.get(), header.n, path) : read_ids<uint64_t>(file.get(), header.n, path);
+    }
+
+    std::vector<size_t> read_cluster_sizes(const std::string& path)
+    {
+        if(!is_binary_labeling(path))
+            return {};
+        file_ptr file = open_file(path, "rb");
+        const binary_labeling_header header = read_binary_header(file.get(), path);
+        if(!(header.flags & binary_labeling_has_cluster_sizes))
+            return {};
+        if(std::fseek(file.get(), header.n * header.id_bytes, SEEK_CUR) != 0)
+            throw std::runtime_error("Truncated binary labeling file " + path);
+        return read_ids<uint64_t>(file.get(), header.nr_clusters, path);
+    }
+}
@@ -0,0 +1,243 @@
+#include "local_search.h"
+#include "dense_multicut_utils.h"
+#include "time_measure_util.h"
+#include "log.h"
+#include <faiss/index_factory.h>
+#include <faiss/Index.h>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <limits>
+#include <chrono>
+#include <cassert>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        // Cost of joining f and s, with the offset dimension negated when tracking the distance offset.
+        template<typename T>
+        double signed_inner_product(const float* f, const T* s, const size_t d, const bool track_dist_offset)
+        {
+            double x = 0.0;
+            for(size_t l=0; l+1<d; ++l)
+                x += double(f[l]) * s[l];
+            return track_dist_offset ? x - double(f[d-1]) * s[d-1] : x + double(f[d-1]) * s[d-1];
+        }
+
+        struct node_move {
+            double gain;
+            size_t node;
+            size_t target;
+        };
+    }
+
+    local_search_result local_search(const size_t n, const size_t d, const std::vector<float>& features, const bool track_dist_offset, const std::vector<size_t>& labeling,
+            const local_search_options& options)
+    {
+        MEASURE_FUNCTION_EXECUTION_TIME;
+        if(labeling.size() != n)
+            throw std::runtime_error("labeling has " + std::to_string(labeling.size()) + " entries for " + std::to_string(n) + " nodes");
+        assert(features.size() == n*d && d > 0);
+        constexpr size_t no_cluster = std::numeric_limits<size_t>::max();
+        // target of a move to a new singleton cluster.
+        constexpr size_t new_cluster = no_cluster - 1;
+
+        // one sum per cluster id, ids of emptied clusters are reused and new ids are only added for singletons when none is free.
+        // Sums are kept in double, moves only add and subtract rows.
+        local_search_result result;
+        std::vector<size_t>& label = result.labels;
+        const size_t nr_initial_clusters = contiguous_labeling(labeling, label);
+        std::vector<double> sums(nr_initial_clusters*d, 0.0);
+        std::vector<size_t> sizes(nr_initial_clusters, 0);
+        for(size_t i=0; i<n; ++i)
+        {
+            for(size_t l=0; l<d; ++l)
+                sums[label[i]*d + l] += features[i*d + l];
+            ++sizes[label[i]];
+        }
+        std::vector<size_t> free_ids;
+
+        // cut edges are all pairs minus pairs within clusters, i.e. (<S,S> - sum <S_c,S_c>)/2 in the signed inner product.
+        {
+            std::vector<double> total_sum(d, 0.0);
+            double cluster_sum_squares = 0.0;
+            for(size_t c=0; c<nr_initial_clusters; ++c)
+            {
+                double squared_norm = 0.0;
+                for(size_t l=0; l<d; ++l)
+                {
+                    total_sum[l] += sums[c*d + l];
+                    squared_norm += (l+1 == d && track_dist_offset ? -1.0 : 1.0) * sums[c*d + l] * sums[c*d + l];
+                }
+                cluster_sum_squares += squared_norm;
+            }
+            double total_sum_squares = 0.0;
+            for(size_t l=0; l<d; ++l)
+                total_sum_squares += (l+1 == d && track_dist_offset ? -1.0 : 1.0) * total_sum[l] * total_sum[l];
+            result.initial_objective = 0.5 * (total_sum_squares - cluster_sum_squares);
+        }
+        double objective = result.initial_objective;
+        LOG_INFO << "[local search] " << n << " nodes in " << nr_initial_clusters << " clusters, objective " << objective << "\n";
+
+        std::vector<char> locked(nr_initial_clusters, false);
+        std::vector<char> pending(n, true);
+        std::vector<size_t> best_target(n);
+        std::vector<double> best_gain(n);
+        for(size_t sweep=0; sweep<options.max_sweeps && n > 1; ++sweep)
+        {
+            const auto sweep_begin = std::chrono::steady_clock::now();
+            const double sweep_objective = objective;
+
+            // candidate targets: clusters whose sum has the largest inner product with the node.
+            std::vector<size_t> cluster_of_row;
+            std::vector<float> rows;
+            for(size_t c=0; c<sizes.size(); ++c)
+                if(sizes[c] > 0)
+                {
+                    cluster_of_row.push_back(c);
+                    for(size_t l=0; l<d; ++l)
+                        rows.push_back(l+1 == d && track_dist_offset ? -sums[c*d + l] : sums[c*d + l]);
+                }
+            const size_t k = std::min(options.nr_candidates + 1, cluster_of_row.size());
+            std::vector<size_t> candidates(n*k, no_cluster);
+            {
+                std::unique_ptr<faiss::Index> index(faiss::index_factory(d, options.index_str.c_str(), faiss::MetricType::METRIC_INNER_PRODUCT));
+                if(!index->is_trained)
+                    index->train(cluster_of_row.size(), rows.data());
+                index->add(cluster_of_row.size(), rows.data());
+                std::vector<faiss::Index::idx_t> nns(n*k);
+                std::vector<float> distances(n*k);
+                index->search(n, features.data(), k, distances.data(), nns.data());
+                for(size_t c=0; c<n*k; ++c)
+                    if(nns[c] >= 0)
+                        candidates[c] = cluster_of_row[nns[c]];
+            }
+
+            std::fill(pending.begin(), pending.end(), true);
+            size_t nr_moves = 0;
+            size_t nr_batches = 0;
+            std::vector<node_move> moves;
+            for(; nr_batches<options.max_batches_per_sweep; ++nr_batches)
+            {
+                // best move of every pending node against the current sums. Gains of other nodes have not changed.
+#pragma omp parallel for schedule(dynamic, 256)
+                for(size_t v=0; v<n; ++v)
+                {
+                    if(!pending[v])
+                        continue;
+                    best_target[v] = no_cluster;
+                    best_gain[v] = 0.0;
+                    const float* f = features.data() + v*d;
+                    const size_t a = label[v];
+                    // joining cost of v with the rest of its cluster, lost by every move.
+                    const double stay = signed_inner_product(f, sums.data() + a*d, d, track_dist_offset) - signed_inner_product(f, f, d, track_dist_offset);
+                    for(size_t c=0; c<k; ++c)
+                    {
+                        const size_t b = candidates[v*k + c];
+                        // emptied clusters are free ids, only taken by singleton moves.
+                        if(b == no_cluster || b == a || sizes[b] == 0)
+                            continue;
+                        const double gain = signed_inner_product(f, sums.data() + b*d, d, track_dist_offset) - stay;
+                        if(gain > best_gain[v])
+                        {
+                            best_gain[v] = gain;
+                            best_target[v] = b;
+                        }
+                    }
+                    if(sizes[a] > 1 && -stay > best_gain[v])
+                    {
+                        best_gain[v] = -stay;
+                        best_target[v] = new_cluster;
+                    }
+                }
+
+                moves.clear();
+                for(size_t v=0; v<n; ++v)
+                    if(pending[v] && best_target[v] != no_cluster && best_gain[v] > 1e-9 * std::max(1.0, std::abs(objective) / n))
+                        moves.push_back({best_gain[v], v, best_target[v]});
+                if(moves.empty())
+                    break;
+
+                // best moves first, each cluster may be changed by one move per batch.
+                std::sort(moves.begin(), moves.end(), [](const node_move& x, const node_move& y) { return x.gain > y.gain; });
+                size_t nr_accepted = 0;
+                for(const node_move& m : moves)
+                {
+                    const size_t a = label[m.node];
+                    if(locked[a])
+                        continue;
+                    size_t b = m.target;
+                    if(b == new_cluster)
+                    {
+                        if(free_ids.empty())
+                        {
+                            free_ids.push_back(sizes.size());
+                            sums.resize(sums.size() + d, 0.0);
+                            sizes.push_back(0);
+                            locked.push_back(false);
+                        }
+                        b = free_ids.back();
+                        free_ids.pop_back();
+                    }
+                    else if(locked[b])
+                        continue;
+                    locked[a] = true;
+                    locked[b] = true;
+                    moves[nr_accepted++] = {m.gain, m.node, b};
+                }
+                moves.resize(nr_accepted);
+
+#pragma omp parallel for schedule(static)
+                for(size_t c=0; c<moves.size(); ++c)
+                {
+                    const size_t v = moves[c].node;
+                    const size_t a = label[v];
+                    const size_t b = moves[c].target;
+                    for(size_t l=0; l<d; ++l)
+                    {
+                        sums[a*d + l] -= features[v*d + l];
+                        sums[b*d + l] += features[v*d + l];
+                    }
+                    --sizes[a];
+                    ++sizes[b];
+                }
+                // labels are changed afterwards, the update above reads the source clusters.
+                for(const node_move& m : moves)
+                {
+                    const size_t a = label[m.node];
+                    objective -= m.gain;
+                    if(sizes[a] == 0)
+                        free_ids.push_back(a);
+                    label[m.node] = m.target;
+                }
+                nr_moves += moves.size();
+
+                // nodes of changed clusters and nodes with a changed candidate are evaluated again.
+#pragma omp parallel for schedule(static)
+                for(size_t v=0; v<n; ++v)
+                {
+                    bool changed = locked[label[v]];
+                    for(size_t c=0; c<k && !changed; ++c)
+                        changed = candidates[v*k + c] != no_cluster && locked[candidates[v*k + c]];
+                    pending[v] = changed;
+                }
+                std::fill(locked.begin(), locked.end(), false);
+            }
+
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sweep_begin).count();
+            result.sweeps.push_back({objective, nr_moves, nr_batches, seconds});
+            METRICS_COUNTER_ADD("local search moves", nr_moves);
+            LOG_INFO << "[local search] sweep " << sweep << ": objective " << objective << ", " << nr_moves << " moves in " << nr_batches << " batches, " << seconds << " s\n";
+            if(nr_moves == 0 || sweep_objective - objective < options.min_relative_improvement * std::abs(sweep_objective))
+                break;
+        }
+
+        // moves leave gaps in the cluster ids.
+        std::vector<size_t> contiguous;
+        contiguous_labeling(label, contiguous);
+        label = std::move(contiguous);
+        result.objective = objective;
+        return result;
+    }
+}
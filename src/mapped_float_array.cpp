@@ -0,0 +1,144 @@
+#include "mapped_float_array.h"
+#include "time_measure_util.h"
+#include "log.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        std::runtime_error system_error(const std::string& what, const std::string& path)
+        {
+            return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+        }
+
+        size_t page_size()
+        {
+            static const size_t size = sysconf(_SC_PAGESIZE);
+            return size;
+        }
+
+        void page_faults(long& minor_faults, long& major_faults)
+        {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            minor_faults = usage.ru_minflt;
+            major_faults = usage.ru_majflt;
+        }
+    }
+
+    mapped_float_array::mapped_float_array(const std::string& path, const size_t memory_budget_bytes)
+        : path_(path),
+        memory_budget_bytes_(memory_budget_bytes)
+    {
+        fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if(fd_ < 0)
+            throw system_error("cannot create feature file", path);
+        // the mapping keeps the file alive, no name is needed after opening.
+        if(unlink(path.c_str()) != 0)
+        {
+            close(fd_);
+            throw system_error("cannot unlink feature file", path);
+        }
+        page_faults(minor_faults_, major_faults_);
+        LOG_INFO << "[feature storage] rows in file " << path_ << (memory_budget_bytes_ > 0 ? " with memory budget " + std::to_string(memory_budget_bytes_ >> 20) + " MiB" : "") << "\n";
+    }
+
+    mapped_float_array::~mapped_float_array()
+    {
+        long minor_faults, major_faults;
+        page_faults(minor_faults, major_faults);
+        LOG_INFO << "[feature storage] " << size_ * sizeof(float) / 1e6 << " MB in " << path_ << ", " << nr_releases_ << " releases of resident pages, page faults of the whole process since creation: "
+            << major_faults - major_faults_ << " major, " << minor_faults - minor_faults_ << " minor\n";
+        if(data_ != nullptr)
+            munmap(data_, capacity_ * sizeof(float));
+        close(fd_);
+    }
+
+    void mapped_float_array::map(const size_t capacity)
+    {
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME;
+        if(data_ != nullptr && munmap(data_, capacity_ * sizeof(float)) != 0)
+            throw system_error("cannot unmap", path_);
+        data_ = nullptr;
+        // the file is sparse, blocks are only allocated when rows are written.
+        if(ftruncate(fd_, capacity * sizeof(float)) != 0)
+            throw system_error("cannot grow", path_);
+        void* p = mmap(nullptr, capacity * sizeof(float), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if(p == MAP_FAILED)
+            throw system_error("cannot map", path_);
+        data_ = static_cast<float*>(p);
+        capacity_ = capacity;
+    }
+
+    void mapped_float_array::resize(const size_t size)
+    {
+        if(size > capacity_)
+        {
+            const size_t floats_per_page = page_size() / sizeof(float);
+            const size_t capacity = std::max(size, 2*capacity_);
+            map((capacity + floats_per_page - 1) / floats_per_page * floats_per_page);
+        }
+        if(size > size_)
+            bytes_since_check_ += (size - size_) * sizeof(float);
+        size_ = size;
+        enforce_memory_budget();
+    }
+
+    void mapped_float_array::note_read(const size_t bytes) const
+    {
+        if(memory_budget_bytes_ == 0)
+            return;
+        bytes_since_check_.fetch_add(bytes, std::memory_order_relaxed);
+        enforce_memory_budget();
+    }
+
+    size_t mapped_float_array::resident_bytes() const
+    {
+        if(data_ == nullptr)
+            return 0;
+        const size_t nr_pages = (capacity_ * sizeof(float) + page_size() - 1) / page_size();
+        std::vector<unsigned char> resident(nr_pages);
+        if(mincore(data_, capacity_ * sizeof(float), resident.data()) != 0)
+            return 0;
+        return std::count_if(resident.begin(), resident.end(), [](const unsigned char r) { return r & 1; }) * page_size();
+    }
+
+    void mapped_float_array::enforce_memory_budget() const
+    {
+        // residency is only checked after an eighth of the budget was appended or read, since mincore walks the whole mapping.
+        if(memory_budget_bytes_ == 0 || bytes_since_check_.load(std::memory_order_relaxed) < std::max(memory_budget_bytes_ / 8, page_size()))
+            return;
+        std::unique_lock<std::mutex> lock(check_mutex_, std::try_to_lock);
+        if(!lock.owns_lock())
+            return;
+        bytes_since_check_.store(0, std::memory_order_relaxed);
+        const size_t resident = resident_bytes();
+        METRICS_GAUGE_SET("feature storage resident MB", resident / 1e6);
+        if(resident <= memory_budget_bytes_)
+            return;
+        MEASURE_CUMULATIVE_FUNCTION_EXECUTION_TIME2("feature storage release");
+        // written back first, so that the page cache can drop the pages as well. Concurrent readers fault the pages back in from the file.
+        if(msync(data_, capacity_ * sizeof(float), MS_SYNC) != 0)
+            throw system_error("cannot write back", path_);
+        if(madvise(data_, capacity_ * sizeof(float), MADV_DONTNEED) != 0)
+            throw system_error("cannot release pages of", path_);
+        // only advisory, the pages stay cached if the kernel ignores it.
+        if(const int error = posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED); error != 0)
+            LOG_DEBUG << "[feature storage] posix_fadvise on " << path_ << " failed: " << std::strerror(error) << "\n";
+        ++nr_releases_;
+        long minor_faults, major_faults;
+        page_faults(minor_faults, major_faults);
+        METRICS_COUNTER_ADD("feature storage releases", 1);
+        METRICS_GAUGE_SET("process major page faults", major_faults - major_faults_);
+        METRICS_GAUGE_SET("process minor page faults", minor_faults - minor_faults_);
+        LOG_DEBUG << "[feature storage] released " << resident / 1e6 << " MB resident of " << path_ << "\n";
+    }
+}
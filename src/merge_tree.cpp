@@ -0,0 +1,226 @@
+#include "merge_tree.h"
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        constexpr char merge_tree_magic[4] = {'D','M','M','T'};
+        constexpr uint32_t merge_tree_version = 1;
+
+        template<typename ID_TYPE>
+        void write_ids(std::ofstream& f, const std::vector<merge_tree::contraction>& contractions)
+        {
+            std::vector<ID_TYPE> ids(2 * contractions.size());
+            for(size_t c=0; c<contractions.size(); ++c)
+            {
+                ids[2*c] = contractions[c].i;
+                ids[2*c+1] = contractions[c].j;
+            }
+            f.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(ID_TYPE));
+        }
+
+        template<typename ID_TYPE>
+        std::vector<size_t> read_ids(std::ifstream& f, const size_t m)
+        {
+            std::vector<ID_TYPE> ids(2 * m);
+            f.read(reinterpret_cast<char*>(ids.data()), ids.size() * sizeof(ID_TYPE));
+            return std::vector<size_t>(ids.begin(), ids.end());
+        }
+    }
+
+    merge_tree::merge_tree(const size_t n, const float dist_offset)
+    {
+        init(n, dist_offset);
+    }
+
+    void merge_tree::init(const size_t n, const float dist_offset)
+    {
+        n_ = n;
+        dist_offset_ = dist_offset;
+        contractions_.clear();
+        contractions_.reserve(n > 0 ? n - 1 : 0);
+        sizes_.assign(n, 1);
+        sizes_.reserve(n > 0 ? 2 * n - 1 : 0);
+    }
+
+    void merge_tree::add_contraction(const size_t i, const size_t j, const size_t new_id, const float cost, const float runner_up_cost)
+    {
+        assert(i != j);
+        assert(i < sizes_.size() && j < sizes_.size());
+        if(new_id != n_ + contractions_.size())
+            throw std::runtime_error("merge tree expects consecutive ids for contracted nodes");
+        contractions_.push_back({i, j, new_id, cost, runner_up_cost, sizes_[i], sizes_[j]});
+        sizes_.push_back(sizes_[i] + sizes_[j]);
+    }
+
+    std::vector<size_t> merge_tree::labeling(const size_t nr_contractions) const
+    {
+        assert(nr_contractions <= contractions_.size());
+        // propagate the id of the topmost applied contraction down to the leaves.
+        std::vector<size_t> top(n_ + nr_contractions);
+        std::iota(top.begin(), top.end(), 0);
+        for(size_t c=nr_contractions; c-- > 0;)
+        {
+            const contraction& e = contractions_[c];
+            top[e.i] = top[e.new_id];
+            top[e.j] = top[e.new_id];
+        }
+        top.resize(n_);
+        return top;
+    }
+
+    std::vector<size_t> merge_tree::labeling_with_nr_clusters(const size_t nr_clusters) const
+    {
+        const size_t min_nr_clusters = n_ - contractions_.size();
+        if(nr_clusters < min_nr_clusters)
+            throw std::runtime_error("merge tree has at least " + std::to_string(min_nr_clusters) + " clusters");
+        return labeling(n_ - nr_clusters);
+    }
+
+    void merge_tree::write(const std::string& file_path) const
+    {
+        std::ofstream f(file_path, std::ios::binary);
+        if(!f.is_open())
+            throw std::runtime_error("Could not open merge tree file " + file_path);
+
+        const uint64_t n = n_;
+        const uint64_t m = contractions_.size();
+        const uint8_t id_bytes = n_ + contractions_.size() <= std::numeric_limits<uint32_t>::max() ? 4 : 8;
+        f.write(merge_tree_magic, sizeof(merge_tree_magic));
+        f.write(reinterpret_cast<const char*>(&merge_tree_version), sizeof(merge_tree_version));
+        f.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        f.write(reinterpret_cast<const char*>(&m), sizeof(m));
+        f.write(reinterpret_cast<const char*>(&dist_offset_), sizeof(dist_offset_));
+        f.write(reinterpret_cast<const char*>(&id_bytes), sizeof(id_bytes));
+
+        if(id_bytes == 4)
+            write_ids<uint32_t>(f, contractions_);
+        else
+            write_ids<uint64_t>(f, contractions_);
+
+        std::vector<float> costs(2 * m);
+        for(size_t c=0; c<m; ++c)
+        {
+            costs[c] = contractions_[c].cost;
+            costs[m + c] = contractions_[c].runner_up_cost;
+        }
+        f.write(reinterpret_cast<const char*>(costs.data()), costs.size() * sizeof(float));
+    }
+
+    merge_tree merge_tree::read(const std::string& file_path)
+    {
+        std::ifstream f(file_path, std::ios::binary);
+        if(!f.is_open())
+            throw std::runtime_error("Could not open merge tree file " + file_path);
+
+        char magic[4];
+        uint32_t version;
+        uint64_t n, m;
+        float dist_offset;
+        uint8_t id_bytes;
+        f.read(magic, sizeof(magic));
+        f.read(reinterpret_cast<char*>(&version), sizeof(version));
+        f.read(reinterpret_cast<char*>(&n), sizeof(n));
+        f.read(reinterpret_cast<char*>(&m), sizeof(m));
+        f.read(reinterpret_cast<char*>(&dist_offset), sizeof(dist_offset));
+        f.read(reinterpret_cast<char*>(&id_bytes), sizeof(id_bytes));
+        if(!f || std::memcmp(magic, merge_tree_magic, sizeof(magic)) != 0 || version != merge_tree_version)
+            throw std::runtime_error("Invalid merge tree file " + file_path);
+        if(m >= n && n > 0)
+            throw std::runtime_error("Merge tree file " + file_path + " has more contractions than nodes");
+        if(id_bytes != 4 && id_bytes != 8)
+            throw std::runtime_error("Invalid id width " + std::to_string(id_bytes) + " in merge tree file " + file_path);
+
+        const std::vector<size_t> ids = id_bytes == 4 ? read_ids<uint32_t>(f, m) : read_ids<uint64_t>(f, m);
+        std::vector<float> costs(2 * m);
+        f.read(reinterpret_cast<char*>(costs.data()), costs.size() * sizeof(float));
+        if(!f)
+            throw std::runtime_error("Truncated merge tree file " + file_path);
+
+        // the c-th contraction may only join distinct nodes that exist before it, i.e. leaves or clusters n, ..., n+c-1, and were not contracted yet.
+        std::vector<char> contracted(n + m, false);
+        for(size_t c=0; c<m; ++c)
+        {
+            const size_t i = ids[2*c];
+            const size_t j = ids[2*c+1];
+            if(i >= n + c || j >= n + c || i == j || contracted[i] || contracted[j])
+                throw std::runtime_error("Merge tree file " + file_path + " has invalid contraction " + std::to_string(c) + " of nodes " + std::to_string(i) + " and " + std::to_string(j));
+            contracted[i] = true;
+            contracted[j] = true;
+        }
+
+        merge_tree tree(n, dist_offset);
+        for(size_t c=0; c<m; ++c)
+            tree.add_contraction(ids[2*c], ids[2*c+1], n + c, costs[c], costs[m + c]);
+        return tree;
+    }
+
+    void merge_tree::serialize(binary_writer& writer) const
+    {
+        writer.write(n_);
+        writer.write(dist_offset_);
+        writer.write_vector(contractions_);
+        writer.write_vector(sizes_);
+    }
+
+    void merge_tree::deserialize(binary_reader& reader)
+    {
+        n_ = reader.read<size_t>();
+        dist_offset_ = reader.read<float>();
+        contractions_ = reader.read_vector<contraction>();
+        sizes_ = reader.read_vector<size_t>();
+    }
+
+    std::vector<threshold_sweep_result> threshold_sweep(const merge_tree& tree, const std::vector<float>& dist_offsets)
+    {
+        std::vector<threshold_sweep_result> results;
+        results.reserve(dist_offsets.size());
+        const std::vector<merge_tree::contraction>& contractions = tree.contractions();
+        for(const float t : dist_offsets)
+        {
+            // the solve offset is recovered as square of the offset feature, allow for its rounding error.
+            const double tolerance = 1e-6 * std::max(1.0f, tree.dist_offset());
+            if(t < tree.dist_offset() - tolerance)
+                throw std::runtime_error("threshold sweep cannot answer offset " + std::to_string(t) + " below the solve offset " + std::to_string(tree.dist_offset()));
+
+            const double delta = t - tree.dist_offset() > tolerance ? t - tree.dist_offset() : 0.0;
+            auto cost_at_offset = [&](const merge_tree::contraction& e) {
+                return e.cost - delta * double(e.size_i) * double(e.size_j);
+            };
+
+            size_t prefix = 0;
+            while(prefix < contractions.size() && cost_at_offset(contractions[prefix]) > 0.0)
+                ++prefix;
+
+            // replay the greedy choices: competing edges have size product >= 1, so their cost at offset t is at most runner_up_cost - delta.
+            size_t first_uncertain = contractions.size();
+            if(delta > 0.0)
+            {
+                for(size_t c=0; c<contractions.size(); ++c)
+                {
+                    const double competitor_bound = contractions[c].runner_up_cost - delta;
+                    const double cost = cost_at_offset(contractions[c]);
+                    const bool same_choice = cost > 0.0 ? cost >= competitor_bound : competitor_bound <= 0.0;
+                    if(!same_choice)
+                    {
+                        first_uncertain = c;
+                        break;
+                    }
+                    if(cost <= 0.0)
+                        break;
+                }
+            }
+            const bool exact = first_uncertain == contractions.size();
+
+            results.push_back({t, tree.labeling(prefix), prefix, exact, first_uncertain});
+        }
+        return results;
+    }
+}
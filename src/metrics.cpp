@@ -0,0 +1,176 @@
+#include "metrics.h"
+#include "log.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        const char* kind_name(const metric_kind kind)
+        {
+            switch(kind)
+            {
+                case metric_kind::counter: return "counter";
+                case metric_kind::gauge: return "gauge";
+                case metric_kind::timer: return "timer";
+                case metric_kind::histogram: return "histogram";
+            }
+            return "unknown";
+        }
+
+        // JSON has no infinities, metrics without values report 0.
+        double finite_or_zero(const metric_snapshot& m, const double value)
+        {
+            return m.count > 0 && std::isfinite(value) ? value : 0.0;
+        }
+
+        std::string json_escape(const std::string& str)
+        {
+            std::stringstream s;
+            for(const char c : str)
+            {
+                if(c == '"' || c == '\\')
+                    s << '\\' << c;
+                else if(static_cast<unsigned char>(c) < 0x20)
+                    s << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c);
+                else
+                    s << c;
+            }
+            return s.str();
+        }
+
+        // quotes inside CSV fields are doubled.
+        std::string csv_escape(const std::string& str)
+        {
+            std::string escaped;
+            for(const char c : str)
+            {
+                if(c == '"')
+                    escaped += '"';
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        double rate(const metrics_snapshot& snapshot, const metric_snapshot& m)
+        {
+            return m.kind == metric_kind::counter && snapshot.uptime > 0.0 ? m.sum / snapshot.uptime : 0.0;
+        }
+    }
+
+    std::string metrics_json(const metrics_snapshot& snapshot)
+    {
+        std::stringstream s;
+        s << std::setprecision(9);
+        s << "{\"uptime_seconds\": " << snapshot.uptime << ", \"metrics\": [";
+        for(size_t c=0; c<snapshot.metrics.size(); ++c)
+        {
+            const metric_snapshot& m = snapshot.metrics[c];
+            s << (c > 0 ? ",\n" : "\n");
+            s << "  {\"name\": \"" << json_escape(m.name) << "\", \"kind\": \"" << kind_name(m.kind) << "\""
+                << ", \"count\": " << m.count
+                << ", \"sum\": " << m.sum
+                << ", \"mean\": " << m.mean();
+            // counters only keep count and sum.
+            if(m.kind == metric_kind::counter)
+                s << ", \"rate_per_second\": " << rate(snapshot, m) << "}";
+            else
+                s << ", \"min\": " << finite_or_zero(m, m.min)
+                    << ", \"max\": " << finite_or_zero(m, m.max)
+                    << ", \"last\": " << m.last
+                    << ", \"p50\": " << m.quantile(0.5)
+                    << ", \"p90\": " << m.quantile(0.9)
+                    << ", \"p99\": " << m.quantile(0.99) << "}";
+        }
+        s << "\n]}\n";
+        return s.str();
+    }
+
+    std::string metrics_csv(const metrics_snapshot& snapshot)
+    {
+        std::stringstream s;
+        s << std::setprecision(9);
+        s << "uptime_seconds,name,kind,count,sum,mean,min,max,last,rate_per_second,p50,p90,p99\n";
+        for(const metric_snapshot& m : snapshot.metrics)
+        {
+            s << snapshot.uptime << ",\"" << csv_escape(m.name) << "\"," << kind_name(m.kind) << "," << m.count << "," << m.sum << "," << m.mean() << ",";
+            // counters leave the distribution columns empty.
+            if(m.kind == metric_kind::counter)
+                s << ",,," << rate(snapshot, m) << ",,,\n";
+            else
+                s << finite_or_zero(m, m.min) << "," << finite_or_zero(m, m.max) << "," << m.last << "," << rate(snapshot, m) << ","
+                    << m.quantile(0.5) << "," << m.quantile(0.9) << "," << m.quantile(0.99) << "\n";
+        }
+        return s.str();
+    }
+
+    void write_metrics(const metrics_snapshot& snapshot, const std::string& file_path)
+    {
+        const bool csv = std::filesystem::path(file_path).extension() == ".csv";
+        // write to a temporary file first, so that scrapers never see a partial snapshot.
+        const std::string tmp_path = file_path + ".tmp";
+        {
+            std::ofstream f(tmp_path);
+            if(!f.is_open())
+                throw std::runtime_error("Could not open metrics file " + tmp_path);
+            f << (csv ? metrics_csv(snapshot) : metrics_json(snapshot));
+        }
+        std::filesystem::rename(tmp_path, file_path);
+    }
+
+    struct metrics_reporter::impl {
+        std::string file_path;
+        double interval_seconds;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stop = false;
+
+        void report()
+        {
+            try
+            {
+                write_metrics(metrics_registry::instance().snapshot(), file_path);
+            }
+            catch(const std::exception& e)
+            {
+                LOG_WARNING << "[metrics] " << e.what() << "\n";
+            }
+        }
+
+        void report_loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!cv.wait_for(lock, std::chrono::duration<double>(interval_seconds), [&]() { return stop; }))
+                report();
+        }
+    };
+
+    metrics_reporter::metrics_reporter(const std::string& file_path, const double interval_seconds)
+        : impl_(std::make_unique<impl>())
+    {
+        impl_->file_path = file_path;
+        impl_->interval_seconds = interval_seconds;
+        if(interval_seconds > 0.0)
+            impl_->thread = std::thread(&impl::report_loop, impl_.get());
+    }
+
+    metrics_reporter::~metrics_reporter()
+    {
+        if(impl_->thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(impl_->mutex);
+                impl_->stop = true;
+            }
+            impl_->cv.notify_one();
+            impl_->thread.join();
+        }
+        impl_->report();
+    }
+}
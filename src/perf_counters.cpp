@@ -0,0 +1,295 @@
+#include "perf_counters.h"
+#include "metrics.h"
+#include "log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace DENSE_MULTICUT {
+
+    namespace {
+        // Counters of the calling thread, opened on its first sample. The first event that opens leads the group, the others join it,
+        // so that a single read returns all of them.
+        struct thread_events {
+            bool opened = false;
+            int leader = -1;
+            std::vector<int> fds;
+            // position of each event in the group read, -1 if it could not be opened.
+            std::array<int, nr_perf_events> position;
+            std::array<int, nr_perf_events> open_errno{};
+
+            ~thread_events()
+            {
+#ifdef __linux__
+                for(const int fd : fds)
+                    close(fd);
+#endif
+            }
+
+            void open()
+            {
+                opened = true;
+                position.fill(-1);
+#if defined(__linux__) && defined(DENSE_MULTICUT_PERF_COUNTERS)
+                // cache misses are last level cache misses on most CPUs.
+                const std::array<uint64_t, nr_perf_events> configs = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+                for(size_t e=0; e<nr_perf_events; ++e)
+                {
+                    perf_event_attr attr;
+                    std::memset(&attr, 0, sizeof(attr));
+                    attr.size = sizeof(attr);
+                    attr.type = PERF_TYPE_HARDWARE;
+                    attr.config = configs[e];
+                    // user space only, which perf_event_paranoid <= 2 allows without privileges.
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv = 1;
+                    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                    const int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+                    if(fd < 0)
+                    {
+                        open_errno[e] = errno;
+                        continue;
+                    }
+                    if(leader < 0)
+                        leader = fd;
+                    position[e] = fds.size();
+                    fds.push_back(fd);
+                }
+#endif
+            }
+
+            bool available(const size_t e) const { return position[e] >= 0; }
+
+            void read(perf_counters::sample& s) const
+            {
+                s.values.fill(0);
+                s.time_enabled = 0;
+                s.time_running = 0;
+#ifdef __linux__
+                if(leader < 0)
+                    return;
+                // nr, time enabled, time running, one value per group member.
+                std::array<uint64_t, 3 + nr_perf_events> buffer{};
+                if(::read(leader, buffer.data(), sizeof(buffer)) < ssize_t(3 * sizeof(uint64_t)))
+                    return;
+                s.time_enabled = buffer[1];
+                s.time_running = buffer[2];
+                for(size_t e=0; e<nr_perf_events; ++e)
+                    if(position[e] >= 0 && size_t(position[e]) < buffer[0])
+                        s.values[e] = buffer[3 + position[e]];
+#endif
+            }
+        };
+
+        thread_events& local_events()
+        {
+            thread_local thread_events events;
+            return events;
+        }
+
+        std::string format_count(const perf_region_summary& r, const perf_event e)
+        {
+            if(!r.has(e))
+                return "n/a";
+            std::stringstream s;
+            s << std::setprecision(4) << r.count(e) / 1e6 << "M";
+            return s.str();
+        }
+
+        std::string format_rate(const bool available, const double rate)
+        {
+            if(!available)
+                return "n/a";
+            std::stringstream s;
+            s << std::fixed << std::setprecision(2) << rate;
+            return s.str();
+        }
+
+        void log_region(const std::string& prefix, const perf_region_summary& r, const log_level level)
+        {
+            if(!log_enabled(level))
+                return;
+            const bool ipc = r.has(perf_event::cycles) && r.has(perf_event::instructions);
+            std::stringstream s;
+            s << prefix << r.name << ": " << r.calls << " calls, " << r.seconds << " s, "
+                << format_count(r, perf_event::cycles) << " cycles, " << format_count(r, perf_event::instructions) << " instructions, "
+                << "IPC " << format_rate(ipc, r.ipc()) << ", "
+                << "LLC misses/kinstr " << format_rate(r.has(perf_event::llc_misses) && r.has(perf_event::instructions), r.llc_misses_per_kilo_instruction()) << ", "
+                << "branch misses/kinstr " << format_rate(r.has(perf_event::branch_misses) && r.has(perf_event::instructions), r.branch_misses_per_kilo_instruction());
+            if(level == log_level::info)
+                LOG_INFO << s.str() << " on " << r.nr_threads << " threads\n";
+            else
+                LOG_DEBUG << s.str() << "\n";
+        }
+    }
+
+    std::string perf_event_name(const perf_event e)
+    {
+        switch(e)
+        {
+            case perf_event::cycles: return "cycles";
+            case perf_event::instructions: return "instructions";
+            case perf_event::llc_misses: return "LLC misses";
+            case perf_event::branch_misses: return "branch misses";
+        }
+        return "unknown";
+    }
+
+    bool perf_counters::enable()
+    {
+        enabled_.store(true, std::memory_order_relaxed);
+#ifndef DENSE_MULTICUT_PERF_COUNTERS
+        LOG_WARNING << "[perf counters] built without DENSE_MULTICUT_PERF_COUNTERS, solver phases are not instrumented\n";
+        return false;
+#else
+        // probe on the calling thread, other threads open their counters on their first region.
+        sample s;
+        read(s);
+        const thread_events& events = local_events();
+        std::string missing;
+        for(size_t e=0; e<nr_perf_events; ++e)
+            if(!events.available(e))
+                missing += (missing.empty() ? "" : ", ") + perf_event_name(perf_event(e)) + " (" + std::strerror(events.open_errno[e]) + ")";
+        if(events.leader < 0)
+            LOG_WARNING << "[perf counters] no hardware counters available, regions record calls and time only. Missing: " << missing
+                << ". Check /proc/sys/kernel/perf_event_paranoid and whether the machine exposes a PMU\n";
+        else if(!missing.empty())
+            LOG_WARNING << "[perf counters] unavailable counters: " << missing << "\n";
+        else
+            LOG_INFO << "[perf counters] counting cycles, instructions, LLC misses and branch misses per region\n";
+        return events.leader >= 0;
+#endif
+    }
+
+    size_t perf_counters::register_region(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = std::find(names_.begin(), names_.end(), name);
+        if(it != names_.end())
+            return it - names_.begin();
+        if(names_.size() == max_nr_regions)
+            throw std::runtime_error("too many perf counter regions, increase perf_counters::max_nr_regions");
+        names_.push_back(name);
+        return names_.size() - 1;
+    }
+
+    perf_counters::shard& perf_counters::local_shard()
+    {
+        thread_local shard* s = nullptr;
+        if(s == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shards_.push_back(std::make_unique<shard>());
+            s = shards_.back().get();
+            s->thread_nr = shards_.size() - 1;
+        }
+        return *s;
+    }
+
+    void perf_counters::read(sample& s)
+    {
+        thread_events& events = local_events();
+        if(!events.opened)
+        {
+            events.open();
+            shard& sh = local_shard();
+            for(size_t e=0; e<nr_perf_events; ++e)
+                sh.available[e] = events.available(e);
+        }
+        events.read(s);
+        s.time = std::chrono::steady_clock::now();
+    }
+
+    void perf_counters::record(const size_t region, const sample& begin, const sample& end)
+    {
+        region_slot& slot = local_shard().regions[region];
+        slot.calls.store(slot.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        const double seconds = std::chrono::duration<double>(end.time - begin.time).count();
+        slot.seconds.store(slot.seconds.load(std::memory_order_relaxed) + seconds, std::memory_order_relaxed);
+        const uint64_t running = end.time_running - begin.time_running;
+        if(running == 0)
+            return;
+        // extrapolates counts over the time the group was descheduled by multiplexing.
+        const double scale = double(end.time_enabled - begin.time_enabled) / double(running);
+        for(size_t e=0; e<nr_perf_events; ++e)
+        {
+            auto& c = slot.counts[e];
+            c.store(c.load(std::memory_order_relaxed) + scale * double(end.values[e] - begin.values[e]), std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<perf_region_summary> perf_counters::summary(const shard* only) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<perf_region_summary> result(names_.size());
+        for(size_t r=0; r<names_.size(); ++r)
+        {
+            perf_region_summary& s = result[r];
+            s.name = names_[r];
+            for(const auto& sh : shards_)
+            {
+                if(only != nullptr && sh.get() != only)
+                    continue;
+                const region_slot& slot = sh->regions[r];
+                const uint64_t calls = slot.calls.load(std::memory_order_relaxed);
+                if(calls == 0)
+                    continue;
+                s.calls += calls;
+                ++s.nr_threads;
+                s.seconds += slot.seconds.load(std::memory_order_relaxed);
+                for(size_t e=0; e<nr_perf_events; ++e)
+                {
+                    s.counts[e] += slot.counts[e].load(std::memory_order_relaxed);
+                    s.available[e] = s.available[e] || sh->available[e];
+                }
+            }
+        }
+        return result;
+    }
+
+    std::vector<perf_region_summary> perf_counters::summary() const
+    {
+        return summary(nullptr);
+    }
+
+    void perf_counters::report() const
+    {
+        if(!enabled())
+            return;
+        for(const perf_region_summary& r : summary())
+        {
+            if(r.calls == 0)
+                continue;
+            log_region("[perf counters] ", r, log_level::info);
+#ifdef DENSE_MULTICUT_METRICS
+            // names vary per region, so the metrics macros with their per call site ids do not apply.
+            metrics_registry& metrics = metrics_registry::instance();
+            if(r.has(perf_event::cycles) && r.has(perf_event::instructions))
+                metrics.set(metrics.register_metric("perf " + r.name + " IPC", metric_kind::gauge), r.ipc());
+            if(r.has(perf_event::llc_misses) && r.has(perf_event::instructions))
+                metrics.set(metrics.register_metric("perf " + r.name + " LLC misses per kilo instruction", metric_kind::gauge), r.llc_misses_per_kilo_instruction());
+            if(r.has(perf_event::branch_misses) && r.has(perf_event::instructions))
+                metrics.set(metrics.register_metric("perf " + r.name + " branch misses per kilo instruction", metric_kind::gauge), r.branch_misses_per_kilo_instruction());
+#endif
+        }
+        if(!log_enabled(log_level::debug))
+            return;
+        std::vector<const shard*> shards;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for(const auto& sh : shards_)
+                shards.push_back(sh.get());
+        }
+        for(const shard* sh : shards)
+            for(const perf_region_summary& r : summary(sh))
+                if(r.calls > 0)
+                    log_region("[perf counters] thread " + std::to_string(sh->thread_nr) + " ", r, log_level::debug);
+    }
+}
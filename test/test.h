@@ -2,6 +2,8 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include <random>
 
 namespace DENSE_MULTICUT {
 
@@ -24,4 +26,15 @@ namespace DENSE_MULTICUT {
             throw std::runtime_error(msg);
     }
 
+    // n rows of dimension d with entries uniform in [-1, 1].
+    inline std::vector<float> random_features(const size_t n, const size_t d, const unsigned seed = 0)
+    {
+        std::vector<float> features(n*d);
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> distr(-1.0, 1.0);
+        for(size_t i=0; i<n*d; ++i)
+            features[i] = distr(generator);
+        return features;
+    }
+
 }
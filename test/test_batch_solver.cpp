@@ -0,0 +1,75 @@
+#include "batch_solver.h"
+#include "dense_gaec.h"
+#include "test.h"
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+std::vector<float> write_random_instance(const std::string& path, const size_t n, const size_t d, const unsigned seed)
+{
+    std::vector<float> features = random_features(n, d, seed);
+    std::ofstream f(path);
+    f << n << " " << d << "\n";
+    for(size_t i=0; i<n*d; ++i)
+        f << features[i] << (i % d == d-1 ? "\n" : " ");
+    f.close();
+    // values as parsed back from text.
+    std::ifstream in(path);
+    size_t n_read, d_read;
+    in >> n_read >> d_read;
+    for(float& x : features)
+        in >> x;
+    return features;
+}
+
+int main(int argc, char** argv)
+{
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "dense_multicut_test_batch";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "instances");
+
+    const std::vector<size_t> sizes = {300, 50, 500, 120, 10, 250, 80};
+    std::vector<std::vector<float>> features;
+    std::ofstream manifest(dir / "manifest");
+    manifest << "# instance and output path\n";
+    for(size_t c=0; c<sizes.size(); ++c)
+    {
+        const std::string name = "instance_" + std::to_string(c) + ".txt";
+        features.push_back(write_random_instance((dir / "instances" / name).string(), sizes[c], 16, c));
+        manifest << "instances/" << name << " labels_" << c << ".txt\n";
+    }
+    manifest.close();
+
+    batch_options options;
+    options.solver.dist_offset = 0.1;
+    options.nr_threads = 3;
+    dense_gaec_solver reference(options.solver);
+
+    std::cout << "[test batch solver] manifest\n";
+    const std::vector<batch_instance> instances = read_batch_instances((dir / "manifest").string(), "");
+    test(instances.size() == sizes.size(), "wrong number of manifest entries");
+    std::vector<double> objectives(sizes.size(), 0.0);
+    const batch_summary summary = solve_batch(instances, options, [&](const size_t i, const dense_gaec_result& result) { objectives[i] = result.objective; });
+    test(summary.nr_instances == sizes.size() && summary.nr_failed == 0, "batch instances failed");
+    for(size_t c=0; c<sizes.size(); ++c)
+    {
+        const dense_gaec_result expected = reference.solve(sizes[c], 16, features[c]);
+        test(read_labeling((dir / ("labels_" + std::to_string(c) + ".txt")).string()) == expected.labels, "batch labeling differs from single solve");
+        test(objectives[c] == expected.objective, "batch objective differs from single solve");
+    }
+
+    std::cout << "[test batch solver] directory\n";
+    const std::vector<batch_instance> dir_instances = read_batch_instances((dir / "instances").string(), (dir / "out").string());
+    test(dir_instances.size() == sizes.size(), "wrong number of directory instances");
+    fs::create_directories(dir / "out");
+    test(solve_batch(dir_instances, options).nr_failed == 0, "batch instances failed");
+    for(size_t c=0; c<sizes.size(); ++c)
+        test(read_labeling((dir / "out" / ("instance_" + std::to_string(c) + ".txt")).string()) == read_labeling((dir / ("labels_" + std::to_string(c) + ".txt")).string()),
+                "directory and manifest labelings differ");
+
+    fs::remove_all(dir);
+}
@@ -0,0 +1,103 @@
+#include "dense_gaec_incremental_nn.h"
+#include "merge_tree.h"
+#include "checkpoint.h"
+#include "dense_multicut_utils.h"
+#include "node_id.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+// Interrupts a checkpointed solve by a contraction budget, resumes it from the last checkpoint and compares with an uninterrupted solve.
+void test_checkpoint_resume(const size_t n, const size_t d, const size_t k)
+{
+    std::cout << "[test checkpoint] interrupt and resume inc-NN for " << n << " nodes of dimension " << d << " with k=" << k << "\n";
+    const std::vector<float> features = random_features(n, d);
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "dense_multicut_test_checkpoint";
+    std::filesystem::remove_all(directory);
+
+    merge_tree full_tree;
+    solve_status full;
+    const std::vector<size_t> full_labels = dense_gaec_incremental_nn(n, d, features, k, "Flat", false, &full_tree, {}, {}, {}, &full);
+    test(full.is_final && full.nr_contractions > 20, "too few contractions for the test");
+
+    checkpoint_options checkpoint;
+    checkpoint.directory = directory.string();
+    checkpoint.interval_contractions = full.nr_contractions / 8;
+    merge_tree interrupted_tree;
+    solve_status interrupted;
+    dense_gaec_incremental_nn(n, d, features, k, "Flat", false, &interrupted_tree, checkpoint, {}, {0.0, full.nr_contractions / 2}, &interrupted);
+    test(!interrupted.is_final, "interrupted solve reported final");
+    test(std::filesystem::exists(checkpoint_file(checkpoint.directory)), "no checkpoint written");
+
+    checkpoint.resume = true;
+    merge_tree resumed_tree;
+    solve_status resumed;
+    const std::vector<size_t> resumed_labels = dense_gaec_incremental_nn(n, d, features, k, "Flat", false, &resumed_tree, checkpoint, {}, {}, &resumed);
+    test(resumed.is_final, "resumed solve not final");
+    test(resumed_labels == full_labels, "resumed labeling differs from uninterrupted one");
+    test(resumed.nr_contractions == full.nr_contractions && resumed.nr_clusters == full.nr_clusters);
+    test(std::abs(resumed.objective - full.objective) <= 1e-6 * std::max(1.0, std::abs(full.objective)),
+            "resumed objective " + std::to_string(resumed.objective) + " != " + std::to_string(full.objective));
+    test(resumed_tree.nr_contractions() == full_tree.nr_contractions(), "resumed merge tree incomplete");
+    for(size_t c=0; c<full_tree.nr_contractions(); ++c)
+        test(resumed_tree.contractions()[c].i == full_tree.contractions()[c].i && resumed_tree.contractions()[c].j == full_tree.contractions()[c].j, "resumed merge tree differs");
+    std::filesystem::remove_all(directory);
+}
+
+bool resume_throws(const size_t n, const size_t d, const std::vector<float>& features, const size_t k, const std::string& index_type, const bool track_dist_offset, const checkpoint_options& checkpoint)
+{
+    try
+    {
+        dense_gaec_incremental_nn(n, d, features, k, index_type, track_dist_offset, nullptr, checkpoint);
+    }
+    catch(const std::runtime_error& e)
+    {
+        std::cout << "[test checkpoint] rejected: " << e.what() << "\n";
+        return true;
+    }
+    return false;
+}
+
+// A checkpoint is only resumed with the id width, index type and distance offset it was written with.
+void test_checkpoint_mismatch(const size_t n, const size_t d, const size_t k)
+{
+    std::cout << "[test checkpoint] resume with different settings for " << n << " nodes of dimension " << d << "\n";
+    const std::vector<float> raw_features = random_features(n, d);
+    const std::vector<float> features = append_dist_offset_in_features(raw_features, 0.5, n, d);
+    const std::vector<float> other_offset_features = append_dist_offset_in_features(raw_features, 0.25, n, d);
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "dense_multicut_test_checkpoint_mismatch";
+    std::filesystem::remove_all(directory);
+
+    checkpoint_options checkpoint;
+    checkpoint.directory = directory.string();
+    checkpoint.interval_contractions = 10;
+    dense_gaec_incremental_nn(n, d + 1, features, k, "Flat", true, nullptr, checkpoint, {}, {0.0, 50});
+    test(std::filesystem::exists(checkpoint_file(checkpoint.directory)), "no checkpoint written");
+
+    checkpoint.resume = true;
+    test(resume_throws(n, d + 1, other_offset_features, k, "Flat", true, checkpoint), "checkpoint resumed with a different distance offset");
+    test(resume_throws(n, d + 1, features, k, "Flat", false, checkpoint), "checkpoint resumed without distance offset");
+    test(resume_throws(n, d + 1, features, k, "IVF4,Flat", true, checkpoint), "checkpoint resumed with a different index type");
+    force_64bit_ids() = true;
+    test(resume_throws(n, d + 1, features, k, "Flat", true, checkpoint), "checkpoint resumed with a different id width");
+    force_64bit_ids() = false;
+    test(!resume_throws(n, d + 1, features, k, "Flat", true, checkpoint), "checkpoint not resumed with the settings it was written with");
+
+    // a truncated checkpoint is rejected instead of being read past its end.
+    std::vector<char> state = read_checkpoint(checkpoint.directory);
+    state.resize(state.size() / 2);
+    write_checkpoint(checkpoint.directory, state);
+    test(resume_throws(n, d + 1, features, k, "Flat", true, checkpoint), "truncated checkpoint resumed");
+    std::filesystem::remove_all(directory);
+}
+
+int main(int argc, char** argv)
+{
+    test_checkpoint_resume(300, 8, 5);
+    test_checkpoint_resume(300, 8, 1);
+    test_checkpoint_mismatch(300, 8, 5);
+}
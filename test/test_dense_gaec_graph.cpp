@@ -0,0 +1,137 @@
+#include "dense_gaec_graph.h"
+#include "dense_gaec.h"
+#include "dense_multicut_utils.h"
+#include "union_find.hxx"
+#include "dense_features_parser.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+
+using namespace DENSE_MULTICUT;
+
+// 4-neighbourhood of a rows x cols grid, every edge listed from both sides.
+void grid_graph(const size_t rows, const size_t cols, std::vector<size_t>& row_offsets, std::vector<size_t>& column_indices)
+{
+    row_offsets = {0};
+    column_indices.clear();
+    for(size_t r=0; r<rows; ++r)
+        for(size_t c=0; c<cols; ++c)
+        {
+            if(r > 0) column_indices.push_back((r-1)*cols + c);
+            if(c > 0) column_indices.push_back(r*cols + c-1);
+            if(c+1 < cols) column_indices.push_back(r*cols + c+1);
+            if(r+1 < rows) column_indices.push_back((r+1)*cols + c);
+            row_offsets.push_back(column_indices.size());
+        }
+}
+
+void test_grid(const size_t rows, const size_t cols, const size_t d, const float dist_offset)
+{
+    std::cout << "[test dense gaec graph] " << rows << " x " << cols << " grid, dimension " << d << ", offset " << dist_offset << "\n";
+    const size_t n = rows * cols;
+    const std::vector<float> features = random_features(n, d);
+    std::vector<size_t> row_offsets, column_indices;
+    grid_graph(rows, cols, row_offsets, column_indices);
+
+    solve_status status;
+    const std::vector<size_t> labels = dense_gaec_graph(n, d + 1, append_dist_offset_in_features(features, dist_offset, n, d), row_offsets, column_indices, true, nullptr, {}, {}, &status);
+    test(status.is_final, "graph solve not final");
+    const double expected = multicut_objective(n, d, features, labels, dist_offset);
+    test(std::abs(status.objective - expected) <= 1e-3 * std::max(1.0, std::abs(expected)), "objective " + std::to_string(status.objective) + " != " + std::to_string(expected));
+
+    // clusters are connected in the grid.
+    union_find<size_t> uf(n);
+    for(size_t i=0; i<n; ++i)
+        for(size_t c=row_offsets[i]; c<row_offsets[i+1]; ++c)
+            if(labels[i] == labels[column_indices[c]])
+                uf.merge(i, column_indices[c]);
+    test(uf.count() == status.nr_clusters, "cluster not connected in the graph");
+
+    // no adjacent pair of clusters has positive cost.
+    std::vector<std::vector<double>> sums;
+    std::vector<size_t> sizes;
+    std::vector<size_t> cluster(n);
+    {
+        std::vector<size_t> id(2*n, n);
+        for(size_t i=0; i<n; ++i)
+        {
+            if(id[labels[i]] == n)
+            {
+                id[labels[i]] = sums.size();
+                sums.emplace_back(d, 0.0);
+                sizes.push_back(0);
+            }
+            cluster[i] = id[labels[i]];
+            for(size_t l=0; l<d; ++l)
+                sums[cluster[i]][l] += features[i*d + l];
+            ++sizes[cluster[i]];
+        }
+    }
+    for(size_t i=0; i<n; ++i)
+        for(size_t c=row_offsets[i]; c<row_offsets[i+1]; ++c)
+        {
+            const size_t a = cluster[i];
+            const size_t b = cluster[column_indices[c]];
+            if(a == b)
+                continue;
+            double cost = -dist_offset * sizes[a] * sizes[b];
+            for(size_t l=0; l<d; ++l)
+                cost += sums[a][l] * sums[b][l];
+            test(cost <= 1e-4, "adjacent clusters with positive cost remain");
+        }
+}
+
+void test_complete_graph(const size_t n, const size_t d)
+{
+    std::cout << "[test dense gaec graph] complete graph with " << n << " nodes equals dense gaec\n";
+    const std::vector<float> features = random_features(n, d);
+    std::vector<size_t> row_offsets = {0}, column_indices;
+    for(size_t i=0; i<n; ++i)
+    {
+        for(size_t j=i+1; j<n; ++j)
+            column_indices.push_back(j);
+        row_offsets.push_back(column_indices.size());
+    }
+    solve_status graph_status, dense_status;
+    dense_gaec_graph(n, d, features, row_offsets, column_indices, false, nullptr, {}, {}, &graph_status);
+    dense_gaec_flat_index(n, d, features, false, nullptr, {}, {}, &dense_status);
+    test(std::abs(graph_status.objective - dense_status.objective) <= 1e-3 * std::abs(dense_status.objective), "complete graph differs from dense gaec");
+    test(graph_status.nr_clusters == dense_status.nr_clusters, "complete graph gives different number of clusters");
+}
+
+// Graph files are read into CSR, malformed lines are reported instead of ending the graph early.
+void test_read_graph_file()
+{
+    std::cout << "[test dense gaec graph] read graph file\n";
+    const std::string path = (std::filesystem::temp_directory_path() / "test_dense_gaec_graph_edges.txt").string();
+    {
+        std::ofstream f(path);
+        f << "0 1\n1 0\n\n2 1\n";
+    }
+    const auto [row_offsets, column_indices] = read_graph_file(path, 3);
+    test(row_offsets == std::vector<size_t>({0, 1, 2, 3}) && column_indices == std::vector<size_t>({1, 0, 1}), "wrong CSR adjacency");
+
+    for(const std::string& invalid : {"0 1\n1 x\n2 1\n", "0 1\n1\n", "0 1 2\n"})
+    {
+        {
+            std::ofstream f(path);
+            f << invalid;
+        }
+        bool thrown = false;
+        try { read_graph_file(path, 3); } catch(const std::runtime_error&) { thrown = true; }
+        test(thrown, "malformed graph file accepted");
+    }
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+    test_read_graph_file();
+    test_grid(20, 30, 8, 0.0);
+    test_grid(40, 40, 16, 0.5);
+    test_grid(1, 100, 4, 0.1);
+    test_complete_graph(200, 16);
+}
@@ -0,0 +1,74 @@
+#include "dense_gaec.h"
+#include "dense_gaec_parallel.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <unordered_map>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+// n points around k random centers.
+std::vector<float> clustered_features(const size_t n, const size_t k, const size_t d)
+{
+    std::mt19937 generator(0);
+    std::normal_distribution<float> distr(0.0, 1.0);
+    std::vector<float> centers(k*d);
+    for(float& x : centers)
+        x = distr(generator);
+    std::vector<float> features(n*d);
+    for(size_t i=0; i<n; ++i)
+        for(size_t l=0; l<d; ++l)
+            features[i*d + l] = centers[(i % k)*d + l] + 0.3 * distr(generator);
+    return features;
+}
+
+// Parallel rounds with k candidates per node have to end in a clustering without positive edge between clusters,
+// whose objective is reported correctly and is at most the fraction tolerance worse than that of sequential GAEC.
+void test_parallel_k(const size_t n, const size_t d, const float dist_offset, const size_t k, const bool greedy_matching, const double tolerance)
+{
+    std::cout << "[test dense gaec parallel] k=" << k << (greedy_matching ? " with greedy matching" : "") << " for " << n << " nodes of dimension " << d << "\n";
+    const std::vector<float> features = clustered_features(n, 20, d);
+    const std::vector<float> solver_features = append_dist_offset_in_features(features, dist_offset, n, d);
+    solve_status sequential;
+    dense_gaec_flat_index(n, d + 1, solver_features, true, nullptr, {}, {}, &sequential);
+
+    solve_status status;
+    const std::vector<size_t> labels = dense_gaec_parallel_flat_index(n, d + 1, solver_features, true, nullptr, greedy_matching, k, {}, {}, &status);
+    test(labels.size() == n && status.is_final);
+
+    std::unordered_map<size_t, std::vector<double>> cluster_sums;
+    std::unordered_map<size_t, size_t> cluster_sizes;
+    for(size_t i=0; i<n; ++i)
+    {
+        std::vector<double>& sum = cluster_sums[labels[i]];
+        sum.resize(d, 0.0);
+        for(size_t l=0; l<d; ++l)
+            sum[l] += features[i*d + l];
+        cluster_sizes[labels[i]]++;
+    }
+    test(cluster_sums.size() == status.nr_clusters && status.nr_contractions == n - status.nr_clusters, "inconsistent solve status");
+    for(const auto& [a, sum_a] : cluster_sums)
+        for(const auto& [b, sum_b] : cluster_sums)
+        {
+            if(a >= b)
+                continue;
+            double cost = -double(dist_offset) * cluster_sizes[a] * cluster_sizes[b];
+            for(size_t l=0; l<d; ++l)
+                cost += sum_a[l] * sum_b[l];
+            test(cost <= 1e-3, "positive edge between clusters " + std::to_string(a) + " and " + std::to_string(b));
+        }
+
+    const double objective = multicut_objective(n, d, features, labels, dist_offset);
+    test(std::abs(status.objective - objective) <= 1e-4 * std::abs(objective), "reported objective " + std::to_string(status.objective) + " != " + std::to_string(objective));
+    test(objective <= sequential.objective * (1.0 - tolerance),
+            "objective " + std::to_string(objective) + " not within " + std::to_string(tolerance) + " of sequential GAEC " + std::to_string(sequential.objective));
+}
+
+int main(int argc, char** argv)
+{
+    for(const bool greedy_matching : {false, true})
+        for(const size_t k : {1, 4, 16})
+            test_parallel_k(400, 8, 4.0, k, greedy_matching, 0.05);
+}
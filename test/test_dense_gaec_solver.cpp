@@ -0,0 +1,52 @@
+#include "dense_gaec.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <array>
+
+using namespace DENSE_MULTICUT;
+
+void test_repeated_solves(const std::string& index_str, const float dist_offset)
+{
+    std::cout << "[test dense gaec solver] repeated solves with " << index_str << " index and offset " << dist_offset << "\n";
+    dense_gaec_options options;
+    options.index_str = index_str;
+    options.dist_offset = dist_offset;
+    dense_gaec_solver solver(options);
+
+    // instances of changing size and dimension, the last one repeats the first.
+    const std::vector<std::array<size_t,3>> instances = {{200, 16, 0}, {500, 16, 1}, {50, 16, 2}, {300, 32, 3}, {200, 16, 0}};
+    std::vector<size_t> first_labels;
+    dense_gaec_result result;
+    for(const auto [n, d, seed] : instances)
+    {
+        const std::vector<float> features = random_features(n, d, seed);
+        solver.solve(n, d, features, result);
+
+        // HNSW graphs depend on the random levels drawn by the reused index, so only exact search gives the same labeling.
+        if(index_str == "Flat")
+        {
+            const std::vector<float> offset_features = dist_offset != 0.0 ? append_dist_offset_in_features(features, dist_offset, n, d) : features;
+            const std::vector<size_t> expected = dense_gaec_flat_index(n, dist_offset != 0.0 ? d + 1 : d, offset_features, dist_offset != 0.0);
+            test(result.labels == expected, "solver labeling differs from dense gaec");
+        }
+
+        const double objective = multicut_objective(n, d, features, result.labels, dist_offset);
+        test(std::abs(result.objective - objective) <= 1e-3 * std::max(1.0, std::abs(objective)), "solver objective " + std::to_string(result.objective) + " != " + std::to_string(objective));
+        test(result.nr_clusters + result.nr_contractions == n, "clusters and contractions do not add up");
+        test(result.timings.total >= result.timings.contraction, "total time below contraction time");
+        if(first_labels.empty())
+            first_labels = result.labels;
+    }
+    if(index_str == "Flat")
+        test(result.labels == first_labels, "repeated instance solved differently");
+}
+
+int main(int argc, char** argv)
+{
+    test_repeated_solves("Flat", 0.0);
+    test_repeated_solves("Flat", 0.5);
+    test_repeated_solves("HNSW", 0.5);
+}
@@ -0,0 +1,137 @@
+#include "dense_gaec_streaming.h"
+#include "dense_gaec.h"
+#include "dense_multicut_utils.h"
+#include "node_id.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+
+using namespace DENSE_MULTICUT;
+
+bool same_partition(const std::vector<size_t>& a, const std::vector<size_t>& b)
+{
+    std::vector<size_t> a_contiguous, b_contiguous;
+    contiguous_labeling(a, a_contiguous);
+    contiguous_labeling(b, b_contiguous);
+    return a_contiguous == b_contiguous;
+}
+
+bool close(const double a, const double b)
+{
+    return std::abs(a - b) <= 1e-4 * std::max(1.0, std::abs(b));
+}
+
+// Inserting all points into an empty stream runs GAEC on the whole instance and has to reproduce the batch solver.
+void test_streaming_matches_batch(const size_t n, const size_t d, const float dist_offset)
+{
+    std::cout << "[test dense gaec streaming] single batch of " << n << " nodes of dimension " << d << " with offset " << dist_offset << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    solve_status batch;
+    const std::vector<size_t> batch_labels = dist_offset > 0.0
+        ? dense_gaec_flat_index(n, d + 1, append_dist_offset_in_features(features, dist_offset, n, d), true, nullptr, {}, {}, &batch)
+        : dense_gaec_flat_index(n, d, features, false, nullptr, {}, {}, &batch);
+    test(batch.nr_clusters > 1 && batch.nr_clusters < n, "trivial instance");
+
+    dense_gaec_streaming stream(d, dist_offset);
+    const streaming_update update = stream.insert(n, features);
+    test(update.new_node_labels.size() == n);
+    test(update.merged_clusters.empty(), "empty stream reported merged clusters");
+    test(stream.nr_clusters() == batch.nr_clusters, "streaming has " + std::to_string(stream.nr_clusters()) + " clusters, batch " + std::to_string(batch.nr_clusters));
+    test(update.nr_contractions == batch.nr_contractions);
+    test(same_partition(update.new_node_labels, batch_labels), "streaming labeling differs from batch labeling");
+
+    const double stream_objective = multicut_objective(n, d, features, update.new_node_labels, dist_offset);
+    test(close(stream_objective, batch.objective), "streaming objective " + std::to_string(stream_objective) + " != batch " + std::to_string(batch.objective));
+    std::vector<size_t> singletons(n);
+    std::iota(singletons.begin(), singletons.end(), 0);
+    const double disconnected = multicut_objective(n, d, features, singletons, dist_offset);
+    test(close(disconnected + update.cost_change, stream_objective), "cost change does not match objective");
+}
+
+// Starting from the batch clustering of the first points, the cost change of an insertion is the change of the objective.
+void test_streaming_cost_change(const size_t n, const size_t n_new, const size_t d, const float dist_offset)
+{
+    std::cout << "[test dense gaec streaming] insert " << n_new << " nodes into clustering of " << n << " nodes with offset " << dist_offset << "\n";
+    const std::vector<float> all_features = random_features(n + n_new, d);
+    const std::vector<float> features(all_features.begin(), all_features.begin() + n*d);
+    const std::vector<float> new_features(all_features.begin() + n*d, all_features.end());
+
+    const std::vector<size_t> labels = dist_offset > 0.0
+        ? dense_gaec_flat_index(n, d + 1, append_dist_offset_in_features(features, dist_offset, n, d), true)
+        : dense_gaec_flat_index(n, d, features);
+    dense_gaec_streaming stream = dense_gaec_streaming::from_labeling(n, d, features, labels, dist_offset);
+    const streaming_update update = stream.insert(n_new, new_features);
+
+    // old points follow the merges of their clusters, new points get the reported labels.
+    std::vector<size_t> all_labels(labels);
+    for(const auto [absorbed, surviving] : update.merged_clusters)
+        for(size_t& l : all_labels)
+            if(l == absorbed)
+                l = surviving;
+    all_labels.insert(all_labels.end(), update.new_node_labels.begin(), update.new_node_labels.end());
+
+    // objective before the insertion with the new points as singletons.
+    std::vector<size_t> before_labels(labels);
+    const size_t max_label = *std::max_element(labels.begin(), labels.end());
+    for(size_t c=0; c<n_new; ++c)
+        before_labels.push_back(max_label + 1 + c);
+    const double before = multicut_objective(n + n_new, d, all_features, before_labels, dist_offset);
+    const double after = multicut_objective(n + n_new, d, all_features, all_labels, dist_offset);
+    test(update.nr_contractions > 0, "insertion did not contract");
+    test(close(after - before, update.cost_change), "objective changed by " + std::to_string(after - before) + ", reported " + std::to_string(update.cost_change));
+    test(after <= before, "insertion increased the objective");
+}
+
+// Queues with 32 and 64-bit ids contract the same edges.
+void test_streaming_id_widths(const size_t n, const size_t d, const float dist_offset)
+{
+    std::cout << "[test dense gaec streaming] 32 and 64-bit ids for " << n << " nodes\n";
+    const std::vector<float> features = random_features(n, d);
+    dense_gaec_streaming stream_32(d, dist_offset);
+    const streaming_update update_32 = stream_32.insert(n, features);
+    force_64bit_ids() = true;
+    dense_gaec_streaming stream_64(d, dist_offset);
+    const streaming_update update_64 = stream_64.insert(n, features);
+    force_64bit_ids() = false;
+    test(update_32.new_node_labels == update_64.new_node_labels, "32 and 64-bit ids give different labelings");
+    test(update_32.nr_contractions == update_64.nr_contractions && update_32.cost_change == update_64.cost_change);
+}
+
+// A saved state is replaced only by a complete file and inserting into the loaded state continues the clustering.
+void test_streaming_save_load(const size_t n, const size_t n_new, const size_t d, const float dist_offset)
+{
+    std::cout << "[test dense gaec streaming] save and load state of " << n << " nodes\n";
+    const std::vector<float> all_features = random_features(n + n_new, d);
+    const std::vector<float> features(all_features.begin(), all_features.begin() + n*d);
+    const std::vector<float> new_features(all_features.begin() + n*d, all_features.end());
+
+    dense_gaec_streaming stream(d, dist_offset);
+    stream.insert(n, features);
+    const std::string path = (std::filesystem::temp_directory_path() / "test_dense_gaec_streaming_state.bin").string();
+    stream.save(path);
+    stream.save(path);
+    test(!std::filesystem::exists(path + ".tmp"), "temporary state file left behind");
+
+    dense_gaec_streaming loaded = dense_gaec_streaming::load(path);
+    test(loaded.nr_clusters() == stream.nr_clusters() && loaded.dim() == d && loaded.dist_offset() == dist_offset, "loaded state differs");
+    const streaming_update update = stream.insert(n_new, new_features);
+    const streaming_update loaded_update = loaded.insert(n_new, new_features);
+    test(update.new_node_labels == loaded_update.new_node_labels, "insertion into loaded state differs");
+    std::filesystem::remove(path);
+
+    test(dense_gaec_streaming::from_labeling(0, d, {}, {}, dist_offset).nr_clusters() == 0, "clustering of no points is not empty");
+}
+
+int main(int argc, char** argv)
+{
+    test_streaming_matches_batch(300, 8, 0.0);
+    test_streaming_matches_batch(300, 8, 0.5);
+    test_streaming_cost_change(300, 50, 8, 0.5);
+    test_streaming_id_widths(300, 8, 0.5);
+    test_streaming_save_load(300, 50, 8, 0.5);
+}
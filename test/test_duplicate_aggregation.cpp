@@ -0,0 +1,144 @@
+#include "duplicate_aggregation.h"
+#include "dense_gaec.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+// n distinct rows around k well separated centers, each row repeated 1 to 3 times in random order. Edges inside a cluster are positive
+// and edges between clusters negative for dist_offset 2, hence GAEC finds the clusters in any contraction order, with and without aggregation.
+// The last dimension is zero with alternating sign between copies.
+std::vector<float> features_with_duplicates(const size_t n, const size_t k, const size_t d, size_t& n_total)
+{
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> noise(-0.2, 0.2);
+    std::uniform_int_distribution<size_t> nr_copies_distr(1, 3);
+    std::vector<float> rows(n*d, 0.0);
+    for(size_t i=0; i<n; ++i)
+    {
+        rows[i*d + i % k] = 2.0;
+        for(size_t l=0; l+1<d; ++l)
+            rows[i*d + l] += noise(generator);
+    }
+
+    std::vector<size_t> order;
+    for(size_t i=0; i<n; ++i)
+        order.insert(order.end(), nr_copies_distr(generator), i);
+    std::shuffle(order.begin(), order.end(), generator);
+    n_total = order.size();
+    std::vector<float> features(n_total*d);
+    for(size_t c=0; c<n_total; ++c)
+        for(size_t l=0; l<d; ++l)
+        {
+            const float x = rows[order[c]*d + l];
+            features[c*d + l] = x == 0.0 && c % 2 == 1 ? -0.0f : x;
+        }
+    return features;
+}
+
+void test_exact_duplicates(const size_t n, const size_t k, const size_t d)
+{
+    const float dist_offset = 2.0;
+    size_t n_total;
+    const std::vector<float> features = features_with_duplicates(n, k, d, n_total);
+    std::cout << "[test duplicate aggregation] " << n << " distinct rows in " << n_total << " nodes of dimension " << d << " with offset " << dist_offset << "\n";
+
+    const aggregated_instance aggregated = aggregate_duplicates(n_total, d, features, 0.0, dist_offset);
+    test(aggregated.n == n, "collapsed into " + std::to_string(aggregated.n) + " groups instead of " + std::to_string(n));
+
+    // intra-group edges are contracted, so they are missing from the disconnected cost of the aggregated instance.
+    const double disconnected = cost_disconnected(n_total, d + 1, append_dist_offset_in_features(features, dist_offset, n_total, d), true);
+    const double aggregated_disconnected = cost_disconnected(n, d + 1, append_dist_offset_in_features(aggregated.features, dist_offset, n, d, aggregated.weights), true);
+    test(std::abs(aggregated_disconnected + aggregated.intra_group_cost - disconnected) <= 1e-4 * std::abs(disconnected), "intra-group cost does not account for contracted edges");
+
+    solve_status full;
+    const std::vector<size_t> full_labels = dense_gaec_flat_index(n_total, d + 1, append_dist_offset_in_features(features, dist_offset, n_total, d), true, nullptr, {}, {}, &full);
+    test(full.nr_clusters == k, "found " + std::to_string(full.nr_clusters) + " instead of " + std::to_string(k) + " clusters");
+    solve_status dedup;
+    const std::vector<size_t> dedup_labels = expand_labeling(aggregated,
+            dense_gaec_flat_index(n, d + 1, append_dist_offset_in_features(aggregated.features, dist_offset, n, d, aggregated.weights), true, nullptr, {}, {}, &dedup));
+
+    std::vector<size_t> full_contiguous, dedup_contiguous;
+    contiguous_labeling(full_labels, full_contiguous);
+    contiguous_labeling(dedup_labels, dedup_contiguous);
+    test(full_contiguous == dedup_contiguous, "labeling with duplicate aggregation differs from labeling without");
+
+    const double objective = multicut_objective(n_total, d, features, dedup_labels, dist_offset);
+    test(std::abs(dedup.objective - objective) <= 1e-4 * std::max(1.0, std::abs(objective)),
+            "reported objective " + std::to_string(dedup.objective) + " != objective of expanded labeling " + std::to_string(objective));
+    test(std::abs(dedup.objective - full.objective) <= 1e-4 * std::max(1.0, std::abs(full.objective)),
+            "objective with duplicate aggregation " + std::to_string(dedup.objective) + " != without " + std::to_string(full.objective));
+}
+
+// Rows around 2d centers +-2.05 e_a with jitter below epsilon/4 in every coordinate: jittered copies share their grid cell and are
+// aggregated. Per center, one row at 2.35 lies outside epsilon and one at 2.101 lies within epsilon but in the next cell, both stay
+// separate groups. Rows near zero share a cell too, but their edges are negative and they are kept apart.
+void test_near_duplicates(const size_t d, const size_t nr_copies, const size_t nr_small)
+{
+    const float epsilon = 0.1;
+    const float dist_offset = 1.0;
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> jitter(-0.02, 0.02);
+    std::vector<float> features;
+    auto add_row = [&](const size_t axis, const float value) {
+        for(size_t l=0; l<d; ++l)
+            features.push_back(l == axis ? value : 0.05f + jitter(generator));
+    };
+    const size_t nr_centers = 2*d;
+    for(size_t c=0; c<nr_centers; ++c)
+    {
+        const float sign = c < d ? 1.0 : -1.0;
+        for(size_t r=0; r<nr_copies; ++r)
+            add_row(c % d, sign * (2.05f + jitter(generator)));
+        add_row(c % d, sign * 2.35f);
+        add_row(c % d, sign * 2.101f);
+    }
+    for(size_t r=0; r<nr_small; ++r)
+        add_row(d, 0.0);
+    const size_t n = features.size() / d;
+    std::cout << "[test duplicate aggregation] " << n << " nodes of dimension " << d << " with epsilon " << epsilon << " and offset " << dist_offset << "\n";
+
+    const aggregated_instance aggregated = aggregate_duplicates(n, d, features, epsilon, dist_offset);
+    test(aggregated.n == 3*nr_centers + nr_small, "collapsed into " + std::to_string(aggregated.n) + " groups instead of " + std::to_string(3*nr_centers + nr_small));
+    for(size_t c=0; c<nr_centers; ++c)
+    {
+        const size_t first = c * (nr_copies + 2);
+        for(size_t r=1; r<nr_copies; ++r)
+            test(aggregated.group[first + r] == aggregated.group[first], "copies within epsilon not aggregated");
+        test(aggregated.group[first + nr_copies] != aggregated.group[first], "row outside epsilon aggregated");
+        test(aggregated.group[first + nr_copies + 1] != aggregated.group[first], "row in another grid cell aggregated");
+    }
+    for(size_t r=0; r<nr_small; ++r)
+        test(aggregated.weights[aggregated.group[nr_centers * (nr_copies + 2) + r]] == 1, "rows with negative edge cost aggregated");
+
+    const double disconnected = cost_disconnected(n, d + 1, append_dist_offset_in_features(features, dist_offset, n, d), true);
+    const double aggregated_disconnected = cost_disconnected(aggregated.n, d + 1, append_dist_offset_in_features(aggregated.features, dist_offset, aggregated.n, d, aggregated.weights), true);
+    test(std::abs(aggregated_disconnected + aggregated.intra_group_cost - disconnected) <= 1e-4 * std::abs(disconnected), "intra-group cost does not account for contracted edges");
+
+    solve_status full;
+    const std::vector<size_t> full_labels = dense_gaec_flat_index(n, d + 1, append_dist_offset_in_features(features, dist_offset, n, d), true, nullptr, {}, {}, &full);
+    test(full.nr_clusters == nr_centers + nr_small, "found " + std::to_string(full.nr_clusters) + " instead of " + std::to_string(nr_centers + nr_small) + " clusters");
+    solve_status dedup;
+    const std::vector<size_t> dedup_labels = expand_labeling(aggregated,
+            dense_gaec_flat_index(aggregated.n, d + 1, append_dist_offset_in_features(aggregated.features, dist_offset, aggregated.n, d, aggregated.weights), true, nullptr, {}, {}, &dedup));
+
+    std::vector<size_t> full_contiguous, dedup_contiguous;
+    contiguous_labeling(full_labels, full_contiguous);
+    contiguous_labeling(dedup_labels, dedup_contiguous);
+    test(full_contiguous == dedup_contiguous, "labeling with near-duplicate aggregation differs from labeling without");
+    const double objective = multicut_objective(n, d, features, dedup_labels, dist_offset);
+    test(std::abs(dedup.objective - objective) <= 1e-4 * std::max(1.0, std::abs(objective)),
+            "reported objective " + std::to_string(dedup.objective) + " != objective of expanded labeling " + std::to_string(objective));
+    test(std::abs(dedup.objective - full.objective) <= 1e-4 * std::max(1.0, std::abs(full.objective)),
+            "objective with near-duplicate aggregation " + std::to_string(dedup.objective) + " != without " + std::to_string(full.objective));
+}
+
+int main(int argc, char** argv)
+{
+    test_exact_duplicates(200, 10, 16);
+    test_near_duplicates(8, 5, 6);
+}
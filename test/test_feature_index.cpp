@@ -1,10 +1,14 @@
 #include "test.h"
 #include "feature_index.h"
+#include "mapped_float_array.h"
+#include <faiss/IndexHNSW.h>
 #include <random>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <filesystem>
+#include <unistd.h>
 
 using namespace DENSE_MULTICUT;
 
@@ -129,6 +133,282 @@ void test_exact_lookup(const size_t n, const size_t d, const std::string index_s
     }
 }
 
+void test_reduced_precision(const size_t n, const size_t d, const feature_precision precision, const float max_error)
+{
+    std::cout << "test " << to_string(precision) << " feature index for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    const feature_storage storage(d, n, features.data(), precision);
+    test(storage.memory_bytes() < storage.fp32_memory_bytes());
+    std::vector<float> buffer(d);
+    for(size_t i=0; i<n; ++i)
+    {
+        const float* row = storage.row(i, buffer.data());
+        for(size_t l=0; l<d; ++l)
+            test(std::abs(row[l] - features[i*d + l]) <= max_error);
+    }
+
+    feature_index_options options;
+    options.precision = precision;
+    feature_index index(d, n, features, "Flat", false, options);
+    const std::vector<std::tuple<size_t, float>> nns_brute_force = get_nearest_nodes_brute_force(n, d, features);
+
+    // returned distances are exact inner products of the stored features, so they can only lose against the true nearest neighbour by the quantization error.
+    std::vector<faiss::Index::idx_t> all_indices(n);
+    std::iota(all_indices.begin(), all_indices.end(), 0);
+    const auto [nns, distances] = index.get_nearest_nodes(all_indices);
+    for(size_t i=0; i<n; ++i)
+    {
+        test(std::abs(distances[i] - index.inner_product(i, nns[i])) < 1e-6*d);
+        test(distances[i] >= std::get<1>(nns_brute_force[i*(n-1)]) - 4*max_error*d);
+    }
+
+    // merged nodes hold exact sums of the stored rows.
+    const faiss::Index::idx_t merged = index.merge(0, 1);
+    for(faiss::Index::idx_t j=2; j<n; ++j)
+        test(std::abs(index.inner_product(merged, j) - index.inner_product(0, j) - index.inner_product(1, j)) < 1e-5*d);
+    const auto [nn_merged, dist_merged] = index.get_nearest_node(merged);
+    test(nn_merged != 0 && nn_merged != 1);
+    test(std::abs(dist_merged - index.inner_product(merged, nn_merged)) < 1e-6*d);
+}
+
+void test_reranked_ivf_pq(const size_t n, const size_t d)
+{
+    std::cout << "test re-ranked IVF-PQ lookup for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+    const std::vector<std::tuple<size_t, float>> nns_brute_force = get_nearest_nodes_brute_force(n, d, features);
+
+    // all lists are probed and 4k candidates re-ranked: distances are exact for the returned nodes, which are mostly the true nearest ones.
+    const size_t k = 5;
+    feature_index_options options;
+    options.index_string = "IVF4,PQ4x4";
+    options.nprobe = 4;
+    options.rerank_depth = 4*k;
+    options.train_sample_size = n/2;
+    feature_index index(d, n, features, "Flat", false, options);
+
+    std::vector<faiss::Index::idx_t> all_indices(n);
+    std::iota(all_indices.begin(), all_indices.end(), 0);
+    const auto [nns, distances] = index.get_nearest_nodes(all_indices);
+    const auto [nns_k, distances_k] = index.get_nearest_nodes(all_indices, k);
+    size_t nr_exact = 0;
+    for(size_t i=0; i<n; ++i)
+    {
+        test(std::abs(distances[i] - index.inner_product(i, nns[i])) < 1e-6*d, "candidate not re-ranked by exact inner product");
+        nr_exact += nns[i] == std::get<0>(nns_brute_force[i*(n-1)]);
+        for(size_t l=0; l<k; ++l)
+        {
+            test(std::abs(distances_k[i*k + l] - index.inner_product(i, nns_k[i*k + l])) < 1e-6*d, "candidate not re-ranked by exact inner product");
+            test(l == 0 || distances_k[i*k + l - 1] >= distances_k[i*k + l], "re-ranked candidates not sorted");
+        }
+    }
+    test(nr_exact >= 0.9 * n, "only " + std::to_string(nr_exact) + " of " + std::to_string(n) + " nearest neighbours found with re-ranking depth " + std::to_string(4*k));
+
+    // with one of four lists probed, queries reach at most a few of the remaining active nodes, the others fall back to an exhaustive scan.
+    // Asking for all other active nodes only succeeds if they are found, so the result has to be exact either way.
+    options.nprobe = 1;
+    feature_index sparse_index(d, n, features, "Flat", false, options);
+    const size_t nr_remaining = 6;
+    for(size_t i=nr_remaining; i<n; ++i)
+        sparse_index.remove(i);
+    std::vector<faiss::Index::idx_t> remaining(nr_remaining);
+    std::iota(remaining.begin(), remaining.end(), 0);
+    const auto [nns_remaining, distances_remaining] = sparse_index.get_nearest_nodes(remaining, nr_remaining - 1);
+    for(size_t i=0; i<nr_remaining; ++i)
+    {
+        std::vector<std::tuple<size_t, float>> expected;
+        for(size_t l=0; l<n-1; ++l)
+            if(std::get<0>(nns_brute_force[i*(n-1) + l]) < nr_remaining)
+                expected.push_back(nns_brute_force[i*(n-1) + l]);
+        for(size_t l=0; l+1<nr_remaining; ++l)
+        {
+            test(nns_remaining[i*(nr_remaining-1) + l] == std::get<0>(expected[l]), "exhaustive fallback returned wrong neighbour");
+            test(std::abs(distances_remaining[i*(nr_remaining-1) + l] - std::get<1>(expected[l])) < 1e-6*d);
+        }
+    }
+}
+
+void test_serialization_version(const size_t n, const size_t d)
+{
+    std::cout << "test feature index serialization version for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+    feature_index_options options;
+    options.rerank_depth = 8;
+    feature_index index(d, n, features, "Flat", false, options);
+    index.merge(0, 1);
+
+    binary_writer writer;
+    index.serialize(writer);
+    binary_reader reader(writer.buffer());
+    const feature_index read_index(reader);
+    test(read_index.get_active_nodes() == index.get_active_nodes(), "round trip changed active nodes");
+
+    // the version follows the four byte magic.
+    std::vector<char> other_version = writer.buffer();
+    other_version[4] = 1;
+    bool thrown = false;
+    try
+    {
+        binary_reader other_reader(other_version);
+        feature_index other_index(other_reader);
+    }
+    catch(const std::runtime_error& e)
+    {
+        thrown = std::string(e.what()).find("version") != std::string::npos;
+    }
+    test(thrown, "serialized feature index with other version accepted");
+}
+
+void test_sharded_lookup(const size_t n, const size_t d, const size_t nr_shards, const std::string& index_str)
+{
+    std::cout << "test " << index_str << " lookup with " << nr_shards << " shards for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    feature_index_options options;
+    options.nr_shards = nr_shards;
+    feature_index index(d, n, features, "Flat");
+    feature_index sharded_index(d, n, features, index_str, false, options);
+
+    // merged nodes are routed to different shards than their children.
+    test(index.merge(0, 1) == sharded_index.merge(0, 1));
+    const std::vector<std::array<size_t,2>> pairs = {{2,3}, {4,5}, {6,7}, {8, n}};
+    test(index.merge(pairs) == sharded_index.merge(pairs));
+    index.remove(9);
+    sharded_index.remove(9);
+
+    const std::vector<faiss::Index::idx_t> active_nodes = index.get_active_nodes();
+    test(active_nodes == sharded_index.get_active_nodes());
+    const size_t k = 4;
+    // a batch of all nodes is searched shard by shard, single queries fan out to the shards.
+    const auto [nns, distances] = index.get_nearest_nodes(active_nodes, k);
+    const auto [sharded_nns, sharded_distances] = sharded_index.get_nearest_nodes(active_nodes, k);
+    // HNSW shards are approximate, almost all neighbours of such small graphs are still found.
+    const bool exact = index_str == "Flat";
+    size_t nr_equal = 0;
+    for(size_t i=0; i<nns.size(); ++i)
+    {
+        test(sharded_index.node_active(sharded_nns[i]));
+        test(std::abs(sharded_distances[i] - sharded_index.inner_product(active_nodes[i/k], sharded_nns[i])) < 1e-5*d);
+        test(!exact || std::abs(distances[i] - sharded_distances[i]) < 1e-6*d);
+        nr_equal += std::abs(distances[i] - sharded_distances[i]) < 1e-6*d;
+    }
+    test(nr_equal >= 0.9 * nns.size(), "sharded index misses too many nearest neighbours");
+    for(const faiss::Index::idx_t i : active_nodes)
+    {
+        const auto [nn, dist] = index.get_nearest_node(i);
+        const auto [sharded_nn, sharded_dist] = sharded_index.get_nearest_node(i);
+        test(sharded_index.node_active(sharded_nn) && sharded_nn != i);
+        test(!exact || std::abs(dist - sharded_dist) < 1e-6*d);
+    }
+}
+
+void test_file_backed_storage(const size_t n, const size_t d, const std::string index_str)
+{
+    std::cout << "test file-backed storage with " << index_str << " for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    const std::filesystem::path storage_dir = std::filesystem::temp_directory_path() / "dense_multicut_test_storage";
+    std::filesystem::remove_all(storage_dir);
+    feature_index_options options;
+    options.storage_dir = storage_dir.string();
+    options.memory_budget_mb = 1;
+    {
+        feature_index index(d, n, features, index_str);
+        feature_index file_index(d, n, features, index_str, false, options);
+        // the feature file is unlinked right after creation, only on-disk inverted lists remain visible.
+        if(index_str.rfind("IVF", 0) != 0)
+            test(std::filesystem::is_empty(storage_dir), "feature file not unlinked");
+
+        // chain of merges, the file grows beyond the memory budget and is remapped several times.
+        faiss::Index::idx_t last = 0;
+        for(size_t i=1; i<n; ++i)
+        {
+            const faiss::Index::idx_t merged = index.merge(last, i);
+            test(file_index.merge(last, i) == merged);
+            last = merged;
+        }
+        for(faiss::Index::idx_t i=0; i<=index.max_id_nr(); i+=97)
+            test(std::abs(index.inner_product(i, last) - file_index.inner_product(i, last)) <= 1e-5 * std::max(1.0, std::abs(index.inner_product(i, last))));
+        test(std::equal(index.node_features(last), index.node_features(last) + d, file_index.node_features(last)));
+    }
+    test(std::filesystem::is_empty(storage_dir), "storage files not removed");
+    std::filesystem::remove_all(storage_dir);
+}
+
+void test_mapped_float_array_budget()
+{
+    std::cout << "test memory budget of mapped float array on reads\n";
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "dense_multicut_test_mapped_array";
+    const size_t budget = 1 << 20;
+    const size_t page = sysconf(_SC_PAGESIZE);
+    mapped_float_array array(path.string(), budget);
+    test(!std::filesystem::exists(path), "file not unlinked after creation");
+    const size_t size = 8 * budget / sizeof(float);
+    array.resize(size);
+    for(size_t i=0; i<size; ++i)
+        array.data()[i] = float(i % 1000);
+    array.resize(size + 1);
+
+    // reading pages back in counts towards the budget as well, so residency stays bounded by about the budget plus one check interval.
+    const size_t floats_per_page = page / sizeof(float);
+    for(size_t pass=0; pass<2; ++pass)
+    {
+        double sum = 0.0;
+        double expected_sum = 0.0;
+        for(size_t i=0; i<size; i+=floats_per_page)
+        {
+            sum += array.data()[i];
+            expected_sum += i % 1000;
+            array.note_read(page);
+        }
+        test(sum == expected_sum, "wrong values read back");
+        test(array.resident_bytes() <= budget + budget / 8 + page, "resident " + std::to_string(array.resident_bytes()) + " bytes exceed the memory budget");
+    }
+    for(size_t i=0; i<size; i+=997)
+        test(array.data()[i] == float(i % 1000), "value changed by releasing pages");
+}
+
+void test_hnsw_parameters(const size_t n, const size_t d)
+{
+    std::cout << "test HNSW parameters for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    feature_index_options options;
+    options.hnsw_m = 24;
+    options.ef_construction = 100;
+    options.ef_search = 48;
+    const feature_index index(d, n, features, "HNSW32", false, options);
+    const faiss::IndexHNSW* hnsw_index = dynamic_cast<const faiss::IndexHNSW*>(&index.shard_index(0));
+    test(hnsw_index != nullptr, "no HNSW index built");
+    test(hnsw_index->hnsw.nb_neighbors(1) == 24, "HNSW degree " + std::to_string(hnsw_index->hnsw.nb_neighbors(1)) + " instead of 24");
+    test(hnsw_index->hnsw.efConstruction == 100, "efConstruction not set");
+    test(hnsw_index->hnsw.efSearch == 48, "efSearch not set");
+}
+
+void test_ef_search_controller()
+{
+    ef_search_controller controller(16);
+    test(controller.ef_search(4) == 16);
+    test(controller.ef_search(64) == 64);
+
+    // half of the results are tombstones and queries need retries: ef grows.
+    for(size_t b=0; b<10; ++b)
+        controller.update(100, 50, 3);
+    const size_t raised_ef = controller.ef_search(4);
+    test(raised_ef > 32);
+
+    // an index without tombstones answered in the first round lets ef decay back.
+    for(size_t b=0; b<100; ++b)
+        controller.update(100, 100, 1);
+    test(controller.ef_search(4) < raised_ef);
+    test(controller.ef_search(4) <= 17);
+
+    // a new solve starts from the base ef again.
+    for(size_t b=0; b<10; ++b)
+        controller.update(100, 50, 3);
+    controller.reset();
+    test(controller.ef_search(4) == 16, "controller not reset");
+}
 
 int main(int argc, char** argv)
 {
@@ -137,4 +417,27 @@ int main(int argc, char** argv)
     for(const size_t n : nr_nodes)
         for(const size_t d : nr_dims)
             test_exact_lookup(n, d, "Flat");
+
+    for(const size_t d : {16, 128})
+    {
+        test_reduced_precision(200, d, feature_precision::fp16, 1e-3);
+        test_reduced_precision(200, d, feature_precision::bf16, 4e-3);
+        test_reduced_precision(200, d, feature_precision::int8, 4e-3);
+    }
+
+    test_reranked_ivf_pq(400, 16);
+    test_serialization_version(100, 8);
+
+    test_hnsw_parameters(200, 16);
+    test_ef_search_controller();
+
+    for(const size_t nr_shards : {2, 3, 8})
+    {
+        test_sharded_lookup(100, 32, nr_shards, "Flat");
+        test_sharded_lookup(100, 32, nr_shards, "HNSW32");
+    }
+
+    test_file_backed_storage(4000, 64, "Flat");
+    test_file_backed_storage(4000, 64, "IVF16,Flat");
+    test_mapped_float_array_budget();
 }
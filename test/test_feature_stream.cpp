@@ -0,0 +1,84 @@
+#include "feature_stream.h"
+#include "dense_features_parser.h"
+#include "dense_multicut_utils.h"
+#include "dense_gaec.h"
+#include "test.h"
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <cmath>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+std::string write_instance(const size_t n, const size_t d, const std::string& name)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / name).string();
+    const std::vector<float> features = random_features(n, d);
+    std::ofstream f(path);
+    f << n << " " << d << "\n";
+    for(size_t i=0; i<n*d; ++i)
+        f << features[i] << (i % d == d-1 ? "\n" : " ");
+    return path;
+}
+
+void test_stream(const size_t n, const size_t d, const float dist_offset, const size_t chunk_rows)
+{
+    std::cout << "[test feature stream] " << n << " rows of dimension " << d << ", offset " << dist_offset << ", chunks of " << chunk_rows << " rows\n";
+    const std::string path = write_instance(n, d, "dense_multicut_test_stream.txt");
+    auto [features, n_read, d_read] = read_file(path);
+    if(dist_offset != 0.0)
+        features = append_dist_offset_in_features(features, dist_offset, n, d);
+    const size_t d_eff = dist_offset != 0.0 ? d+1 : d;
+
+    {
+        feature_stream stream(path, dist_offset, chunk_rows);
+        test(stream.nr_rows() == n && stream.dim() == d_eff, "wrong instance size");
+        test(stream.wait_for_rows(1) >= std::min<size_t>(1, n), "first row not parsed");
+        test(stream.wait_for_rows(n+10) == n, "not all rows parsed");
+        test(stream.features() == features, "parsed rows differ from read_file");
+        const double cost = cost_disconnected(n, d_eff, features, dist_offset != 0.0);
+        test(std::abs(stream.cost_disconnected() - cost) <= 1e-6 * std::max(1.0, std::abs(cost)), "accumulated cost " + std::to_string(stream.cost_disconnected()) + " != " + std::to_string(cost));
+    }
+
+    // same contractions as the solver on the fully read input.
+    feature_stream stream(path, dist_offset, chunk_rows);
+    solve_status pipelined_status, status;
+    const std::vector<size_t> pipelined_labels = dense_gaec_pipelined(stream, "Flat", nullptr, {}, {}, &pipelined_status);
+    const std::vector<size_t> labels = dense_gaec_flat_index(n, d_eff, features, dist_offset != 0.0, nullptr, {}, {}, &status);
+    test(pipelined_labels == labels, "pipelined labels differ");
+    test(std::abs(pipelined_status.objective - status.objective) <= 1e-6 * std::max(1.0, std::abs(status.objective)), "pipelined objective differs");
+    std::filesystem::remove(path);
+}
+
+void test_truncated_input()
+{
+    std::cout << "[test feature stream] truncated input\n";
+    const std::string path = (std::filesystem::temp_directory_path() / "dense_multicut_test_truncated.txt").string();
+    {
+        std::ofstream f(path);
+        f << "100 4\n1 2 3 4\n5 6 7";
+    }
+    feature_stream stream(path, 0.0, 1);
+    test(stream.wait_for_rows(1) >= 1, "first row not parsed");
+    bool thrown = false;
+    try
+    {
+        stream.wait_for_rows(100);
+    }
+    catch(const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    test(thrown, "truncated input not detected");
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+    test_stream(300, 16, 0.0, 64);
+    test_stream(300, 16, 0.3, 100);
+    test_stream(277, 5, 0.1, 4096);
+    test_stream(2, 3, 0.2, 1);
+    test_truncated_input();
+}
@@ -0,0 +1,98 @@
+#include "labeling_io.h"
+#include "dense_features_parser.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+// Labels like union find roots in [0, 2n).
+std::vector<size_t> random_labeling(const size_t n, const size_t nr_labels)
+{
+    std::mt19937 generator(0);
+    std::uniform_int_distribution<size_t> label_distr(0, 2*n - 1);
+    std::vector<size_t> labels(nr_labels);
+    for(size_t& l : labels)
+        l = label_distr(generator);
+    std::uniform_int_distribution<size_t> node_distr(0, nr_labels - 1);
+    std::vector<size_t> labeling(n);
+    for(size_t& l : labeling)
+        l = labels[node_distr(generator)];
+    return labeling;
+}
+
+void test_contiguous_labeling(const std::vector<size_t>& labeling)
+{
+    // serial reference: ids in order of first occurrence.
+    std::unordered_map<size_t, size_t> ids;
+    std::vector<size_t> expected(labeling.size());
+    for(size_t i=0; i<labeling.size(); ++i)
+        expected[i] = ids.emplace(labeling[i], ids.size()).first->second;
+
+    std::vector<size_t> contiguous;
+    const size_t nr_clusters = contiguous_labeling(labeling, contiguous);
+    test(nr_clusters == ids.size(), "wrong number of clusters");
+    test(contiguous == expected, "contiguous ids not in order of first occurrence");
+
+    const std::vector<size_t> sizes = cluster_sizes(contiguous, nr_clusters);
+    std::vector<size_t> expected_sizes(nr_clusters, 0);
+    for(const size_t c : expected)
+        ++expected_sizes[c];
+    test(sizes == expected_sizes, "wrong cluster sizes");
+}
+
+void test_round_trip(const std::vector<size_t>& labeling)
+{
+    std::cout << "[test labeling io] " << labeling.size() << " nodes\n";
+    const std::string path = (std::filesystem::temp_directory_path() / "dense_multicut_test_labeling").string();
+
+    write_labeling(path, labeling);
+    test(read_labeling(path) == labeling, "text labeling differs after round trip");
+    test(read_labeling_file(path) == labeling, "text labeling differs when read by read_labeling_file");
+    test(read_cluster_sizes(path).empty(), "text labeling has cluster sizes");
+    {
+        // same format as the previous ostream based writer.
+        std::ifstream f(path);
+        size_t label;
+        for(const size_t l : labeling)
+            test(f >> label && label == l, "text labeling not one label per line");
+    }
+
+    std::vector<size_t> contiguous;
+    const size_t nr_clusters = contiguous_labeling(labeling, contiguous);
+    write_labeling(path, labeling, labeling_format::binary);
+    test(read_labeling(path) == contiguous, "binary labeling differs from contiguous labeling");
+    test(read_labeling_file(path) == contiguous, "binary labeling differs when read by read_labeling_file");
+    test(read_cluster_sizes(path).empty(), "binary labeling without sizes has cluster sizes");
+    test(std::filesystem::file_size(path) == 32 + 4 * labeling.size(), "binary labeling does not use 32 bit ids");
+
+    write_labeling(path, labeling, labeling_format::binary, true);
+    test(read_labeling(path) == contiguous, "binary labeling with sizes differs from contiguous labeling");
+    test(read_cluster_sizes(path) == cluster_sizes(contiguous, nr_clusters), "wrong cluster sizes in binary labeling");
+
+    bool thrown = false;
+    try { write_labeling(path, labeling, labeling_format::text, true); } catch(const std::runtime_error&) { thrown = true; }
+    test(thrown, "cluster sizes accepted for text format");
+
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv)
+{
+    test(labeling_format_from_string("binary") == labeling_format::binary, "binary format not parsed");
+    test(labeling_format_from_string("text") == labeling_format::text, "text format not parsed");
+
+    for(const auto [n, nr_labels] : std::vector<std::pair<size_t, size_t>>{{2, 1}, {10, 10}, {1000, 37}, {100000, 5000}})
+    {
+        const std::vector<size_t> labeling = random_labeling(n, nr_labels);
+        test_contiguous_labeling(labeling);
+        test_round_trip(labeling);
+    }
+    // labels far beyond the number of nodes use the hash map fallback.
+    test_contiguous_labeling({size_t(1) << 40, 3, size_t(1) << 40, 7, 3});
+    test_round_trip({size_t(1) << 40, 3, size_t(1) << 40, 7, 3});
+}
@@ -0,0 +1,71 @@
+#include "local_search.h"
+#include "dense_multicut_utils.h"
+#include "dense_gaec.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+using namespace DENSE_MULTICUT;
+
+void check_result(const size_t n, const size_t d, const std::vector<float>& features, const float dist_offset, const local_search_result& result)
+{
+    const double objective = multicut_objective(n, d, features, result.labels, dist_offset);
+    test(std::abs(objective - result.objective) <= 1e-4 * std::max(1.0, std::abs(objective)), "objective " + std::to_string(result.objective) + " != evaluated " + std::to_string(objective));
+    test(result.objective <= result.initial_objective + 1e-6 * std::max(1.0, std::abs(result.initial_objective)), "local search increased the objective");
+    double previous = result.initial_objective;
+    for(const local_search_sweep& s : result.sweeps)
+    {
+        test(s.objective <= previous + 1e-6 * std::max(1.0, std::abs(previous)), "sweep increased the objective");
+        previous = s.objective;
+    }
+    std::vector<size_t> contiguous;
+    const size_t nr_clusters = contiguous_labeling(result.labels, contiguous);
+    test(contiguous == result.labels, "labels are not contiguous");
+    test(nr_clusters <= n, "more clusters than nodes");
+}
+
+void test_random_labeling(const size_t n, const size_t d, const size_t nr_labels, const float dist_offset, const std::string& index_str = "Flat")
+{
+    std::cout << "[test local search] random labeling of " << n << " nodes with " << nr_labels << " labels, offset " << dist_offset << ", " << index_str << " index\n";
+    const std::vector<float> features = random_features(n, d, 0);
+    std::mt19937 generator(1);
+    std::vector<size_t> labels(n);
+    for(size_t& l : labels)
+        l = std::uniform_int_distribution<size_t>(0, nr_labels-1)(generator) * 7;
+
+    const std::vector<float> offset_features = dist_offset > 0.0 ? append_dist_offset_in_features(features, dist_offset, n, d) : features;
+    const size_t offset_d = dist_offset > 0.0 ? d+1 : d;
+    local_search_options options;
+    options.index_str = index_str;
+    const local_search_result result = local_search(n, offset_d, offset_features, dist_offset > 0.0, labels, options);
+    const double initial = multicut_objective(n, d, features, labels, dist_offset);
+    test(std::abs(initial - result.initial_objective) <= 1e-4 * std::max(1.0, std::abs(initial)), "initial objective " + std::to_string(result.initial_objective) + " != evaluated " + std::to_string(initial));
+    test(n == 1 || result.objective < result.initial_objective, "random labeling not improved");
+    check_result(n, d, features, dist_offset, result);
+}
+
+void test_gaec_labeling(const size_t n, const size_t d, const float dist_offset)
+{
+    std::cout << "[test local search] GAEC labeling of " << n << " nodes, offset " << dist_offset << "\n";
+    const std::vector<float> features = random_features(n, d, 2);
+    dense_gaec_options options;
+    options.dist_offset = dist_offset;
+    const dense_gaec_result gaec = dense_gaec_solver(options).solve(n, d, features);
+    const local_search_result result = local_search(n, d+1, append_dist_offset_in_features(features, dist_offset, n, d), true, gaec.labels);
+    test(std::abs(result.initial_objective - gaec.objective) <= 1e-4 * std::max(1.0, std::abs(gaec.objective)), "initial objective differs from GAEC objective");
+    check_result(n, d, features, dist_offset, result);
+}
+
+int main(int argc, char** argv)
+{
+    test_random_labeling(1000, 16, 20, 0.0);
+    test_random_labeling(1000, 16, 20, 0.3);
+    test_random_labeling(1000, 16, 20, 0.3, "HNSW32");
+    // a single initial cluster, cluster ids for new singletons are added as nodes split off.
+    test_random_labeling(500, 8, 1, 0.5);
+    test_random_labeling(1, 4, 1, 0.1);
+    test_gaec_labeling(500, 32, 0.2);
+    test_gaec_labeling(500, 32, 1.0);
+}
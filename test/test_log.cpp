@@ -0,0 +1,44 @@
+#include "test.h"
+#include "log.h"
+#include <iostream>
+#include <sstream>
+
+using namespace DENSE_MULTICUT;
+
+int evaluated = 0;
+
+int count_evaluation()
+{
+    return ++evaluated;
+}
+
+int main(int argc, char** argv)
+{
+    std::stringstream captured;
+    std::streambuf* cout_buffer = std::cout.rdbuf(captured.rdbuf());
+
+    set_log_level(log_level::info);
+    LOG_INFO << "info " << count_evaluation() << "\n";
+    LOG_DEBUG << "debug " << count_evaluation() << "\n";
+    test(evaluated == 1, "arguments of disabled levels must not be evaluated");
+    test(captured.str() == "info 1\n");
+
+    set_log_level(log_level::trace);
+    LOG_TRACE << "trace " << count_evaluation() << "\n";
+    test(captured.str() == "info 1\ntrace 2\n");
+
+    // the macro must bind like a single statement.
+    set_log_level(log_level::off);
+    bool else_branch = false;
+    if(evaluated == 0)
+        LOG_ERROR << "unreachable\n";
+    else
+        else_branch = true;
+    test(else_branch);
+    LOG_INFO << "off " << count_evaluation() << "\n";
+    test(evaluated == 2);
+
+    std::cout.rdbuf(cout_buffer);
+    test(log_level_from_string("debug") == log_level::debug);
+    std::cout << "log test passed\n";
+}
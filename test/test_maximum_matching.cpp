@@ -0,0 +1,58 @@
+#include "test.h"
+#include "maximum_matching_greedy.h"
+#include "maximum_matching_parallel.h"
+#include <random>
+#include <vector>
+#include <set>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+void test_maximum_matching(const size_t n, const size_t m)
+{
+    std::cout << "test maximum matching for " << n << " nodes and " << m << " edges\n";
+    std::mt19937 gen(n + m);
+    std::uniform_int_distribution<size_t> node_dist(0, n-1);
+    std::uniform_real_distribution<float> cost_dist(0.0, 1.0);
+    std::vector<size_t> i, j;
+    std::vector<float> costs;
+    while(i.size() < m)
+    {
+        const size_t k = node_dist(gen);
+        const size_t l = node_dist(gen);
+        if(k == l)
+            continue;
+        i.push_back(k);
+        j.push_back(l);
+        costs.push_back(cost_dist(gen));
+    }
+
+    const std::vector<std::array<size_t,2>> greedy = maximum_matching_greedy(i.begin(), i.end(), j.begin(), costs.begin());
+    const std::vector<std::array<size_t,2>> parallel = maximum_matching_parallel(i.begin(), i.end(), j.begin(), costs.begin());
+
+    // for distinct costs the locally dominant matching is the greedy matching.
+    auto normalized = [](const std::vector<std::array<size_t,2>>& matching) {
+        std::set<std::array<size_t,2>> edges;
+        for(const auto [k,l] : matching)
+            edges.insert({std::min(k,l), std::max(k,l)});
+        return edges;
+    };
+    test(normalized(parallel) == normalized(greedy), "parallel matching differs from greedy matching");
+
+    std::vector<char> covered(n, false);
+    for(const auto [k,l] : parallel)
+    {
+        test(!covered[k] && !covered[l], "parallel matching is not a matching");
+        covered[k] = true;
+        covered[l] = true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    test_maximum_matching(2, 1);
+    test_maximum_matching(10, 20);
+    test_maximum_matching(1000, 1000);
+    test_maximum_matching(1000, 20000);
+    test_maximum_matching(100000, 300000);
+}
@@ -0,0 +1,127 @@
+#include "test.h"
+#include "merge_tree.h"
+#include "dense_gaec.h"
+#include "dense_gaec_adj_matrix.h"
+#include "dense_gaec_incremental_nn.h"
+#include <random>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <stdexcept>
+
+using namespace DENSE_MULTICUT;
+
+bool same_partition(const std::vector<size_t>& a, const std::vector<size_t>& b)
+{
+    if(a.size() != b.size())
+        return false;
+    std::map<size_t, size_t> a_to_b, b_to_a;
+    for(size_t i=0; i<a.size(); ++i)
+    {
+        if(a_to_b.insert({a[i], b[i]}).first->second != b[i])
+            return false;
+        if(b_to_a.insert({b[i], a[i]}).first->second != a[i])
+            return false;
+    }
+    return true;
+}
+
+void test_merge_tree(const size_t n, const size_t d)
+{
+    std::cout << "test merge tree for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    merge_tree tree;
+    const std::vector<size_t> labeling = dense_gaec_flat_index(n, d, features, false, &tree);
+    test(tree.nr_nodes() == n);
+    test(same_partition(labeling, tree.labeling(tree.nr_contractions())), "full tree does not reproduce solver labeling");
+
+    merge_tree tree_adj;
+    const std::vector<size_t> labeling_adj = dense_gaec_adj_matrix(n, d, features, false, &tree_adj);
+    test(same_partition(labeling_adj, tree_adj.labeling(tree_adj.nr_contractions())), "full tree does not reproduce adjacency matrix labeling");
+
+    for(const merge_tree::contraction& c : tree.contractions())
+        test(c.cost > 0.0 && c.runner_up_cost <= c.cost + 1e-4);
+
+    tree.write("test_merge_tree.bin");
+    const merge_tree tree_read = merge_tree::read("test_merge_tree.bin");
+    test(tree_read.nr_contractions() == tree.nr_contractions());
+    for(size_t c=0; c<tree.nr_contractions(); ++c)
+    {
+        test(tree_read.contractions()[c].i == tree.contractions()[c].i);
+        test(tree_read.contractions()[c].j == tree.contractions()[c].j);
+        test(tree_read.contractions()[c].cost == tree.contractions()[c].cost);
+        test(tree_read.contractions()[c].size_i == tree.contractions()[c].size_i);
+    }
+
+    const auto sweep = threshold_sweep(tree, {0.0, 1e6});
+    test(sweep[0].exact && same_partition(sweep[0].labeling, labeling));
+    test(sweep[1].nr_contractions == 0);
+    test(tree.labeling_with_nr_clusters(n).size() == n);
+}
+
+// With k=1 the queue of inc-NN drains long before all positive edges are contracted and the remaining ones are found by rechecks,
+// so its contractions must not be certified as the greedy choice at other offsets.
+void test_incremental_nn_sweep(const size_t n, const size_t d)
+{
+    std::cout << "test threshold sweep of inc-NN merge tree for " << n << " elements of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+
+    merge_tree tree;
+    const std::vector<size_t> labeling = dense_gaec_incremental_nn(n, d, features, 1, "Flat", false, &tree);
+    test(tree.nr_contractions() > 1);
+    test(same_partition(labeling, tree.labeling(tree.nr_contractions())), "full tree does not reproduce inc-NN labeling");
+    for(const merge_tree::contraction& c : tree.contractions())
+        test(std::isinf(c.runner_up_cost), "inc-NN contraction recorded with a runner-up cost");
+
+    const auto sweep = threshold_sweep(tree, {0.0, 0.01});
+    test(sweep[0].exact && same_partition(sweep[0].labeling, labeling));
+    test(!sweep[1].exact && sweep[1].first_uncertain_contraction == 0, "inc-NN contractions certified at a larger offset");
+}
+
+void test_read_invalid()
+{
+    std::cout << "test reading invalid merge trees\n";
+    merge_tree tree(4);
+    tree.add_contraction(0, 1, 4, 1.0);
+    tree.add_contraction(2, 4, 5, 0.5);
+    tree.write("test_merge_tree_invalid.bin");
+    test(merge_tree::read("test_merge_tree_invalid.bin").nr_contractions() == 2);
+
+    // offsets of the ids of the second contraction in the 4 byte id table after the header.
+    const size_t ids_begin = 4 + sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(float) + sizeof(uint8_t);
+    auto read_with_ids = [&](const uint32_t i, const uint32_t j) {
+        std::fstream f("test_merge_tree_invalid.bin", std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(ids_begin + 2 * sizeof(uint32_t));
+        f.write(reinterpret_cast<const char*>(&i), sizeof(i));
+        f.write(reinterpret_cast<const char*>(&j), sizeof(j));
+        f.close();
+        try
+        {
+            merge_tree::read("test_merge_tree_invalid.bin");
+        }
+        catch(const std::runtime_error&)
+        {
+            return false;
+        }
+        return true;
+    };
+    test(read_with_ids(2, 4), "valid contraction rejected");
+    test(!read_with_ids(2, 5), "contraction of a node created later accepted");
+    test(!read_with_ids(2, 100), "node id beyond the tree accepted");
+    test(!read_with_ids(3, 3), "contraction of a node with itself accepted");
+    test(!read_with_ids(0, 2), "node contracted twice accepted");
+}
+
+int main(int argc, char** argv)
+{
+    const std::vector<size_t> nr_nodes = {10,20,50,100};
+    const std::vector<size_t> nr_dims = {16,32,64};
+    for(const size_t n : nr_nodes)
+        for(const size_t d : nr_dims)
+            test_merge_tree(n, d);
+    test_incremental_nn_sweep(200, 8);
+    test_read_invalid();
+}
@@ -0,0 +1,70 @@
+#include "test.h"
+#include "metrics.h"
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+const metric_snapshot& find_metric(const metrics_snapshot& snapshot, const std::string& name)
+{
+    for(const metric_snapshot& m : snapshot.metrics)
+        if(m.name == name)
+            return m;
+    throw std::runtime_error("metric " + name + " not found");
+}
+
+int main(int argc, char** argv)
+{
+    metrics_registry& registry = metrics_registry::instance();
+    const size_t counter = registry.register_metric("test counter", metric_kind::counter);
+    const size_t histogram = registry.register_metric("test histogram", metric_kind::histogram);
+    const size_t gauge = registry.register_metric("test gauge", metric_kind::gauge);
+    const size_t quoted = registry.register_metric("test \"quoted\" \\ name", metric_kind::counter);
+    test(registry.register_metric("test counter", metric_kind::counter) == counter, "metric registered twice");
+
+    const size_t nr_threads = 8;
+    const size_t nr_updates = 10000;
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<nr_threads; ++t)
+        threads.emplace_back([&, t]() {
+            for(size_t c=0; c<nr_updates; ++c)
+            {
+                registry.increment(counter, 2.0);
+                registry.add(histogram, double(t + 1));
+            }
+        });
+    // snapshots while threads record must not disturb the final result.
+    for(size_t c=0; c<10; ++c)
+        registry.snapshot();
+    for(auto& t : threads)
+        t.join();
+    // shards of finished threads are folded into the retired shard.
+    test(registry.nr_shards() == 1, "shards of finished threads not freed");
+    registry.increment(quoted, 1.0);
+    registry.set(gauge, 5.0);
+    registry.set(gauge, 3.0);
+
+    const metrics_snapshot snapshot = registry.snapshot();
+    const metric_snapshot& c = find_metric(snapshot, "test counter");
+    test(c.count == nr_threads * nr_updates, "counter lost updates");
+    test(c.sum == 2.0 * nr_threads * nr_updates, "counter sum is wrong");
+
+    const metric_snapshot& h = find_metric(snapshot, "test histogram");
+    test(h.min == 1.0 && h.max == double(nr_threads), "histogram min or max is wrong");
+    // values 1..8 are equally frequent, so the median lies between 4 and 5.
+    test(h.quantile(0.5) >= 4.0 && h.quantile(0.5) <= 5.0, "histogram median " + std::to_string(h.quantile(0.5)) + " is wrong");
+    test(h.quantile(0.99) == 8.0 && h.quantile(0.0) >= 1.0, "histogram quantiles exceed min or max");
+
+    const metric_snapshot& g = find_metric(snapshot, "test gauge");
+    test(g.last == 3.0, "gauge does not report most recent value");
+
+    const std::string csv = metrics_csv(snapshot);
+    test(csv.find("\"test counter\",counter,80000,160000") != std::string::npos, "counter missing in CSV output");
+    const std::string json = metrics_json(snapshot);
+    test(json.find("{\"name\": \"test counter\", \"kind\": \"counter\", \"count\": 80000, \"sum\": 160000, \"mean\": 2, \"rate_per_second\"") != std::string::npos,
+            "counter in JSON output has min or max");
+    test(json.find("\"test \\\"quoted\\\" \\\\ name\"") != std::string::npos, "metric name not escaped in JSON output");
+    test(csv.find("\"test \"\"quoted\"\" \\ name\"") != std::string::npos, "metric name not escaped in CSV output");
+    std::cout << json;
+}
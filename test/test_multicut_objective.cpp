@@ -0,0 +1,58 @@
+#include "dense_multicut_utils.h"
+#include "dense_gaec.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+double brute_force_objective(const size_t n, const size_t d, const std::vector<float>& features, const std::vector<size_t>& labels, const float dist_offset)
+{
+    double obj = 0.0;
+    for(size_t i=0; i<n; ++i)
+        for(size_t j=i+1; j<n; ++j)
+            if(labels[i] != labels[j])
+            {
+                for(size_t l=0; l<d; ++l)
+                    obj += double(features[i*d + l]) * features[j*d + l];
+                obj -= dist_offset;
+            }
+    return obj;
+}
+
+void test_objective(const size_t n, const size_t d, const size_t nr_labels, const size_t label_stride, const float dist_offset)
+{
+    std::cout << "[test multicut objective] " << n << " nodes, " << nr_labels << " labels with stride " << label_stride << ", offset " << dist_offset << "\n";
+    const std::vector<float> features = random_features(n, d);
+    std::mt19937 generator(0);
+    std::vector<size_t> labels(n);
+    for(size_t& l : labels)
+        l = std::uniform_int_distribution<size_t>(0, nr_labels-1)(generator) * label_stride;
+
+    const double expected = brute_force_objective(n, d, features, labels, dist_offset);
+    const double objective = multicut_objective(n, d, features, labels, dist_offset);
+    test(std::abs(objective - expected) <= 1e-6 * std::max(1.0, std::abs(expected)), "objective " + std::to_string(objective) + " != " + std::to_string(expected));
+}
+
+void test_solver_objective(const size_t n, const size_t d, const float dist_offset)
+{
+    std::cout << "[test multicut objective] matches solver objective for " << n << " nodes, offset " << dist_offset << "\n";
+    const std::vector<float> features = random_features(n, d, 1);
+    dense_gaec_options options;
+    options.dist_offset = dist_offset;
+    const dense_gaec_result result = dense_gaec_solver(options).solve(n, d, features);
+    const double objective = multicut_objective(n, d, features, result.labels, dist_offset);
+    test(std::abs(objective - result.objective) <= 1e-4 * std::max(1.0, std::abs(objective)), "objective " + std::to_string(objective) + " != solver objective " + std::to_string(result.objective));
+}
+
+int main(int argc, char** argv)
+{
+    test_objective(500, 16, 1, 1, 0.0);
+    test_objective(500, 16, 500, 1, 0.0);
+    test_objective(500, 16, 10, 1, 0.3);
+    test_objective(800, 7, 37, 1000003, 0.1);
+    test_objective(1, 4, 1, 1, 0.5);
+    test_solver_objective(1000, 32, 0.0);
+    test_solver_objective(1000, 32, 0.2);
+}
@@ -0,0 +1,58 @@
+#include "node_id.h"
+#include "dense_gaec.h"
+#include "dense_gaec_parallel.h"
+#include "dense_gaec_incremental_nn.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <functional>
+#include <limits>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+using solver = std::function<std::vector<size_t>(const size_t, const size_t, const std::vector<float>&, solve_status*)>;
+
+// Solves once with 32-bit and once with forced 64-bit ids, both have to perform the same contractions.
+void test_id_widths(const std::string& name, const size_t n, const size_t d, const solver& solve)
+{
+    std::cout << "[test node id] " << name << " with 32 and 64-bit ids for " << n << " nodes of dimension " << d << "\n";
+    const std::vector<float> features = random_features(n, d);
+    test(fits_32bit_ids(n));
+    solve_status status_32;
+    const std::vector<size_t> labels_32 = solve(n, d, features, &status_32);
+
+    force_64bit_ids() = true;
+    test(!fits_32bit_ids(n), "64-bit ids not forced");
+    solve_status status_64;
+    const std::vector<size_t> labels_64 = solve(n, d, features, &status_64);
+    force_64bit_ids() = false;
+
+    test(labels_32 == labels_64, name + ": labeling differs between 32 and 64-bit ids");
+    test(status_32.nr_contractions == status_64.nr_contractions && status_32.nr_clusters == status_64.nr_clusters, name + ": number of contractions differs");
+    test(status_32.objective == status_64.objective, name + ": objective " + std::to_string(status_32.objective) + " != " + std::to_string(status_64.objective));
+}
+
+// All 2n-1 ids of a full contraction sequence and the sentinel 2n used by the graph solver have to fit when 32-bit ids are chosen.
+void test_32bit_limit()
+{
+    const size_t max_n = size_t(std::numeric_limits<uint32_t>::max()) / 2;
+    test(fits_32bit_ids(max_n), "largest n with 32-bit ids rejected");
+    test(2 * max_n <= std::numeric_limits<uint32_t>::max(), "sentinel id does not fit");
+    test(uint32_t(2 * max_n - 2) == 2 * max_n - 2, "largest contracted id does not fit");
+    test(!fits_32bit_ids(max_n + 1), "n above the 32-bit limit accepted");
+    test(!fits_32bit_ids(size_t(std::numeric_limits<uint32_t>::max()) + 1));
+}
+
+int main(int argc, char** argv)
+{
+    test_32bit_limit();
+    test_id_widths("flat index", 500, 8, [](const size_t n, const size_t d, const std::vector<float>& features, solve_status* status) {
+            return dense_gaec_flat_index(n, d, features, false, nullptr, {}, {}, status); });
+    test_id_widths("flat index with offset", 500, 8, [](const size_t n, const size_t d, const std::vector<float>& features, solve_status* status) {
+            return dense_gaec_flat_index(n, d + 1, append_dist_offset_in_features(features, 0.5, n, d), true, nullptr, {}, {}, status); });
+    test_id_widths("parallel flat index", 500, 8, [](const size_t n, const size_t d, const std::vector<float>& features, solve_status* status) {
+            return dense_gaec_parallel_flat_index(n, d, features, false, nullptr, false, 1, {}, {}, status); });
+    test_id_widths("inc-NN", 500, 8, [](const size_t n, const size_t d, const std::vector<float>& features, solve_status* status) {
+            return dense_gaec_incremental_nn(n, d, features, 5, "Flat", false, nullptr, {}, {}, {}, status); });
+}
@@ -0,0 +1,83 @@
+#include "test.h"
+#include "perf_counters.h"
+#include <thread>
+#include <vector>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+const perf_region_summary& find_region(const std::vector<perf_region_summary>& summary, const std::string& name)
+{
+    for(const perf_region_summary& r : summary)
+        if(r.name == name)
+            return r;
+    throw std::runtime_error("region " + name + " not found");
+}
+
+double busy_work(const size_t nr_iterations)
+{
+    volatile double x = 0.0;
+    for(size_t i=0; i<nr_iterations; ++i)
+        x = x + 1.0 / (i + 1);
+    return x;
+}
+
+int main(int argc, char** argv)
+{
+    perf_counters& counters = perf_counters::instance();
+    const size_t outer = counters.register_region("test outer");
+    const size_t inner = counters.register_region("test inner");
+    test(counters.register_region("test outer") == outer, "region registered twice");
+
+    {
+        const perf_region region(outer);
+        busy_work(1000);
+    }
+    test(find_region(counters.summary(), "test outer").calls == 0, "region recorded before profiling was enabled");
+
+    const bool hardware_counters = counters.enable();
+    std::cout << "[test perf counters] hardware counters " << (hardware_counters ? "available" : "not available") << "\n";
+
+    const size_t nr_threads = 4;
+    const size_t nr_calls = 10;
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<nr_threads; ++t)
+        threads.emplace_back([&]() {
+            for(size_t c=0; c<nr_calls; ++c)
+            {
+                const perf_region outer_region(outer);
+                busy_work(100000);
+                const perf_region inner_region(inner);
+                busy_work(10000);
+            }
+        });
+    for(auto& t : threads)
+        t.join();
+
+    const std::vector<perf_region_summary> summary = counters.summary();
+    const perf_region_summary& o = find_region(summary, "test outer");
+    const perf_region_summary& i = find_region(summary, "test inner");
+    test(o.calls == nr_threads * nr_calls && i.calls == nr_threads * nr_calls, "wrong number of region calls");
+    test(o.nr_threads == nr_threads && i.nr_threads == nr_threads, "regions not aggregated over threads");
+    test(o.seconds > 0.0 && i.seconds <= o.seconds, "nested region took longer than enclosing region");
+    if(hardware_counters)
+    {
+        test(o.has(perf_event::instructions) && o.count(perf_event::instructions) > i.count(perf_event::instructions), "nested region counted more instructions than enclosing region");
+        test(!o.has(perf_event::cycles) || o.ipc() > 0.0, "no IPC with cycles and instructions counted");
+    }
+    else
+    {
+        for(size_t e=0; e<nr_perf_events; ++e)
+            test(!o.has(perf_event(e)) && o.counts[e] == 0.0, "counts reported without hardware counters");
+    }
+
+    const size_t ended = counters.register_region("test ended");
+    {
+        perf_region region(ended);
+        busy_work(1000);
+        region.end();
+        region.end();
+    }
+    test(find_region(counters.summary(), "test ended").calls == 1, "region ended explicitly recorded more than once");
+    counters.report();
+}
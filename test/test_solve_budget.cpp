@@ -0,0 +1,107 @@
+#include "dense_gaec.h"
+#include "dense_gaec_parallel.h"
+#include "dense_gaec_incremental_nn.h"
+#include "merge_tree.h"
+#include "dense_multicut_utils.h"
+#include "test.h"
+#include <random>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <map>
+#include <array>
+#include <limits>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+using budgeted_solver = std::function<std::vector<size_t>(const std::vector<float>&, const solve_budget&, solve_status*)>;
+
+void test_contraction_budget(const std::string& name, const size_t n, const size_t d, const budgeted_solver& solve)
+{
+    std::cout << "[test solve budget] " << name << " with contraction budget\n";
+    const std::vector<float> features = random_features(n, d);
+    solve_status full;
+    solve(features, {}, &full);
+    test(full.is_final, name + ": unlimited solve not final");
+    test(full.nr_contractions > 10, name + ": too few contractions for the test");
+
+    const size_t max_contractions = full.nr_contractions / 2;
+    solve_status partial;
+    const std::vector<size_t> labels = solve(features, {0.0, max_contractions}, &partial);
+    test(!partial.is_final, name + ": budgeted solve reported final");
+    test(partial.nr_contractions == max_contractions, name + ": " + std::to_string(partial.nr_contractions) + " contractions instead of " + std::to_string(max_contractions));
+    test(partial.nr_clusters == n - max_contractions, name + ": wrong cluster count");
+    const double expected = multicut_objective(n, d, features, labels);
+    test(std::abs(partial.objective - expected) <= 1e-3 * std::max(1.0, std::abs(expected)), name + ": objective of partial labeling is off");
+    test(partial.objective >= full.objective - 1e-3 * std::abs(full.objective), name + ": partial labeling better than the final one");
+}
+
+void test_time_budget(const size_t n, const size_t d)
+{
+    std::cout << "[test solve budget] flat index with time budget\n";
+    const std::vector<float> features = random_features(n, d);
+    solve_status status;
+    const std::vector<size_t> labels = dense_gaec_flat_index(n, d, features, false, nullptr, {}, {1e-9, 0}, &status);
+    test(!status.is_final, "expired deadline gave final labeling");
+    test(std::abs(status.objective - multicut_objective(n, d, features, labels)) <= 1e-3 * std::max(1.0, std::abs(status.objective)), "objective of partial labeling is off");
+}
+
+// A contraction budget ending within the first round of the parallel solver must contract the highest cost edges of the round's matching.
+void test_parallel_truncated_round(const size_t n, const size_t d)
+{
+    std::cout << "[test solve budget] parallel with budget ending within a round\n";
+    const std::vector<float> features = random_features(n, d);
+    auto contracted_edges = [&](const size_t max_contractions) {
+        merge_tree tree;
+        dense_gaec_parallel_flat_index(n, d, features, false, &tree, false, 1, {}, {0.0, max_contractions});
+        std::map<std::array<size_t,2>, float> edges;
+        for(const merge_tree::contraction& c : tree.contractions())
+            edges[{std::min(c.i, c.j), std::max(c.i, c.j)}] = c.cost;
+        return edges;
+    };
+    // a matching of nearest neighbour edges of random points in the first round has far more than 20 edges.
+    const auto top = contracted_edges(5);
+    const auto round = contracted_edges(20);
+    test(top.size() == 5 && round.size() == 20);
+    float min_top_cost = std::numeric_limits<float>::infinity();
+    for(const auto& [edge, cost] : top)
+    {
+        test(round.count(edge) == 1, "edge of the smaller budget missing with the larger one");
+        min_top_cost = std::min(min_top_cost, cost);
+    }
+    for(const auto& [edge, cost] : round)
+        if(top.count(edge) == 0)
+            test(cost <= min_top_cost, "truncated round skipped a higher cost edge");
+
+    // the highest cost edge overall is matched in every round it is present in.
+    double max_cost = 0.0;
+    std::array<size_t,2> max_edge;
+    for(size_t i=0; i<n; ++i)
+        for(size_t j=i+1; j<n; ++j)
+        {
+            double cost = 0.0;
+            for(size_t l=0; l<d; ++l)
+                cost += double(features[i*d + l]) * features[j*d + l];
+            if(cost > max_cost)
+            {
+                max_cost = cost;
+                max_edge = {i, j};
+            }
+        }
+    test(top.count(max_edge) == 1, "highest cost edge not contracted in truncated round");
+}
+
+int main(int argc, char** argv)
+{
+    const size_t n = 300;
+    const size_t d = 8;
+    test_contraction_budget("flat index", n, d, [&](const std::vector<float>& f, const solve_budget& b, solve_status* s) {
+            return dense_gaec_flat_index(n, d, f, false, nullptr, {}, b, s); });
+    test_contraction_budget("incremental nn", n, d, [&](const std::vector<float>& f, const solve_budget& b, solve_status* s) {
+            return dense_gaec_incremental_nn(n, d, f, 5, "Flat", false, nullptr, {}, {}, b, s); });
+    test_contraction_budget("parallel", n, d, [&](const std::vector<float>& f, const solve_budget& b, solve_status* s) {
+            return dense_gaec_parallel_flat_index(n, d, f, false, nullptr, false, 1, {}, b, s); });
+    test_time_budget(2000, d);
+    test_parallel_truncated_round(n, d);
+}
@@ -0,0 +1,51 @@
+#include "test.h"
+#include "union_find.hxx"
+#include "concurrent_union_find.hxx"
+#include <random>
+#include <vector>
+#include <array>
+#include <iostream>
+
+using namespace DENSE_MULTICUT;
+
+void test_union_find(const size_t n, const size_t m)
+{
+    std::cout << "test concurrent union find for " << n << " elements and " << m << " merges\n";
+    std::mt19937 gen(n + m);
+    std::uniform_int_distribution<size_t> dist(0, n-1);
+    std::vector<std::array<size_t,2>> merges(m);
+    for(auto& [x,y] : merges)
+    {
+        x = dist(gen);
+        y = dist(gen);
+    }
+
+    union_find<> uf(n);
+    for(const auto [x,y] : merges)
+        uf.merge(x,y);
+
+    concurrent_union_find<uint32_t> cuf(n);
+#pragma omp parallel for num_threads(4) schedule(dynamic, 16)
+    for(size_t c=0; c<m; ++c)
+        cuf.merge(merges[c][0], merges[c][1]);
+
+    test(cuf.count() == uf.count(), "concurrent union find has a different number of sets");
+    const std::vector<size_t> ids = uf.get_contiguous_ids();
+    const std::vector<uint32_t> concurrent_ids = cuf.get_contiguous_ids();
+    for(size_t i=0; i<n; ++i)
+    {
+        test(ids[i] < uf.count(), "contiguous id out of range");
+        test(concurrent_ids[i] < cuf.count(), "concurrent contiguous id out of range");
+        test(cuf.connected(i, merges[i % m][0]) == uf.connected(i, merges[i % m][0]), "concurrent union find disagrees on connectivity");
+    }
+    for(size_t i=0; i<n; ++i)
+        for(const size_t j : {size_t(0), dist(gen), dist(gen)})
+            test((ids[i] == ids[j]) == (concurrent_ids[i] == concurrent_ids[j]), "concurrent union find gives a different partition");
+}
+
+int main(int argc, char** argv)
+{
+    test_union_find(10, 5);
+    test_union_find(1000, 500);
+    test_union_find(100000, 90000);
+}